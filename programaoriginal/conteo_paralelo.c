@@ -2,296 +2,1095 @@
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
+#include <stdint.h>
 #include <omp.h>
 
-#ifdef _WIN32
-    #include <windows.h>
-#else
-    #include <sys/time.h>
-#endif
+#include "votos.h"
 
-#define MAX_CANDIDATOS 10
-#define MAX_BOLETAS 10000000  
+#define TITULO_RESULTADOS "     RESULTADOS DEL CONTEO PARALELO     "
+#define TITULO_ARCHIVO "RESULTADOS CONTEO PARALELO (OpenMP)"
+#define ARCHIVO_RESULTADOS "resultados_paralelo.txt"
+#define REPETICIONES_COMPARACION 5
+#define ARCHIVO_BENCH_CSV "bench_resultados.csv"
+#define ARCHIVO_BENCH_JSON "bench_resultados.json"
 
-double obtenerTiempoAlta() {
-    #ifdef _WIN32
-        LARGE_INTEGER frequency, counter;
-        QueryPerformanceFrequency(&frequency);
-        QueryPerformanceCounter(&counter);
-        return (double)counter.QuadPart / (double)frequency.QuadPart;
-    #else
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        return tv.tv_sec + tv.tv_usec / 1000000.0;
-    #endif
+typedef struct {
+    int modoPrueba;
+    int usarHugePages;
+    int modoBenchmarkSimd;
+    int modoBenchmarkCandidatos;
+    int modoBenchmarkHilos;
+    int modoBenchmarkClasificacion;
+    int modoBenchmarkTuberia;
+    int modoSuite;
+    int modoNuma;
+    int instrumentar;
+    int recalibrar;
+    const char *backend;
+    const char *isa;
+    const char *archivoEntrada;
+    const char *archivoExportar;
+    uint64_t semilla;
+    int numHilos;
+    long long boletasFusionado;
+    long long boletasIncremental;
+    long long boletasRegiones;
+    long long boletasArena;
+    long long boletasPreferencial;
+    int escanos;
+    const char *socketServidor;
+    const char *socketCarga;
+    int numClientes;
+    int lotesPorCliente;
+    int cerrarServidor;
+    const char *registroControl;
+    long long caidaTramos;
+    int auditoria;
+    const char *verificarAuditoria;
+    long long muestraAuditoria;
+    int semillaFijada;
+    uint64_t semillaMuestra;
+    long long boletasAuditoria;
+    long long boletasEstimacion;
+    int boletasPorLote;
+    int numCandidatos;
+    int numProcesos;
+    long long fragmentoConFallo;
+    int descriptorTrabajador;
+} Opciones;
+
+// Compara el conteo con un hilo del backend "simd" (lo que hace el programa secuencial)
+// sobre las mismas boletas, con calentamiento y varias repeticiones de cada uno
+void compararTiempos(const FuenteBoletas *fuente, const ParametrosConteo *parametros, 
+                     const char *backend) {
+    ParametrosConteo unHilo = {parametros->isa, 1, NULL, parametros->usarHugePages, NULL};
+    ParametrosConteo conHilos = *parametros;
+    MedicionBenchmark secuencial, paralelo;
+    conHilos.tiempos = NULL;
+    conHilos.auditoria = NULL;
+    if (medirConteo("simd", fuente, &unHilo, 1, REPETICIONES_COMPARACION, &secuencial) != 0 ||
+        medirConteo(backend, fuente, &conHilos, 1, REPETICIONES_COMPARACION, &paralelo) != 0) {
+        return;
+    }
+    
+    double tiempoSecuencial = secuencial.mediana;
+    double tiempoParalelo = paralelo.mediana;
+    double speedup = tiempoSecuencial / tiempoParalelo;
+    double eficiencia = speedup / paralelo.numHilos * 100;
+    
+    printf("\n========================================\n");
+    printf("         COMPARACIoN DE TIEMPOS         \n");
+    printf("========================================\n");
+    printf("  Mediana de %d repeticiones (tras 1 de calentamiento)\n", REPETICIONES_COMPARACION);
+    printf("  Tiempo secuencial:  %.6f seg (%.3f ms, p95 %.3f ms)\n", 
+           tiempoSecuencial, tiempoSecuencial * 1000, secuencial.p95 * 1000);
+    printf("  Tiempo paralelo:    %.6f seg (%.3f ms, p95 %.3f ms, %d hilos)\n", 
+           tiempoParalelo, tiempoParalelo * 1000, paralelo.p95 * 1000, paralelo.numHilos);
+    printf("  Speedup obtenido:   %.2fx\n", speedup);
+    printf("  Eficiencia:         %.1f%%\n", eficiencia);
+    printf("  Mejora de tiempo:   %.3f ms\n", 
+           (tiempoSecuencial - tiempoParalelo) * 1000);
+    
+    if (speedup < 1.0) {
+        printf("\n   El programa paralelo es mas lento.\n");
+        printf("  Posibles causas:\n");
+        printf("  - Pocas boletas (overhead > beneficio)\n");
+        printf("  - Demasiados hilos para el trabajo\n");
+        printf("  - Competencia por recursos del sistema\n");
+        printf("\n  Sugerencias:\n");
+        printf("  - Use al menos 1,000,000 boletas\n");
+        printf("  - Use el autoajuste de hilos (0 hilos o -recalibrar)\n");
+    } else if (speedup > 1.0 && speedup < 1.5) {
+        printf("\n  Mejora modesta. Para mejor rendimiento:\n");
+        printf("  - Aumente el numero de boletas\n");
+        printf("  - Ajuste el numero de hilos\n");
+    } else {
+        printf("\n  Buen speedup obtenido!\n");
+    }
+    
+    printf("========================================\n");
+}
+
+void mostrarRaizAuditoria(const ArbolAuditoria *arbol) {
+    printf("\nRaiz de auditoria (SHA-256 %s, %lld hojas): ", implementacionSha256(), arbol->numHojas);
+    for (int i = 0; i < BYTES_HASH; i++) {
+        printf("%02x", arbol->raiz[i]);
+    }
+    printf("\n");
 }
 
-void generarBoletasAleatorias(char **matriz, int numBoletas, int numCandidatos) {
-    srand(time(NULL));
+// Recalcula una muestra de hojas: la de un contenedor, leyendo sus chunks del archivo
+// de boletas; la de boletas generadas en memoria, generandolas otra vez con la semilla.
+// La semilla de la muestra se imprime para poder repetir la misma verificacion
+int ejecutarVerificacionAuditoria(const Opciones *opciones) {
+    ArbolAuditoria arbol;
+    if (leerAuditoria(opciones->verificarAuditoria, &arbol) != 0) {
+        return 1;
+    }
+    int numHilos = opciones->numHilos > 0 ? opciones->numHilos : omp_get_num_procs();
+    if (arbol.hojasDeChunks) {
+        printf("Verificando '%s': %lld boletas, %d candidatos, %lld hojas (chunks de '%s')\n",
+               opciones->verificarAuditoria, arbol.numBoletas, arbol.numCandidatos, arbol.numHojas,
+               opciones->archivoEntrada != NULL ? opciones->archivoEntrada : "?");
+    } else {
+        printf("Verificando '%s': %lld boletas, %d candidatos, %lld hojas (semilla %llu)\n",
+               opciones->verificarAuditoria, arbol.numBoletas, arbol.numCandidatos, arbol.numHojas,
+               (unsigned long long)opciones->semilla);
+    }
+    printf("Semilla de la muestra: %llu (repetir con -semilla-muestra)\n",
+           (unsigned long long)opciones->semillaMuestra);
     
-    for (int i = 0; i < numBoletas; i++) {
-        for (int j = 0; j < numCandidatos; j++) {
-            matriz[i][j] = ' ';
+    long long fallos;
+    if (arbol.hojasDeChunks) {
+        ContenedorBoletas contenedor;
+        if (opciones->archivoEntrada == NULL) {
+            printf("Error: La auditoria es de un contenedor: indique el archivo de boletas con -archivo\n");
+            fallos = -1;
+        } else if (abrirContenedor(&contenedor, opciones->archivoEntrada) != 0) {
+            fallos = -1;
+        } else {
+            fallos = verificarAuditoriaContenedor(&arbol, &contenedor, opciones->muestraAuditoria,
+                                                  opciones->semillaMuestra, numHilos);
+            cerrarContenedor(&contenedor);
         }
-        
-        int tipoVoto = rand() % 100;
-        
-        if (tipoVoto < 70) {
-            int candidato = rand() % numCandidatos;
-            matriz[i][candidato] = 'X';
-        } 
-        else if (tipoVoto < 85) {
-            int numMarcas = 2 + rand() % 3; 
-            for (int m = 0; m < numMarcas; m++) {
-                int candidato = rand() % numCandidatos;
-                matriz[i][candidato] = 'X';
-            }
+        if (fallos == 0) {
+            printf("Auditoria verificada: la muestra y la raiz coinciden\n");
+        } else if (fallos > 0) {
+            printf("Auditoria FALLIDA: %lld comprobaciones no coinciden\n", fallos);
         }
+        liberarArbolAuditoria(&arbol);
+        return fallos == 0 ? 0 : 1;
+    }
+    if (opciones->archivoEntrada != NULL) {
+        printf("Error: La auditoria es de boletas generadas en memoria: se verifica con su -semilla, "
+               "no con -archivo\n");
+        liberarArbolAuditoria(&arbol);
+        return 1;
+    }
+    
+    AlmacenBoletas almacen;
+    if (crearAlmacenBoletas(&almacen, arbol.numBoletas, arbol.numCandidatos, opciones->usarHugePages) != 0) {
+        printf("Error: No se pudo reservar memoria para %lld boletas\n", arbol.numBoletas);
+        liberarArbolAuditoria(&arbol);
+        return 1;
     }
+    generarBoletasAleatorias(&almacen, opciones->semilla, numHilos);
+    fallos = verificarAuditoria(&arbol, &almacen, opciones->muestraAuditoria, 
+                                opciones->semillaMuestra, numHilos);
+    if (fallos == 0) {
+        printf("Auditoria verificada: la muestra y la raiz coinciden\n");
+    } else if (fallos > 0) {
+        printf("Auditoria FALLIDA: %lld comprobaciones no coinciden\n", fallos);
+    }
+    
+    liberarAlmacenBoletas(&almacen);
+    liberarArbolAuditoria(&arbol);
+    return fallos == 0 ? 0 : 1;
 }
 
-void contarVotosParalelo(char **matriz, int numBoletas, int numCandidatos, 
-                         int *votosPorCandidato, int *votosNulos, int numHilos) {
-    for (int i = 0; i < numCandidatos; i++) {
-        votosPorCandidato[i] = 0;
+void ejecutarPruebaAutomatica(const Opciones *opciones) {
+    printf("\n=== MODO PRUEBA AUTOMaTICA ===\n");
+    printf("Ejecutando con valores optimizados...\n\n");
+    
+    long long numBoletas = 1000000;  
+    int numCandidatos = 10;
+    
+    printf("Configuracion automatica:\n");
+    printf("- Boletas: %lld\n", numBoletas);
+    printf("- Candidatos: %d\n\n", numCandidatos);
+    
+    AlmacenBoletas almacen;
+    if (crearAlmacenBoletas(&almacen, numBoletas, numCandidatos, opciones->usarHugePages) != 0) {
+        printf("Error: No se pudo reservar memoria para %lld boletas\n", numBoletas);
+        return;
     }
-    *votosNulos = 0;
     
-    omp_set_num_threads(numHilos);
+    printf("Generando %lld boletas aleatorias (semilla %llu)...\n", numBoletas, 
+           (unsigned long long)opciones->semilla);
+    double tiempoGen = obtenerTiempoAlta();
+    generarBoletasAleatorias(&almacen, opciones->semilla, omp_get_num_procs());
+    printf("Tiempo de generacion: %.3f segundos\n\n", obtenerTiempoAlta() - tiempoGen);
+    if (opciones->archivoExportar != NULL && esRutaContenedor(opciones->archivoExportar)) {
+        exportarContenedor(&almacen, opciones->archivoExportar, omp_get_max_threads());
+    } else if (opciones->archivoExportar != NULL) {
+        exportarBoletasTexto(&almacen, opciones->archivoExportar);
+    }
     
-    int totalNulos = 0;
+    const NivelSimd *nivel = elegirNivelSimd(&almacen, opciones->isa);
+    ConfiguracionConteo config;
+    elegirConfiguracion(&almacen, nivel, opciones->recalibrar, &config);
+    int numHilos = config.numHilos;
+    printf("\nIniciando conteo paralelo con %d hilos (backend %s)...\n", numHilos, opciones->backend);
     
-    #pragma omp parallel reduction(+:totalNulos)
-    {
-        int idHilo = omp_get_thread_num();
-        int totalHilos = omp_get_num_threads();
-        int votosLocales[MAX_CANDIDATOS] = {0};
-        
-        #pragma omp single
-        {
-            printf("  Procesando con %d hilos...\n", totalHilos);
+    TiempoHilo *tiempos = opciones->modoNuma ? (TiempoHilo *)calloc(numHilos, sizeof(TiempoHilo)) : NULL;
+    ParametrosConteo parametros = {opciones->isa, numHilos, &config, opciones->usarHugePages, tiempos};
+    ArbolAuditoria arbol;
+    if (opciones->auditoria && crearArbolAuditoria(&arbol, &almacen) == 0) {
+        parametros.auditoria = &arbol;
+    }
+    FuenteBoletas fuente = {&almacen, NULL};
+    ResultadoConteo resultado;
+    if (contarVotos(opciones->backend, &fuente, &parametros, &resultado) == 0) {
+        mostrarResultados(TITULO_RESULTADOS, &resultado);
+        guardarResultados(ARCHIVO_RESULTADOS, TITULO_ARCHIVO, &resultado);
+        if (parametros.auditoria != NULL) {
+            mostrarRaizAuditoria(&arbol);
+            guardarAuditoria(ARCHIVO_RESULTADOS, &arbol);
         }
-        
-        #pragma omp for schedule(static)
-        for (int i = 0; i < numBoletas; i++) {
-            int contadorMarcas = 0;
-            int candidatoMarcado = -1;
-            
-            for (int j = 0; j < numCandidatos; j++) {
-                char marca = matriz[i][j];
-                
-                if (marca == 'X' || marca == 'x') {
-                    contadorMarcas++;
-                    candidatoMarcado = j;
-                    
-                    for (int k = 0; k < 10; k++) {
-                        marca = marca ^ 0x01;
-                    }
-                }
-            }
-            
-            if (contadorMarcas == 1) {
-                votosLocales[candidatoMarcado]++;
-            } else {
-                totalNulos++;
-            }
+        if (tiempos != NULL) {
+            mostrarInformeNuma(&almacen, tiempos, numHilos);
         }
-        
-        #pragma omp critical
-        {
-            for (int i = 0; i < numCandidatos; i++) {
-                votosPorCandidato[i] += votosLocales[i];
-            }
+        if (opciones->instrumentar) {
+            mostrarInformeInstrumentacion();
+            terminarInstrumentacion();
         }
+        compararTiempos(&fuente, &parametros, opciones->backend);
+        liberarResultado(&resultado);
     }
     
-    *votosNulos = totalNulos;
+    if (parametros.auditoria != NULL) {
+        liberarArbolAuditoria(&arbol);
+    }
+    free(tiempos);
+    liberarAlmacenBoletas(&almacen);
 }
 
-void mostrarResultados(int *votosPorCandidato, int numCandidatos, int votosNulos, 
-                      double tiempoEjecucion, int numHilos, int numBoletas) {
-    printf("\n========================================\n");
-    printf("     RESULTADOS DEL CONTEO PARALELO     \n");
-    printf("========================================\n\n");
+// Proceso trabajador del backend "fragmentos": lo lanza el coordinador con el socket
+// ya conectado y no escribe nada por su cuenta
+int ejecutarTrabajadorFragmentos(const Opciones *opciones) {
+    detectarNivelesSimd();
+    ConfiguracionConteo config;
+    configuracionPorDefecto(&config, opciones->numHilos > 0 ? opciones->numHilos : omp_get_max_threads());
+    aplicarConfiguracion(&config);
+    simularFalloFragmento(opciones->fragmentoConFallo);
+    return atenderFragmentos(opciones->descriptorTrabajador, opciones->archivoEntrada, 
+                             opciones->isa, opciones->numHilos) == 0 ? 0 : 1;
+}
+
+int ejecutarConteoArchivo(const Opciones *opciones) {
+    // Con un archivo solo tienen sentido los backends de flujo y contenedor (o el
+    // fragmentado, con -procesos), salvo que se pida otro
+    const char *backend = opciones->backend;
+    if (strcmp(backend, "openmp") == 0) {
+        if (!esArchivoContenedor(opciones->archivoEntrada)) {
+            backend = "flujo";
+        } else {
+            backend = opciones->numProcesos > 0 ? "fragmentos" : "contenedor";
+        }
+    }
+    int numHilos = opciones->numHilos > 0 ? opciones->numHilos : omp_get_num_procs();
+    
+    printf("Archivo: %s\n", opciones->archivoEntrada);
+    printf("Iniciando conteo en flujo con %d hilos (backend %s)...\n", numHilos, backend);
     
-    int totalVotosValidos = 0;
+    simularFalloFragmento(opciones->fragmentoConFallo);
+    ParametrosConteo parametros = {opciones->isa, numHilos, NULL, opciones->usarHugePages, NULL,
+                                   opciones->numProcesos};
     
-    for (int i = 0; i < numCandidatos; i++) {
-        printf("  Candidato %2d: %7d votos\n", i + 1, votosPorCandidato[i]);
-        totalVotosValidos += votosPorCandidato[i];
+    // Las hojas de un archivo son sus chunks, que solo lee el backend contenedor
+    ArbolAuditoria arbol;
+    if (opciones->auditoria) {
+        ContenedorBoletas contenedor;
+        if (strcmp(backend, "contenedor") != 0) {
+            printf("Error: La auditoria de un archivo necesita un contenedor (%s) y el backend "
+                   "contenedor\n", EXTENSION_CONTENEDOR);
+            return 1;
+        }
+        if (abrirContenedor(&contenedor, opciones->archivoEntrada) != 0) {
+            return 1;
+        }
+        int error = crearArbolContenedor(&arbol, &contenedor);
+        cerrarContenedor(&contenedor);
+        if (error != 0) {
+            return 1;
+        }
+        parametros.auditoria = &arbol;
     }
     
-    printf("\n----------------------------------------\n");
-    printf("  Votos validos:  %7d\n", totalVotosValidos);
-    printf("  Votos nulos:    %7d\n", votosNulos);
-    printf("  Total boletas:  %7d\n", totalVotosValidos + votosNulos);
-    printf("----------------------------------------\n");
-    printf("\n  Tiempo de ejecucion: %.6f segundos\n", tiempoEjecucion);
-    printf("  Tiempo en milisegundos: %.3f ms\n", tiempoEjecucion * 1000);
-    printf("  Boletas por segundo: %.0f\n", numBoletas / tiempoEjecucion);
-    printf("  Numero de hilos utilizados: %d\n", numHilos);
-    printf("========================================\n");
+    FuenteBoletas fuente = {NULL, opciones->archivoEntrada};
+    ResultadoConteo resultado;
+    if (contarVotos(backend, &fuente, &parametros, &resultado) != 0) {
+        if (parametros.auditoria != NULL) {
+            liberarArbolAuditoria(&arbol);
+        }
+        return 1;
+    }
+    
+    mostrarResultados(TITULO_RESULTADOS, &resultado);
+    guardarResultados(ARCHIVO_RESULTADOS, TITULO_ARCHIVO, &resultado);
+    printf("  Kernel %s, lectura del archivo: %.1f MB/s\n", resultado.kernel, 
+           resultado.bytesLeidos / resultado.segundos / 1e6);
+    if (parametros.auditoria != NULL) {
+        mostrarRaizAuditoria(&arbol);
+        guardarAuditoria(ARCHIVO_RESULTADOS, &arbol);
+        liberarArbolAuditoria(&arbol);
+    }
+    
+    liberarResultado(&resultado);
+    return 0;
 }
 
-void guardarResultados(int *votosPorCandidato, int numCandidatos, int votosNulos, 
-                      double tiempoEjecucion, int numBoletas, int numHilos) {
-    FILE *archivo = fopen("resultados_paralelo.txt", "w");
-    if (archivo == NULL) {
-        printf("Error al crear archivo de resultados\n");
-        return;
+int ejecutarModoFusionado(const Opciones *opciones) {
+    long long numBoletas = opciones->boletasFusionado;
+    int numCandidatos = opciones->numCandidatos;
+    int numHilos = opciones->numHilos > 0 ? opciones->numHilos : omp_get_num_procs();
+    // Sin -semilla, un conteo que se reanuda sigue con la semilla de su registro
+    uint64_t semilla = opciones->semilla;
+    int semillaDelRegistro = opciones->registroControl != NULL && !opciones->semillaFijada &&
+                             leerSemillaRegistro(opciones->registroControl, &semilla) == 0;
+    
+    if (numBoletas <= 0) {
+        printf("Error: Numero de boletas debe ser positivo\n");
+        return 1;
+    }
+    if (numCandidatos > MAX_CANDIDATOS || numCandidatos <= 0) {
+        printf("Error: Numero de candidatos debe estar entre 1 y %d\n", MAX_CANDIDATOS);
+        return 1;
     }
     
-    fprintf(archivo, "RESULTADOS CONTEO PARALELO (OpenMP)\n");
-    fprintf(archivo, "====================================\n\n");
-    fprintf(archivo, "Configuracion:\n");
-    fprintf(archivo, "- Numero de boletas: %d\n", numBoletas);
-    fprintf(archivo, "- Numero de candidatos: %d\n", numCandidatos);
-    fprintf(archivo, "- Numero de hilos: %d\n\n", numHilos);
+    // Solo describe el formato y la memoria de cada bloque; cada hilo reserva el suyo
+    AlmacenBoletas bloque;
+    if (crearAlmacenBoletas(&bloque, BOLETAS_POR_BLOQUE, numCandidatos, 0) != 0) {
+        printf("Error: No se pudo reservar memoria para el bloque de boletas\n");
+        return 1;
+    }
     
-    fprintf(archivo, "Resultados por candidato:\n");
-    int totalValidos = 0;
-    for (int i = 0; i < numCandidatos; i++) {
-        fprintf(archivo, "Candidato %d: %d votos\n", i + 1, votosPorCandidato[i]);
-        totalValidos += votosPorCandidato[i];
+    // El modo fusionado genera a la vez que cuenta, asi que no pasa por contarVotos;
+    // el resultado se arma a mano para presentarlo igual
+    ResultadoConteo resultado;
+    memset(&resultado, 0, sizeof(resultado));
+    resultado.backend = buscarBackend("openmp");
+    resultado.numCandidatos = numCandidatos;
+    resultado.numBoletas = numBoletas;
+    resultado.numHilos = numHilos;
+    resultado.votosPorCandidato = (long long *)malloc(numCandidatos * sizeof(long long));
+    if (resultado.votosPorCandidato == NULL) {
+        printf("Error: No se pudo reservar memoria para el resultado\n");
+        liberarAlmacenBoletas(&bloque);
+        return 1;
     }
+    resultado.bytesBoletas = bloque.bytesReservados;
+    resultado.anchoBits = bloque.anchoBits;
+    resultado.palabras = bloque.palabras;
     
-    fprintf(archivo, "\nResumen:\n");
-    fprintf(archivo, "- Votos validos: %d\n", totalValidos);
-    fprintf(archivo, "- Votos nulos: %d\n", votosNulos);
-    fprintf(archivo, "- Total procesado: %d\n", totalValidos + votosNulos);
-    fprintf(archivo, "\nTiempo de ejecucion: %.6f segundos\n", tiempoEjecucion);
-    fprintf(archivo, "Tiempo en milisegundos: %.3f ms\n", tiempoEjecucion * 1000);
-    fprintf(archivo, "Boletas por segundo: %.0f\n", numBoletas / tiempoEjecucion);
+    const NivelSimd *nivel = elegirNivelSimd(&bloque, opciones->isa);
+    resultado.kernel = nivel->nombre;
+    printf("Modo fusionado: %lld boletas, %d candidatos, %d hilos (semilla %llu)\n", 
+           numBoletas, numCandidatos, numHilos, (unsigned long long)semilla);
+    if (semillaDelRegistro) {
+        printf("- Semilla tomada del registro %s\n", opciones->registroControl);
+    }
+    printf("- Bloques de %d boletas (%zu bytes por hilo), kernel %s\n", 
+           BOLETAS_POR_BLOQUE, bloque.bytesReservados, nivel->nombre);
+    
+    // Con -puntos-control, un conteo que se cayo sigue donde lo dejo el registro
+    RegistroControl registro;
+    RegistroControl *puntosControl = NULL;
+    if (opciones->registroControl != NULL) {
+        if (abrirRegistroControl(&registro, opciones->registroControl, numBoletas, numCandidatos, 
+                                 semilla) != 0) {
+            liberarAlmacenBoletas(&bloque);
+            liberarResultado(&resultado);
+            return 1;
+        }
+        puntosControl = &registro;
+        simularCaidaRegistro(&registro, opciones->caidaTramos);
+        printf("- Puntos de control en %s: %lld tramos de %lld boletas", opciones->registroControl, 
+               registro.numTramos, registro.boletasPorTramo);
+        if (registro.tramosReanudados > 0 || registro.bytesDescartados > 0) {
+            printf(", se reanuda con %lld ya contados (%lld bytes incompletos descartados)", 
+                   registro.tramosReanudados, registro.bytesDescartados);
+        }
+        printf("\n");
+    }
+    printf("\n");
+    
+    double inicio = obtenerTiempoAlta();
+    int error = generarYContarFusionado(numBoletas, numCandidatos, semilla, nivel, 
+                                        resultado.votosPorCandidato, &resultado.votosNulos, numHilos,
+                                        puntosControl);
+    resultado.segundos = obtenerTiempoAlta() - inicio;
+    if (error) {
+        printf("Error: El conteo fusionado no termino; no se guardan resultados\n");
+        if (puntosControl != NULL) {
+            cerrarRegistroControl(&registro, 0);
+        }
+        liberarAlmacenBoletas(&bloque);
+        liberarResultado(&resultado);
+        return 1;
+    }
+    
+    mostrarResultados(TITULO_RESULTADOS, &resultado);
+    int guardado = guardarResultados(ARCHIVO_RESULTADOS, TITULO_ARCHIVO, &resultado) == 0;
+    
+    // El registro se borra solo cuando los resultados ya estan en disco; si no, se
+    // conserva para volver a guardarlos sin contar de nuevo
+    int errorRegistro = 0;
+    if (puntosControl != NULL) {
+        long long escritos = registro.tramosEscritos;
+        errorRegistro = cerrarRegistroControl(&registro, guardado) != 0;
+        printf("Puntos de control: %lld tramos registrados en %lld sincronizaciones%s\n", 
+               escritos, registro.sincronizaciones, 
+               errorRegistro ? " (error al sincronizar el registro)" : 
+               guardado ? "" : " (se conserva el registro)");
+    }
     
-    fclose(archivo);
-    printf("\nResultados guardados en 'resultados_paralelo.txt'\n");
+    liberarAlmacenBoletas(&bloque);
+    liberarResultado(&resultado);
+    return guardado && !errorRegistro ? 0 : 1;
 }
 
-void compararTiempos(double tiempoParalelo, int numHilos) {
-    FILE *archivoSec = fopen("resultados_secuencial.txt", "r");
-    if (archivoSec != NULL) {
-        char linea[256];
-        double tiempoSecuencial = 0;
-        
-        while (fgets(linea, sizeof(linea), archivoSec)) {
-            if (strstr(linea, "Tiempo de ejecucion:") != NULL) {
-                sscanf(linea, "Tiempo de ejecucion: %lf", &tiempoSecuencial);
-                break;
+static int compararDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Simula la noche electoral: un hilo ingiere lotes (y cada 10 lotes corrige uno
+// anterior) mientras otro toma instantaneas y comprueba que siempre cuadran.
+// Al final compara con un recuento completo de las mismas boletas.
+int ejecutarModoIncremental(const Opciones *opciones) {
+    long long totalBoletas = opciones->boletasIncremental;
+    int porLote = opciones->boletasPorLote;
+    int numCandidatos = opciones->numCandidatos;
+    int numHilos = opciones->numHilos > 0 ? opciones->numHilos : omp_get_num_procs();
+    
+    if (totalBoletas <= 0 || porLote <= 0) {
+        printf("Error: Numero de boletas y tamano de lote deben ser positivos\n");
+        return 1;
+    }
+    if (numCandidatos > MAX_CANDIDATOS || numCandidatos <= 0) {
+        printf("Error: Numero de candidatos debe estar entre 1 y %d\n", MAX_CANDIDATOS);
+        return 1;
+    }
+    
+    long long numLotes = (totalBoletas + porLote - 1) / porLote;
+    ConteoIncremental conteo;
+    AlmacenBoletas lote;
+    if (crearConteoIncremental(&conteo, numCandidatos, numHilos) != 0) {
+        return 1;
+    }
+    if (crearAlmacenBoletas(&lote, porLote, numCandidatos, 0) != 0) {
+        printf("Error: No se pudo reservar memoria para el lote\n");
+        liberarConteoIncremental(&conteo);
+        return 1;
+    }
+    
+    // Semilla usada en cada lote: la original o la de su ultima correccion
+    uint64_t *semillaLote = (uint64_t *)malloc(numLotes * sizeof(uint64_t));
+    double *latencias = (double *)malloc(numLotes * sizeof(double));
+    InstantaneaConteo foto, final;
+    foto.votosPorCandidato = (long long *)malloc(numCandidatos * sizeof(long long));
+    final.votosPorCandidato = (long long *)malloc(numCandidatos * sizeof(long long));
+    if (semillaLote == NULL || latencias == NULL || foto.votosPorCandidato == NULL || 
+        final.votosPorCandidato == NULL) {
+        printf("Error: No se pudo reservar memoria para %lld lotes\n", numLotes);
+        free(semillaLote);
+        free(latencias);
+        free(foto.votosPorCandidato);
+        free(final.votosPorCandidato);
+        liberarAlmacenBoletas(&lote);
+        liberarConteoIncremental(&conteo);
+        return 1;
+    }
+    int terminado = 0;
+    long long instantaneas = 0, descuadradas = 0, reintentos = 0, correcciones = 0;
+    
+    printf("Modo incremental: %lld boletas en %lld lotes de %d, %d candidatos\n\n", 
+           totalBoletas, numLotes, porLote, numCandidatos);
+    
+    double inicio = obtenerTiempoAlta();
+    #pragma omp parallel sections num_threads(2)
+    {
+        #pragma omp section
+        {
+            for (long long l = 0; l < numLotes; l++) {
+                long long base = l * porLote;
+                lote.numBoletas = totalBoletas - base < porLote ? totalBoletas - base : porLote;
+                semillaLote[l] = opciones->semilla;
+                for (long long i = 0; i < lote.numBoletas; i++) {
+                    escribirBoletaGenerada(&lote, i, semillaLote[l], (uint64_t)(base + i));
+                }
+                double t = obtenerTiempoAlta();
+                agregarLote(&conteo, &lote);
+                latencias[l] = obtenerTiempoAlta() - t;
+                
+                // Correccion: el lote de hace 5 se vuelve a enviar con otro contenido
+                if (l % 10 == 9) {
+                    long long corregido = l - 5;
+                    long long baseCorregido = corregido * porLote;
+                    lote.numBoletas = porLote;
+                    semillaLote[corregido] = opciones->semilla + 1;
+                    for (long long i = 0; i < lote.numBoletas; i++) {
+                        escribirBoletaGenerada(&lote, i, semillaLote[corregido], (uint64_t)(baseCorregido + i));
+                    }
+                    corregirLote(&conteo, corregido, &lote);
+                    correcciones++;
+                }
             }
+            __atomic_store_n(&terminado, 1, __ATOMIC_RELEASE);
         }
-        fclose(archivoSec);
-        
-        if (tiempoSecuencial > 0) {
-            double speedup = tiempoSecuencial / tiempoParalelo;
-            double eficiencia = speedup / numHilos * 100;
-            
-            printf("\n========================================\n");
-            printf("         COMPARACIoN DE TIEMPOS         \n");
-            printf("========================================\n");
-            printf("  Tiempo secuencial:  %.6f seg (%.3f ms)\n", 
-                   tiempoSecuencial, tiempoSecuencial * 1000);
-            printf("  Tiempo paralelo:    %.6f seg (%.3f ms)\n", 
-                   tiempoParalelo, tiempoParalelo * 1000);
-            printf("  Speedup obtenido:   %.2fx\n", speedup);
-            printf("  Eficiencia:         %.1f%%\n", eficiencia);
-            printf("  Mejora de tiempo:   %.3f ms\n", 
-                   (tiempoSecuencial - tiempoParalelo) * 1000);
-            
-            if (speedup < 1.0) {
-                printf("\n   El programa paralelo es mas lento.\n");
-                printf("  Posibles causas:\n");
-                printf("  - Pocas boletas (overhead > beneficio)\n");
-                printf("  - Demasiados hilos para el trabajo\n");
-                printf("  - Competencia por recursos del sistema\n");
-                printf("\n  Sugerencias:\n");
-                printf("  - Use al menos 1,000,000 boletas\n");
-                printf("  - Use 4-8 hilos maximo\n");
-            } else if (speedup > 1.0 && speedup < 1.5) {
-                printf("\n  Mejora modesta. Para mejor rendimiento:\n");
-                printf("  - Aumente el numero de boletas\n");
-                printf("  - Ajuste el numero de hilos\n");
-            } else {
-                printf("\n  Buen speedup obtenido!\n");
+        #pragma omp section
+        {
+            while (!__atomic_load_n(&terminado, __ATOMIC_ACQUIRE)) {
+                reintentos += tomarInstantanea(&conteo, &foto);
+                long long suma = foto.votosNulos;
+                for (int i = 0; i < numCandidatos; i++) {
+                    suma += foto.votosPorCandidato[i];
+                }
+                instantaneas++;
+                if (suma != foto.numBoletas) {
+                    descuadradas++;
+                }
+            }
+        }
+    }
+    double tiempoIngesta = obtenerTiempoAlta() - inicio;
+    
+    // Recuento completo de las boletas finales, como se hacia antes en cada lote
+    AlmacenBoletas todas;
+    ResultadoConteo recuento;
+    int hayTodas = crearAlmacenBoletas(&todas, totalBoletas, numCandidatos, opciones->usarHugePages) == 0;
+    int hayRecuento = 0;
+    if (!hayTodas) {
+        printf("Error: No se pudo reservar memoria para el recuento de comprobacion\n");
+    } else {
+        for (long long l = 0; l < numLotes; l++) {
+            long long base = l * porLote;
+            long long fin = base + porLote < totalBoletas ? base + porLote : totalBoletas;
+            for (long long i = base; i < fin; i++) {
+                escribirBoletaGenerada(&todas, i, semillaLote[l], (uint64_t)i);
             }
-            
-            printf("========================================\n");
         }
+        FuenteBoletas fuente = {&todas, NULL};
+        ParametrosConteo parametros = {opciones->isa, numHilos, NULL, 0, NULL};
+        hayRecuento = contarVotos("openmp", &fuente, &parametros, &recuento) == 0;
+    }
+    
+    int salida = 1;
+    if (hayRecuento) {
+        tomarInstantanea(&conteo, &final);
+        int coincide = final.votosNulos == recuento.votosNulos && 
+                       memcmp(final.votosPorCandidato, recuento.votosPorCandidato, 
+                              numCandidatos * sizeof(long long)) == 0;
+        
+        qsort(latencias, numLotes, sizeof(double), compararDoubles);
+        printf("  Lotes ingeridos:        %lld (%lld correcciones)\n", numLotes, correcciones);
+        printf("  Tiempo total de ingesta: %.3f ms\n", tiempoIngesta * 1000);
+        printf("  Latencia por lote:      p50 %.1f us, p99 %.1f us, max %.1f us\n", 
+               latencias[numLotes / 2] * 1e6, latencias[(long long)(numLotes * 0.99)] * 1e6, 
+               latencias[numLotes - 1] * 1e6);
+        printf("  Recuento completo:      %.1f us (lo que costaba cada lote antes)\n", recuento.segundos * 1e6);
+        printf("  Instantaneas leidas:    %lld (%lld reintentos, %lld descuadradas)\n", 
+               instantaneas, reintentos, descuadradas);
+        printf("  Totales finales:        %s al recuento completo (version %llu)\n", 
+               coincide ? "iguales" : "DIFERENTES", final.version);
+        
+        mostrarResultados(TITULO_RESULTADOS, &recuento);
+        liberarResultado(&recuento);
+        salida = coincide && descuadradas == 0 ? 0 : 1;
     }
+    
+    if (hayTodas) {
+        liberarAlmacenBoletas(&todas);
+    }
+    free(foto.votosPorCandidato);
+    free(final.votosPorCandidato);
+    liberarAlmacenBoletas(&lote);
+    liberarConteoIncremental(&conteo);
+    free(semillaLote);
+    free(latencias);
+    return salida;
 }
 
-void ejecutarPruebaAutomatica() {
-    printf("\n=== MODO PRUEBA AUTOMaTICA ===\n");
-    printf("Ejecutando con valores optimizados...\n\n");
+// Urnas alternas con las claves de los extremos: 0xFFFFFFFF (CLAVE_REGION(255, 255, 65535))
+// es tambien una clave valida y cada recinto debe dar lo mismo que contar sus urnas a mano
+static int comprobarClavesExtremas(int numCandidatos, const char *isa, int numHilos) {
+    const uint32_t claves[3] = {CLAVE_REGION(255, 255, 65535), 0, CLAVE_REGION(255, 255, 65534)};
+    long long numBoletas = 48 * BOLETAS_POR_URNA;
+    long long esperados[3][MAX_CANDIDATOS + 1];
+    AlmacenBoletas almacen;
+    if (crearAlmacenBoletas(&almacen, numBoletas, numCandidatos, 0) != 0 ||
+        reservarRegiones(&almacen, numBoletas / BOLETAS_POR_URNA) != 0) {
+        liberarAlmacenBoletas(&almacen);
+        return -1;
+    }
+    generarBoletasAleatorias(&almacen, SEMILLA_PRUEBA, numHilos);
+    memset(esperados, 0, sizeof(esperados));
+    for (long long u = 0; u < almacen.numTramos; u++) {
+        long long inicio = u * BOLETAS_POR_URNA;
+        almacen.regiones[u].inicio = inicio;
+        almacen.regiones[u].clave = claves[u % 3];
+        contarRangoEscalar(&almacen, inicio, inicio + BOLETAS_POR_URNA, esperados[u % 3],
+                           &esperados[u % 3][numCandidatos]);
+    }
+
+    ResultadoRegiones niveles[3];
+    if (contarPorRegion(&almacen, isa, numHilos, niveles) != 0) {
+        liberarAlmacenBoletas(&almacen);
+        return -1;
+    }
+    int correctas = niveles[0].numGrupos == 3;
+    for (long long g = 0; correctas && g < niveles[0].numGrupos; g++) {
+        const long long *fila = niveles[0].conteos + g * niveles[0].columnas;
+        int k = 0;
+        while (k < 2 && claves[k] != niveles[0].claves[g]) {
+            k++;
+        }
+        correctas = claves[k] == niveles[0].claves[g] &&
+                    memcmp(fila, esperados[k], numCandidatos * sizeof(long long)) == 0 &&
+                    fila[numCandidatos] + fila[numCandidatos + 1] == esperados[k][numCandidatos];
+    }
+    liberarResultadosRegiones(niveles);
+    liberarAlmacenBoletas(&almacen);
+    return correctas ? 0 : -1;
+}
+
+// Conteo por recinto, municipio y departamento de boletas generadas en urnas de
+// BOLETAS_POR_URNA. Se compara con el conteo global de las mismas boletas: los
+// candidatos deben coincidir y blancos + multiples deben dar los nulos.
+int ejecutarModoRegiones(const Opciones *opciones) {
+    long long numBoletas = opciones->boletasRegiones;
+    int numCandidatos = opciones->numCandidatos;
+    int numHilos = opciones->numHilos > 0 ? opciones->numHilos : omp_get_num_procs();
+    Geografia geografia = {22, 15, 20};
     
-    int numBoletas = 1000000;  
-    int numCandidatos = 10;
-    int numHilos = omp_get_num_procs() > 8 ? 8 : omp_get_num_procs();
+    if (numBoletas <= 0 || numBoletas > MAX_BOLETAS) {
+        printf("Error: Numero de boletas debe estar entre 1 y %lld\n", MAX_BOLETAS);
+        return 1;
+    }
+    if (numCandidatos > MAX_CANDIDATOS || numCandidatos <= 0) {
+        printf("Error: Numero de candidatos debe estar entre 1 y %d\n", MAX_CANDIDATOS);
+        return 1;
+    }
     
-    printf("Configuracion automatica:\n");
-    printf("- Boletas: %d\n", numBoletas);
-    printf("- Candidatos: %d\n", numCandidatos);
-    printf("- Hilos: %d\n\n", numHilos);
+    AlmacenBoletas almacen;
+    if (crearAlmacenBoletas(&almacen, numBoletas, numCandidatos, opciones->usarHugePages) != 0 ||
+        reservarRegiones(&almacen, (numBoletas + BOLETAS_POR_URNA - 1) / BOLETAS_POR_URNA) != 0) {
+        printf("Error: No se pudo reservar memoria para %lld boletas\n", numBoletas);
+        liberarAlmacenBoletas(&almacen);
+        return 1;
+    }
+    printf("Modo por regiones: %lld boletas, %d candidatos, %d departamentos x %d municipios x %d recintos\n\n",
+           numBoletas, numCandidatos, geografia.numDepartamentos, 
+           geografia.municipiosPorDepartamento, geografia.recintosPorMunicipio);
+    generarBoletasAleatorias(&almacen, opciones->semilla, numHilos);
+    generarRegionesAleatorias(&almacen, &geografia, opciones->semilla, numHilos);
     
-    char **matriz = (char **)malloc(numBoletas * sizeof(char *));
-    for (int i = 0; i < numBoletas; i++) {
-        matriz[i] = (char *)malloc(numCandidatos * sizeof(char));
+    FuenteBoletas fuente = {&almacen, NULL};
+    ParametrosConteo parametros = {opciones->isa, numHilos, NULL, 0, NULL};
+    ResultadoConteo global;
+    if (contarVotos("openmp", &fuente, &parametros, &global) != 0) {
+        liberarAlmacenBoletas(&almacen);
+        return 1;
     }
     
-    int *votosPorCandidato = (int *)malloc(numCandidatos * sizeof(int));
-    int votosNulos;
+    ResultadoRegiones niveles[3];
+    double inicio = obtenerTiempoAlta();
+    if (contarPorRegion(&almacen, opciones->isa, numHilos, niveles) != 0) {
+        liberarResultado(&global);
+        liberarAlmacenBoletas(&almacen);
+        return 1;
+    }
+    double tiempoRegiones = obtenerTiempoAlta() - inicio;
     
-    printf("Generando %d boletas aleatorias...\n", numBoletas);
-    double tiempoGen = obtenerTiempoAlta();
-    generarBoletasAleatorias(matriz, numBoletas, numCandidatos);
-    printf("Tiempo de generacion: %.3f segundos\n\n", obtenerTiempoAlta() - tiempoGen);
+    // Los departamentos suman todo el pais
+    int columnas = niveles[2].columnas;
+    long long *totales = (long long *)calloc(columnas, sizeof(long long));
+    for (long long g = 0; g < niveles[2].numGrupos; g++) {
+        for (int c = 0; c < columnas; c++) {
+            totales[c] += niveles[2].conteos[g * columnas + c];
+        }
+    }
+    int coincide = memcmp(totales, global.votosPorCandidato, numCandidatos * sizeof(long long)) == 0 &&
+                   totales[numCandidatos] + totales[numCandidatos + 1] == global.votosNulos;
+    
+    printf("  Recintos / municipios / departamentos: %lld / %lld / %lld\n", 
+           niveles[0].numGrupos, niveles[1].numGrupos, niveles[2].numGrupos);
+    printf("  Conteo global:     %.3f ms (%.1f M boletas/s)\n", 
+           global.segundos * 1000, numBoletas / global.segundos / 1e6);
+    printf("  Conteo por region: %.3f ms (%.1f M boletas/s, %.2fx el global)\n", 
+           tiempoRegiones * 1000, numBoletas / tiempoRegiones / 1e6, tiempoRegiones / global.segundos);
+    printf("  Blancos: %lld, marcas multiples: %lld (nulos globales: %lld)\n", 
+           totales[numCandidatos], totales[numCandidatos + 1], global.votosNulos);
+    printf("  Totales por region: %s al conteo global\n", coincide ? "iguales" : "DIFERENTES");
+    int extremas = comprobarClavesExtremas(numCandidatos, opciones->isa, numHilos) == 0;
+    printf("  Claves extremas (0 y 0xFFFFFFFF): %s\n\n", extremas ? "correctas" : "INCORRECTAS");
+    
+    // Ganador y participacion de cada departamento
+    printf("Departamento  Boletas      Ganador        Votos   Blancos  Multiples\n");
+    for (long long g = 0; g < niveles[2].numGrupos; g++) {
+        const long long *fila = &niveles[2].conteos[g * columnas];
+        long long boletas = 0;
+        int ganador = 0;
+        for (int c = 0; c < columnas; c++) {
+            boletas += fila[c];
+        }
+        for (int c = 1; c < numCandidatos; c++) {
+            if (fila[c] > fila[ganador]) ganador = c;
+        }
+        printf("%12u  %-11lld  Candidato %-4d %-7lld %-8lld %lld\n", 
+               DEPARTAMENTO_DE(niveles[2].claves[g]) + 1, boletas, ganador + 1, fila[ganador],
+               fila[numCandidatos], fila[numCandidatos + 1]);
+    }
+    printf("\n");
+    guardarResultadosRegiones("resultados_regiones.csv", niveles);
+    
+    free(totales);
+    liberarResultadosRegiones(niveles);
+    liberarResultado(&global);
+    liberarAlmacenBoletas(&almacen);
+    return coincide && extremas ? 0 : 1;
+}
+
+// Voto preferencial: tabula con el indice por candidato y compara con el recuento
+// que recorre todas las boletas en cada ronda (mismas decisiones en el mismo orden)
+int ejecutarModoPreferencial(const Opciones *opciones) {
+    long long numBoletas = opciones->boletasPreferencial;
+    int numCandidatos = opciones->numCandidatos;
+    int escanos = opciones->escanos;
+    int numHilos = opciones->numHilos > 0 ? opciones->numHilos : omp_get_num_procs();
     
-    printf("Iniciando conteo paralelo...\n");
+    if (numBoletas <= 0 || numBoletas > UINT32_MAX) {
+        printf("Error: Numero de boletas debe estar entre 1 y %u\n", UINT32_MAX);
+        return 1;
+    }
+    if (numCandidatos > MAX_CANDIDATOS || numCandidatos <= 1) {
+        printf("Error: Numero de candidatos debe estar entre 2 y %d\n", MAX_CANDIDATOS);
+        return 1;
+    }
+    if (escanos <= 0 || escanos >= numCandidatos) {
+        printf("Error: Numero de escanos debe estar entre 1 y %d\n", numCandidatos - 1);
+        return 1;
+    }
     
+    AlmacenPreferencias almacen;
+    if (crearAlmacenPreferencias(&almacen, numBoletas, numCandidatos) != 0) {
+        printf("Error: No se pudo reservar memoria para %lld boletas\n", numBoletas);
+        return 1;
+    }
+    printf("Modo preferencial: %lld boletas, %d candidatos, hasta %d preferencias, %d escano(s) (%s)\n\n",
+           numBoletas, numCandidatos, almacen.rangos, escanos, escanos == 1 ? "IRV" : "STV");
     double inicio = obtenerTiempoAlta();
-    contarVotosParalelo(matriz, numBoletas, numCandidatos, 
-                       votosPorCandidato, &votosNulos, numHilos);
-    double fin = obtenerTiempoAlta();
-    double tiempoEjecucion = fin - inicio;
+    generarPreferenciasAleatorias(&almacen, opciones->semilla, numHilos);
+    printf("  Generacion: %.3f ms\n", (obtenerTiempoAlta() - inicio) * 1000);
     
-    mostrarResultados(votosPorCandidato, numCandidatos, votosNulos, 
-                     tiempoEjecucion, numHilos, numBoletas);
-    guardarResultados(votosPorCandidato, numCandidatos, votosNulos, 
-                     tiempoEjecucion, numBoletas, numHilos);
+    ResultadoPreferencial resultado, referencia;
+    if (tabularPreferencial(&almacen, escanos, numHilos, &resultado) != 0) {
+        liberarAlmacenPreferencias(&almacen);
+        return 1;
+    }
+    if (tabularPreferencialRecontando(&almacen, escanos, numHilos, &referencia) != 0) {
+        liberarResultadoPreferencial(&resultado);
+        liberarAlmacenPreferencias(&almacen);
+        return 1;
+    }
+    int coincide = mismoResultadoPreferencial(&resultado, &referencia);
     
-    compararTiempos(tiempoEjecucion, numHilos);
+    if (escanos > 1) {
+        printf("  Cuota Droop: %.0f votos\n", resultado.cuota);
+    }
+    printf("  Con indice por candidato: %.3f ms, %lld boletas revisadas (%.2f pasadas completas)\n",
+           resultado.segundos * 1000, resultado.boletasRevisadas, 
+           (double)resultado.boletasRevisadas / numBoletas);
+    printf("  Recontando cada ronda:    %.3f ms, %lld boletas revisadas (%.2f pasadas completas, %.2fx mas lento)\n",
+           referencia.segundos * 1000, referencia.boletasRevisadas, 
+           (double)referencia.boletasRevisadas / numBoletas, referencia.segundos / resultado.segundos);
+    printf("  Decisiones: %s al recuento completo\n\n", coincide ? "iguales" : "DIFERENTES");
     
-    for (int i = 0; i < numBoletas; i++) {
-        free(matriz[i]);
+    printf("Ronda  Decision    Candidato      Votos         Lider           Votos         Agotadas\n");
+    for (int r = 0; r < resultado.numRondas; r++) {
+        const double *votos = resultado.votosPorRonda + (size_t)r * (numCandidatos + 1);
+        int candidato = resultado.candidatoPorRonda[r];
+        int lider = candidato;
+        for (int c = 0; c < numCandidatos; c++) {
+            if (votos[c] > votos[lider]) lider = c;
+        }
+        printf("%5d  %-10s  Candidato %-4d %-13.1f Candidato %-4d %-13.1f %.1f\n", r + 1,
+               resultado.electoEnRonda[r] ? "electo" : "eliminado", candidato + 1, votos[candidato],
+               lider + 1, votos[lider], votos[numCandidatos]);
     }
-    free(matriz);
-    free(votosPorCandidato);
+    printf("\nElectos:");
+    for (int e = 0; e < resultado.numElectos; e++) {
+        printf(" Candidato %d", resultado.electos[e] + 1);
+    }
+    printf("\n");
+    
+    liberarResultadoPreferencial(&referencia);
+    liberarResultadoPreferencial(&resultado);
+    liberarAlmacenPreferencias(&almacen);
+    return coincide ? 0 : 1;
 }
 
-int obtenerNumeroHilosOptimo(int numBoletas) {
-    int numCores = omp_get_num_procs();
-    int hilosOptimos;
+void leerOpciones(int argc, char *argv[], Opciones *opciones) {
     
-    if (numBoletas < 10000) {
-        hilosOptimos = 2; 
-    } else if (numBoletas < 100000) {
-        hilosOptimos = (numCores > 4) ? 4 : numCores;
-    } else {
-        hilosOptimos = (numCores > 8) ? 8 : numCores;
+    opciones->modoPrueba = 0;
+    opciones->usarHugePages = 0;
+    opciones->modoBenchmarkSimd = 0;
+    opciones->modoBenchmarkCandidatos = 0;
+    opciones->modoBenchmarkHilos = 0;
+    opciones->modoBenchmarkClasificacion = 0;
+    opciones->modoBenchmarkTuberia = 0;
+    opciones->modoSuite = 0;
+    opciones->modoNuma = 0;
+    opciones->instrumentar = 0;
+    opciones->recalibrar = 0;
+    opciones->backend = "openmp";
+    opciones->isa = NULL;
+    opciones->archivoEntrada = NULL;
+    opciones->archivoExportar = NULL;
+    opciones->semilla = (uint64_t)time(NULL);
+    opciones->semillaFijada = 0;
+    opciones->numHilos = 0;
+    opciones->boletasFusionado = 0;
+    opciones->boletasIncremental = 0;
+    opciones->boletasRegiones = 0;
+    opciones->boletasArena = 0;
+    opciones->boletasPreferencial = 0;
+    opciones->escanos = 1;
+    opciones->socketServidor = NULL;
+    opciones->socketCarga = NULL;
+    opciones->numClientes = 4;
+    opciones->lotesPorCliente = 100;
+    opciones->cerrarServidor = 0;
+    opciones->registroControl = NULL;
+    opciones->caidaTramos = -1;
+    opciones->auditoria = 0;
+    opciones->verificarAuditoria = NULL;
+    opciones->muestraAuditoria = MUESTRA_AUDITORIA;
+    opciones->semillaMuestra = (uint64_t)time(NULL);
+    opciones->boletasAuditoria = 0;
+    opciones->boletasEstimacion = 0;
+    opciones->boletasPorLote = 10000;
+    opciones->numCandidatos = MAX_CANDIDATOS;
+    opciones->numProcesos = 0;
+    opciones->fragmentoConFallo = -1;
+    opciones->descriptorTrabajador = -1;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-test") == 0) {
+            opciones->modoPrueba = 1;
+        } else if (strcmp(argv[i], "-hugepages") == 0) {
+            opciones->usarHugePages = 1;
+        } else if (strcmp(argv[i], "-bench-simd") == 0) {
+            opciones->modoBenchmarkSimd = 1;
+        } else if (strcmp(argv[i], "-bench-candidatos") == 0) {
+            opciones->modoBenchmarkCandidatos = 1;
+        } else if (strcmp(argv[i], "-bench-hilos") == 0) {
+            opciones->modoBenchmarkHilos = 1;
+        } else if (strcmp(argv[i], "-bench-clasificacion") == 0) {
+            opciones->modoBenchmarkClasificacion = 1;
+        } else if (strcmp(argv[i], "-bench-tuberia") == 0) {
+            opciones->modoBenchmarkTuberia = 1;
+        } else if (strcmp(argv[i], "-bench") == 0) {
+            opciones->modoSuite = 1;
+        } else if (strcmp(argv[i], "-bench-rapido") == 0) {
+            opciones->modoSuite = 2;
+        } else if (strcmp(argv[i], "-numa") == 0) {
+            opciones->modoNuma = 1;
+        } else if (strcmp(argv[i], "-contadores") == 0) {
+            opciones->instrumentar = 1;
+        } else if (strcmp(argv[i], "-recalibrar") == 0) {
+            opciones->recalibrar = 1;
+        } else if (strcmp(argv[i], "-backend") == 0 && i + 1 < argc) {
+            opciones->backend = argv[++i];
+        } else if (strcmp(argv[i], "-isa") == 0 && i + 1 < argc) {
+            opciones->isa = argv[++i];
+        } else if (strcmp(argv[i], "-archivo") == 0 && i + 1 < argc) {
+            opciones->archivoEntrada = argv[++i];
+        } else if (strcmp(argv[i], "-exportar") == 0 && i + 1 < argc) {
+            opciones->archivoExportar = argv[++i];
+        } else if (strcmp(argv[i], "-semilla") == 0 && i + 1 < argc) {
+            opciones->semilla = strtoull(argv[++i], NULL, 10);
+            opciones->semillaFijada = 1;
+        } else if (strcmp(argv[i], "-hilos") == 0 && i + 1 < argc) {
+            opciones->numHilos = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-fusionado") == 0 && i + 1 < argc) {
+            opciones->boletasFusionado = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-incremental") == 0 && i + 1 < argc) {
+            opciones->boletasIncremental = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-regiones") == 0 && i + 1 < argc) {
+            opciones->boletasRegiones = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-bench-arena") == 0 && i + 1 < argc) {
+            opciones->boletasArena = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-preferencial") == 0 && i + 1 < argc) {
+            opciones->boletasPreferencial = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-escanos") == 0 && i + 1 < argc) {
+            opciones->escanos = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-servidor") == 0 && i + 1 < argc) {
+            opciones->socketServidor = argv[++i];
+        } else if (strcmp(argv[i], "-carga") == 0 && i + 1 < argc) {
+            opciones->socketCarga = argv[++i];
+        } else if (strcmp(argv[i], "-clientes") == 0 && i + 1 < argc) {
+            opciones->numClientes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-lotes") == 0 && i + 1 < argc) {
+            opciones->lotesPorCliente = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-cerrar") == 0) {
+            opciones->cerrarServidor = 1;
+        } else if (strcmp(argv[i], "-puntos-control") == 0 && i + 1 < argc) {
+            opciones->registroControl = argv[++i];
+        } else if (strcmp(argv[i], "-caida-tramo") == 0 && i + 1 < argc) {
+            opciones->caidaTramos = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-auditoria") == 0) {
+            opciones->auditoria = 1;
+        } else if (strcmp(argv[i], "-verificar-auditoria") == 0 && i + 1 < argc) {
+            opciones->verificarAuditoria = argv[++i];
+        } else if (strcmp(argv[i], "-muestra") == 0 && i + 1 < argc) {
+            opciones->muestraAuditoria = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-semilla-muestra") == 0 && i + 1 < argc) {
+            opciones->semillaMuestra = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-bench-auditoria") == 0 && i + 1 < argc) {
+            opciones->boletasAuditoria = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-estimacion") == 0 && i + 1 < argc) {
+            opciones->boletasEstimacion = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-lote") == 0 && i + 1 < argc) {
+            opciones->boletasPorLote = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-candidatos") == 0 && i + 1 < argc) {
+            opciones->numCandidatos = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-procesos") == 0 && i + 1 < argc) {
+            opciones->numProcesos = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-fallo-fragmento") == 0 && i + 1 < argc) {
+            opciones->fragmentoConFallo = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-trabajador-fragmentos") == 0 && i + 1 < argc) {
+            opciones->descriptorTrabajador = atoi(argv[++i]);
+        } else {
+            printf("Opcion desconocida ignorada: %s\n", argv[i]);
+        }
     }
     
-    return hilosOptimos;
+    // La prueba automatica usa siempre los mismos datos para comparar ambos programas
+    if (opciones->modoPrueba && !opciones->semillaFijada) {
+        opciones->semilla = SEMILLA_PRUEBA;
+    }
 }
 
 int main(int argc, char *argv[]) {
-    int numBoletas, numCandidatos, numHilos;
-    double tiempoInicio, tiempoFin, tiempoEjecucion;
+    long long numBoletas;
+    int numCandidatos, numHilos;
+    Opciones opciones;
+    
+    leerOpciones(argc, argv, &opciones);
+    if (opciones.descriptorTrabajador >= 0) {
+        return ejecutarTrabajadorFragmentos(&opciones);
+    }
+    registrarProgramaFragmentos(argv[0]);
+    if (opciones.modoNuma) {
+        fijarAfinidadNuma(argv);
+    }
     
     printf("\n========================================\n");
     printf("  PROGRAMA PARALELO (OpenMP) - CONTEO   \n");
     printf("========================================\n\n");
     
-    if (argc > 1 && strcmp(argv[1], "-test") == 0) {
-        ejecutarPruebaAutomatica();
+    detectarNivelesSimd();
+    if (opciones.instrumentar && activarInstrumentacion() == INSTRUMENTACION_TIEMPO) {
+        printf("Contadores perf_event no disponibles: se mide solo el tiempo por fase\n\n");
+    }
+    
+    // Mismo reparto que antes del autoajuste mientras no se elija otra planificacion
+    ConfiguracionConteo configInicial;
+    configuracionPorDefecto(&configInicial, omp_get_max_threads());
+    aplicarConfiguracion(&configInicial);
+    
+    if (buscarBackend(opciones.backend) == NULL) {
+        printf("Error: Backend de conteo desconocido '%s'\n", opciones.backend);
+        mostrarBackends();
+        return 1;
+    }
+    
+    if (opciones.modoBenchmarkSimd) {
+        ejecutarBenchmarkSimd(opciones.usarHugePages, opciones.semilla);
+        return 0;
+    }
+    
+    if (opciones.modoBenchmarkClasificacion) {
+        ejecutarBenchmarkClasificacion(opciones.usarHugePages, opciones.semilla);
+        return 0;
+    }
+    
+    if (opciones.modoBenchmarkCandidatos) {
+        ParametrosConteo parametros = {opciones.isa, opciones.numHilos, NULL, opciones.usarHugePages, NULL};
+        ejecutarBenchmarkCandidatos(opciones.backend, &parametros, opciones.semilla);
+        return 0;
+    }
+    
+    if (opciones.modoSuite) {
+        return ejecutarSuiteBenchmark(ARCHIVO_BENCH_CSV, ARCHIVO_BENCH_JSON, opciones.modoSuite == 2, 
+                                      opciones.semilla) == 0 ? 0 : 1;
+    }
+    
+    if (opciones.modoBenchmarkHilos) {
+        ejecutarBenchmarkHilos(opciones.numCandidatos, opciones.isa, opciones.usarHugePages, 
+                               opciones.semilla);
+        return 0;
+    }
+    
+    if (opciones.boletasAuditoria > 0) {
+        ejecutarBenchmarkAuditoria(opciones.boletasAuditoria, opciones.numCandidatos, opciones.numHilos,
+                                   opciones.semilla);
+        return 0;
+    }
+    
+    if (opciones.verificarAuditoria != NULL) {
+        return ejecutarVerificacionAuditoria(&opciones);
+    }
+    
+    if (opciones.boletasArena > 0) {
+        ejecutarBenchmarkArena(opciones.boletasArena, opciones.numCandidatos, opciones.numHilos,
+                               opciones.semilla);
+        return 0;
+    }
+    
+    if (opciones.modoBenchmarkTuberia) {
+        if (opciones.archivoEntrada == NULL) {
+            printf("Error: -bench-tuberia necesita -archivo con boletas de texto\n");
+            return 1;
+        }
+        ejecutarBenchmarkTuberia(opciones.archivoEntrada, opciones.numHilos);
+        return 0;
+    }
+    
+    if (opciones.socketServidor != NULL) {
+        return ejecutarServidor(opciones.socketServidor, opciones.numCandidatos, opciones.numHilos) == 0 ? 0 : 1;
+    }
+    
+    if (opciones.socketCarga != NULL) {
+        if (opciones.numClientes <= 0 || opciones.numClientes > MAX_CLIENTES_SERVICIO || 
+            opciones.lotesPorCliente <= 0) {
+            printf("Error: Se necesitan de 1 a %d clientes y al menos un lote por cliente\n", 
+                   MAX_CLIENTES_SERVICIO);
+            return 1;
+        }
+        return ejecutarCargaServicio(opciones.socketCarga, opciones.numClientes, opciones.lotesPorCliente,
+                                     opciones.boletasPorLote, opciones.semilla, opciones.cerrarServidor) == 0 ? 0 : 1;
+    }
+    
+    if (opciones.archivoEntrada != NULL) {
+        return ejecutarConteoArchivo(&opciones);
+    }
+    
+    if (opciones.boletasFusionado != 0) {
+        return ejecutarModoFusionado(&opciones);
+    }
+    
+    if (opciones.boletasIncremental != 0) {
+        return ejecutarModoIncremental(&opciones);
+    }
+    
+    if (opciones.boletasRegiones != 0) {
+        return ejecutarModoRegiones(&opciones);
+    }
+    
+    if (opciones.boletasEstimacion > 0) {
+        return ejecutarModoEstimacion(opciones.boletasEstimacion, opciones.numCandidatos, opciones.numHilos,
+                                      opciones.semilla) == 0 ? 0 : 1;
+    }
+    
+    if (opciones.boletasPreferencial != 0) {
+        return ejecutarModoPreferencial(&opciones);
+    }
+    
+    if (opciones.modoPrueba) {
+        ejecutarPruebaAutomatica(&opciones);
         return 0;
     }
     
@@ -300,17 +1099,16 @@ int main(int argc, char *argv[]) {
     printf("Sistema: %d cores detectados, maximo %d hilos\n\n", numCores, maxHilos);
     
     printf("Ingrese numero de boletas a procesar: ");
-    scanf("%d", &numBoletas);
+    scanf("%lld", &numBoletas);
     
     printf("Ingrese numero de candidatos: ");
     scanf("%d", &numCandidatos);
     
-    int hilosRecomendados = obtenerNumeroHilosOptimo(numBoletas);
-    printf("Ingrese numero de hilos (recomendado: %d): ", hilosRecomendados);
+    printf("Ingrese numero de hilos (0 = autoajuste): ");
     scanf("%d", &numHilos);
     
     if (numBoletas > MAX_BOLETAS || numBoletas <= 0) {
-        printf("Error: Numero de boletas debe estar entre 1 y %d\n", MAX_BOLETAS);
+        printf("Error: Numero de boletas debe estar entre 1 y %lld\n", MAX_BOLETAS);
         printf("Sugerencia: Para ver beneficios del paralelismo use al menos 100,000 boletas\n");
         return 1;
     }
@@ -320,17 +1118,17 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
-    if (numHilos <= 0 || numHilos > maxHilos) {
-        numHilos = hilosRecomendados;
-        printf("Ajustando a %d hilos (optimo para %d boletas)\n", numHilos, numBoletas);
+    int autoajuste = numHilos <= 0 || numHilos > maxHilos;
+    if (autoajuste) {
+        numHilos = numCores;
+        printf("Se elegira el numero de hilos con el autoajuste\n");
     }
     
     if (numBoletas < 100000) {
         printf("\n⚠ ADVERTENCIA: Con menos de 100,000 boletas,\n");
         printf("  el paralelismo puede no mostrar mejoras significativas.\n");
         printf("  Para mejores resultados, use:\n");
-        printf("  - Al menos 1,000,000 boletas\n");
-        printf("  - Entre 4 y 8 hilos\n\n");
+        printf("  - Al menos 1,000,000 boletas\n\n");
     }
     
     if (numHilos > numCores) {
@@ -338,39 +1136,62 @@ int main(int argc, char *argv[]) {
         printf("  Esto puede reducir el rendimiento.\n\n");
     }
     
-    char **matriz = (char **)malloc(numBoletas * sizeof(char *));
-    for (int i = 0; i < numBoletas; i++) {
-        matriz[i] = (char *)malloc(numCandidatos * sizeof(char));
+    AlmacenBoletas almacen;
+    if (crearAlmacenBoletas(&almacen, numBoletas, numCandidatos, opciones.usarHugePages) != 0) {
+        printf("Error: No se pudo reservar memoria para %lld boletas\n", numBoletas);
+        return 1;
     }
     
-    int *votosPorCandidato = (int *)malloc(numCandidatos * sizeof(int));
-    int votosNulos;
-    
-    printf("\nGenerando %d boletas aleatorias...\n", numBoletas);
-    generarBoletasAleatorias(matriz, numBoletas, numCandidatos);
-    
-    printf("\nIniciando conteo paralelo con %d hilos...\n\n", numHilos);
-    
-    tiempoInicio = obtenerTiempoAlta();
-    
-    contarVotosParalelo(matriz, numBoletas, numCandidatos, 
-                       votosPorCandidato, &votosNulos, numHilos);
-    
-    tiempoFin = obtenerTiempoAlta();
-    tiempoEjecucion = tiempoFin - tiempoInicio;
+    printf("\nGenerando %lld boletas aleatorias (semilla %llu)...\n", numBoletas, 
+           (unsigned long long)opciones.semilla);
+    double tiempoGen = obtenerTiempoAlta();
+    generarBoletasAleatorias(&almacen, opciones.semilla, numHilos);
+    printf("Tiempo de generacion: %.3f segundos\n", obtenerTiempoAlta() - tiempoGen);
+    if (opciones.archivoExportar != NULL && esRutaContenedor(opciones.archivoExportar)) {
+        exportarContenedor(&almacen, opciones.archivoExportar, omp_get_max_threads());
+    } else if (opciones.archivoExportar != NULL) {
+        exportarBoletasTexto(&almacen, opciones.archivoExportar);
+    }
     
-    mostrarResultados(votosPorCandidato, numCandidatos, votosNulos, 
-                     tiempoEjecucion, numHilos, numBoletas);
-    guardarResultados(votosPorCandidato, numCandidatos, votosNulos, 
-                     tiempoEjecucion, numBoletas, numHilos);
+    ConfiguracionConteo config;
+    configuracionPorDefecto(&config, numHilos);
+    if (autoajuste) {
+        elegirConfiguracion(&almacen, elegirNivelSimd(&almacen, opciones.isa), opciones.recalibrar, &config);
+        numHilos = config.numHilos;
+    }
+    printf("\nIniciando conteo paralelo con %d hilos (backend %s)...\n\n", numHilos, opciones.backend);
     
-    compararTiempos(tiempoEjecucion, numHilos);
+    TiempoHilo *tiempos = opciones.modoNuma ? (TiempoHilo *)calloc(numHilos, sizeof(TiempoHilo)) : NULL;
+    ParametrosConteo parametros = {opciones.isa, numHilos, &config, opciones.usarHugePages, tiempos};
+    ArbolAuditoria arbol;
+    if (opciones.auditoria && crearArbolAuditoria(&arbol, &almacen) == 0) {
+        parametros.auditoria = &arbol;
+    }
+    FuenteBoletas fuente = {&almacen, NULL};
+    ResultadoConteo resultado;
+    if (contarVotos(opciones.backend, &fuente, &parametros, &resultado) == 0) {
+        mostrarResultados(TITULO_RESULTADOS, &resultado);
+        guardarResultados(ARCHIVO_RESULTADOS, TITULO_ARCHIVO, &resultado);
+        if (parametros.auditoria != NULL) {
+            mostrarRaizAuditoria(&arbol);
+            guardarAuditoria(ARCHIVO_RESULTADOS, &arbol);
+        }
+        if (tiempos != NULL) {
+            mostrarInformeNuma(&almacen, tiempos, numHilos);
+        }
+        if (opciones.instrumentar) {
+            mostrarInformeInstrumentacion();
+            terminarInstrumentacion();
+        }
+        compararTiempos(&fuente, &parametros, opciones.backend);
+        liberarResultado(&resultado);
+    }
     
-    for (int i = 0; i < numBoletas; i++) {
-        free(matriz[i]);
+    if (parametros.auditoria != NULL) {
+        liberarArbolAuditoria(&arbol);
     }
-    free(matriz);
-    free(votosPorCandidato);
+    free(tiempos);
+    liberarAlmacenBoletas(&almacen);
     
     return 0;
 }
\ No newline at end of file
@@ -2,204 +2,185 @@
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
+#include <stdint.h>
 
-#ifdef _WIN32
-    #include <windows.h>
-#else
-    #include <sys/time.h>
-#endif
+#include "votos.h"
 
-#define MAX_CANDIDATOS 10
-#define MAX_BOLETAS 10000000 
+#define TITULO_RESULTADOS "     RESULTADOS DEL CONTEO DE VOTOS     "
+#define TITULO_ARCHIVO "RESULTADOS CONTEO SECUENCIAL"
+#define ARCHIVO_RESULTADOS "resultados_secuencial.txt"
 
-double obtenerTiempoAlta() {
-    #ifdef _WIN32
-        LARGE_INTEGER frequency, counter;
-        QueryPerformanceFrequency(&frequency);
-        QueryPerformanceCounter(&counter);
-        return (double)counter.QuadPart / (double)frequency.QuadPart;
-    #else
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        return tv.tv_sec + tv.tv_usec / 1000000.0;
-    #endif
-}
-
-void generarBoletasAleatorias(char **matriz, int numBoletas, int numCandidatos) {
-    srand(time(NULL));
-    
-    for (int i = 0; i < numBoletas; i++) {
-        for (int j = 0; j < numCandidatos; j++) {
-            matriz[i][j] = ' ';
-        }
-        
-        int tipoVoto = rand() % 100;
-        
-        if (tipoVoto < 70) {
-            int candidato = rand() % numCandidatos;
-            matriz[i][candidato] = 'X';
-        } 
-        else if (tipoVoto < 85) {
-            int numMarcas = 2 + rand() % 3; 
-            for (int m = 0; m < numMarcas; m++) {
-                int candidato = rand() % numCandidatos;
-                matriz[i][candidato] = 'X';
-            }
-        }
-    }
-}
-
-void contarVotosSecuencial(char **matriz, int numBoletas, int numCandidatos, 
-                           int *votosPorCandidato, int *votosNulos) {
+typedef struct {
+    int modoPrueba;
+    int usarHugePages;
+    int modoBenchmarkSimd;
+    int modoBenchmarkCandidatos;
+    const char *backend;
+    const char *isa;
+    const char *archivoEntrada;
+    const char *archivoExportar;
+    uint64_t semilla;
+} Opciones;
 
-    for (int i = 0; i < numCandidatos; i++) {
-        votosPorCandidato[i] = 0;
-    }
-    *votosNulos = 0;
-    
-    for (int i = 0; i < numBoletas; i++) {
-        int contadorMarcas = 0;
-        int candidatoMarcado = -1;
-        
-        for (int j = 0; j < numCandidatos; j++) {
-            char marca = matriz[i][j];
-            
-            if (marca == 'X' || marca == 'x') {
-                contadorMarcas++;
-                candidatoMarcado = j;
-                
-                for (int k = 0; k < 10; k++) {
-                    marca = marca ^ 0x01;
-                }
-            }
-        }
-        
-        if (contadorMarcas == 1) {
-            votosPorCandidato[candidatoMarcado]++;
-        } else {
-            (*votosNulos)++;
-        }
+// Genera y cuenta las boletas en memoria con el backend elegido (un solo hilo)
+int contarEnMemoria(const Opciones *opciones, long long numBoletas, int numCandidatos) {
+    AlmacenBoletas almacen;
+    if (crearAlmacenBoletas(&almacen, numBoletas, numCandidatos, opciones->usarHugePages) != 0) {
+        printf("Error: No se pudo reservar memoria para %lld boletas\n", numBoletas);
+        return 1;
     }
-}
-
-void mostrarResultados(int *votosPorCandidato, int numCandidatos, int votosNulos, 
-                      double tiempoEjecucion, int numBoletas) {
-    printf("\n========================================\n");
-    printf("     RESULTADOS DEL CONTEO DE VOTOS     \n");
-    printf("========================================\n\n");
-    
-    int totalVotosValidos = 0;
     
-    for (int i = 0; i < numCandidatos; i++) {
-        printf("  Candidato %2d: %7d votos\n", i + 1, votosPorCandidato[i]);
-        totalVotosValidos += votosPorCandidato[i];
+    printf("Generando %lld boletas aleatorias (semilla %llu)...\n", numBoletas, 
+           (unsigned long long)opciones->semilla);
+    double tiempoGen = obtenerTiempoAlta();
+    generarBoletasAleatorias(&almacen, opciones->semilla, 1);
+    printf("Tiempo de generacion: %.3f segundos\n", obtenerTiempoAlta() - tiempoGen);
+    if (opciones->archivoExportar != NULL && esRutaContenedor(opciones->archivoExportar)) {
+        exportarContenedor(&almacen, opciones->archivoExportar, 1);
+    } else if (opciones->archivoExportar != NULL) {
+        exportarBoletasTexto(&almacen, opciones->archivoExportar);
     }
     
-    printf("\n----------------------------------------\n");
-    printf("  Votos validos:  %7d\n", totalVotosValidos);
-    printf("  Votos nulos:    %7d\n", votosNulos);
-    printf("  Total boletas:  %7d\n", totalVotosValidos + votosNulos);
-    printf("----------------------------------------\n");
-    printf("\n  Tiempo de ejecucion: %.6f segundos\n", tiempoEjecucion);
-    printf("  Tiempo en milisegundos: %.3f ms\n", tiempoEjecucion * 1000);
-    printf("  Boletas por segundo: %.0f\n", numBoletas / tiempoEjecucion);
-    printf("========================================\n");
-}
-
-void guardarResultados(int *votosPorCandidato, int numCandidatos, int votosNulos, 
-                      double tiempoEjecucion, int numBoletas) {
-    FILE *archivo = fopen("resultados_secuencial.txt", "w");
-    if (archivo == NULL) {
-        printf("Error al crear archivo de resultados\n");
-        return;
-    }
+    printf("Iniciando conteo secuencial (backend %s)...\n", opciones->backend);
     
-    fprintf(archivo, "RESULTADOS CONTEO SECUENCIAL\n");
-    fprintf(archivo, "============================\n\n");
-    fprintf(archivo, "Configuracion:\n");
-    fprintf(archivo, "- Numero de boletas: %d\n", numBoletas);
-    fprintf(archivo, "- Numero de candidatos: %d\n\n", numCandidatos);
-    
-    fprintf(archivo, "Resultados por candidato:\n");
-    int totalValidos = 0;
-    for (int i = 0; i < numCandidatos; i++) {
-        fprintf(archivo, "Candidato %d: %d votos\n", i + 1, votosPorCandidato[i]);
-        totalValidos += votosPorCandidato[i];
+    ParametrosConteo parametros = {opciones->isa, 1, NULL, opciones->usarHugePages, NULL};
+    FuenteBoletas fuente = {&almacen, NULL};
+    ResultadoConteo resultado;
+    int error = contarVotos(opciones->backend, &fuente, &parametros, &resultado);
+    if (error == 0) {
+        mostrarResultados(TITULO_RESULTADOS, &resultado);
+        guardarResultados(ARCHIVO_RESULTADOS, TITULO_ARCHIVO, &resultado);
+        liberarResultado(&resultado);
     }
     
-    fprintf(archivo, "\nResumen:\n");
-    fprintf(archivo, "- Votos validos: %d\n", totalValidos);
-    fprintf(archivo, "- Votos nulos: %d\n", votosNulos);
-    fprintf(archivo, "- Total procesado: %d\n", totalValidos + votosNulos);
-    fprintf(archivo, "\nTiempo de ejecucion: %.6f segundos\n", tiempoEjecucion);
-    fprintf(archivo, "Tiempo en milisegundos: %.3f ms\n", tiempoEjecucion * 1000);
-    fprintf(archivo, "Boletas por segundo: %.0f\n", numBoletas / tiempoEjecucion);
-    
-    fclose(archivo);
-    printf("\nResultados guardados en 'resultados_secuencial.txt'\n");
+    liberarAlmacenBoletas(&almacen);
+    return error != 0;
 }
 
-void ejecutarPruebaAutomatica() {
+void ejecutarPruebaAutomatica(const Opciones *opciones) {
     printf("\n=== MODO PRUEBA AUTOMaTICA ===\n");
     printf("Ejecutando con valores predefinidos...\n\n");
     
-    int numBoletas = 1000000;  
-    int numCandidatos = 10;
-    
-    char **matriz = (char **)malloc(numBoletas * sizeof(char *));
-    for (int i = 0; i < numBoletas; i++) {
-        matriz[i] = (char *)malloc(numCandidatos * sizeof(char));
+    contarEnMemoria(opciones, 1000000, 10);
+}
+
+int ejecutarConteoArchivo(const Opciones *opciones) {
+    // Con un archivo solo tienen sentido los backends de flujo y contenedor, salvo que
+    // se pida otro
+    const char *backend = opciones->backend;
+    if (strcmp(backend, "simd") == 0) {
+        backend = esArchivoContenedor(opciones->archivoEntrada) ? "contenedor" : "flujo";
     }
     
-    int *votosPorCandidato = (int *)malloc(numCandidatos * sizeof(int));
-    int votosNulos;
-    
-    printf("Generando %d boletas aleatorias...\n", numBoletas);
-    double tiempoGen = obtenerTiempoAlta();
-    generarBoletasAleatorias(matriz, numBoletas, numCandidatos);
-    printf("Tiempo de generacion: %.3f segundos\n", obtenerTiempoAlta() - tiempoGen);
+    printf("Archivo: %s\n", opciones->archivoEntrada);
+    printf("Iniciando conteo en flujo (backend %s)...\n", backend);
     
-    printf("Iniciando conteo secuencial...\n");
+    ParametrosConteo parametros = {opciones->isa, 1, NULL, opciones->usarHugePages, NULL};
+    FuenteBoletas fuente = {NULL, opciones->archivoEntrada};
+    ResultadoConteo resultado;
+    if (contarVotos(backend, &fuente, &parametros, &resultado) != 0) {
+        return 1;
+    }
     
-    double inicio = obtenerTiempoAlta();
-    contarVotosSecuencial(matriz, numBoletas, numCandidatos, 
-                         votosPorCandidato, &votosNulos);
-    double fin = obtenerTiempoAlta();
-    double tiempoEjecucion = fin - inicio;
+    mostrarResultados(TITULO_RESULTADOS, &resultado);
+    guardarResultados(ARCHIVO_RESULTADOS, TITULO_ARCHIVO, &resultado);
+    printf("  Kernel %s, lectura del archivo: %.1f MB/s\n", resultado.kernel, 
+           resultado.bytesLeidos / resultado.segundos / 1e6);
     
-    mostrarResultados(votosPorCandidato, numCandidatos, votosNulos, 
-                     tiempoEjecucion, numBoletas);
-    guardarResultados(votosPorCandidato, numCandidatos, votosNulos, 
-                     tiempoEjecucion, numBoletas);
+    liberarResultado(&resultado);
+    return 0;
+}
+
+void leerOpciones(int argc, char *argv[], Opciones *opciones) {
+    int semillaFijada = 0;
+    
+    opciones->modoPrueba = 0;
+    opciones->usarHugePages = 0;
+    opciones->modoBenchmarkSimd = 0;
+    opciones->modoBenchmarkCandidatos = 0;
+    opciones->backend = "simd";
+    opciones->isa = NULL;
+    opciones->archivoEntrada = NULL;
+    opciones->archivoExportar = NULL;
+    opciones->semilla = (uint64_t)time(NULL);
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-test") == 0) {
+            opciones->modoPrueba = 1;
+        } else if (strcmp(argv[i], "-hugepages") == 0) {
+            opciones->usarHugePages = 1;
+        } else if (strcmp(argv[i], "-bench-simd") == 0) {
+            opciones->modoBenchmarkSimd = 1;
+        } else if (strcmp(argv[i], "-bench-candidatos") == 0) {
+            opciones->modoBenchmarkCandidatos = 1;
+        } else if (strcmp(argv[i], "-backend") == 0 && i + 1 < argc) {
+            opciones->backend = argv[++i];
+        } else if (strcmp(argv[i], "-isa") == 0 && i + 1 < argc) {
+            opciones->isa = argv[++i];
+        } else if (strcmp(argv[i], "-archivo") == 0 && i + 1 < argc) {
+            opciones->archivoEntrada = argv[++i];
+        } else if (strcmp(argv[i], "-exportar") == 0 && i + 1 < argc) {
+            opciones->archivoExportar = argv[++i];
+        } else if (strcmp(argv[i], "-semilla") == 0 && i + 1 < argc) {
+            opciones->semilla = strtoull(argv[++i], NULL, 10);
+            semillaFijada = 1;
+        } else {
+            printf("Opcion desconocida ignorada: %s\n", argv[i]);
+        }
+    }
     
-    for (int i = 0; i < numBoletas; i++) {
-        free(matriz[i]);
+    // La prueba automatica usa siempre los mismos datos para comparar ambos programas
+    if (opciones->modoPrueba && !semillaFijada) {
+        opciones->semilla = SEMILLA_PRUEBA;
     }
-    free(matriz);
-    free(votosPorCandidato);
 }
 
 int main(int argc, char *argv[]) {
-    int numBoletas, numCandidatos;
-    double tiempoInicio, tiempoFin, tiempoEjecucion;
+    long long numBoletas;
+    int numCandidatos;
+    Opciones opciones;
     
     printf("\n========================================\n");
     printf("   PROGRAMA SECUENCIAL - CONTEO VOTOS   \n");
     printf("========================================\n\n");
     
-    if (argc > 1 && strcmp(argv[1], "-test") == 0) {
-        ejecutarPruebaAutomatica();
+    leerOpciones(argc, argv, &opciones);
+    detectarNivelesSimd();
+    
+    if (buscarBackend(opciones.backend) == NULL) {
+        printf("Error: Backend de conteo desconocido '%s'\n", opciones.backend);
+        mostrarBackends();
+        return 1;
+    }
+    
+    if (opciones.modoBenchmarkSimd) {
+        ejecutarBenchmarkSimd(opciones.usarHugePages, opciones.semilla);
+        return 0;
+    }
+    
+    if (opciones.modoBenchmarkCandidatos) {
+        ParametrosConteo parametros = {opciones.isa, 1, NULL, opciones.usarHugePages, NULL};
+        ejecutarBenchmarkCandidatos(opciones.backend, &parametros, opciones.semilla);
+        return 0;
+    }
+    
+    if (opciones.archivoEntrada != NULL) {
+        return ejecutarConteoArchivo(&opciones);
+    }
+    
+    if (opciones.modoPrueba) {
+        ejecutarPruebaAutomatica(&opciones);
         return 0;
     }
     
     printf("Ingrese numero de boletas a procesar: ");
-    scanf("%d", &numBoletas);
+    scanf("%lld", &numBoletas);
     
     printf("Ingrese numero de candidatos: ");
     scanf("%d", &numCandidatos);
     
     if (numBoletas > MAX_BOLETAS || numBoletas <= 0) {
-        printf("Error: Numero de boletas debe estar entre 1 y %d\n", MAX_BOLETAS);
+        printf("Error: Numero de boletas debe estar entre 1 y %lld\n", MAX_BOLETAS);
         printf("Sugerencia: Para pruebas significativas use al menos 100,000 boletas\n");
         return 1;
     }
@@ -215,37 +196,6 @@ int main(int argc, char *argv[]) {
         printf("  Recomendado: 1,000,000 boletas para pruebas significativas.\n\n");
     }
     
-    char **matriz = (char **)malloc(numBoletas * sizeof(char *));
-    for (int i = 0; i < numBoletas; i++) {
-        matriz[i] = (char *)malloc(numCandidatos * sizeof(char));
-    }
-    
-    int *votosPorCandidato = (int *)malloc(numCandidatos * sizeof(int));
-    int votosNulos;
-    
-    printf("\nGenerando %d boletas aleatorias...\n", numBoletas);
-    generarBoletasAleatorias(matriz, numBoletas, numCandidatos);
-    
-    printf("Iniciando conteo secuencial...\n");
-    
-    tiempoInicio = obtenerTiempoAlta();
-    
-    contarVotosSecuencial(matriz, numBoletas, numCandidatos, 
-                         votosPorCandidato, &votosNulos);
-    
-    tiempoFin = obtenerTiempoAlta();
-    tiempoEjecucion = tiempoFin - tiempoInicio;
-    
-    mostrarResultados(votosPorCandidato, numCandidatos, votosNulos, 
-                     tiempoEjecucion, numBoletas);
-    guardarResultados(votosPorCandidato, numCandidatos, votosNulos, 
-                     tiempoEjecucion, numBoletas);
-    
-    for (int i = 0; i < numBoletas; i++) {
-        free(matriz[i]);
-    }
-    free(matriz);
-    free(votosPorCandidato);
-    
-    return 0;
-}
\ No newline at end of file
+    printf("\n");
+    return contarEnMemoria(&opciones, numBoletas, numCandidatos);
+}
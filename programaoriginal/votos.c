@@ -0,0 +1,2490 @@
+// O_DIRECT para la tuberia de lectura
+#ifndef _WIN32
+    #define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string.h>
+#include <stdint.h>
+#include <omp.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <malloc.h>
+    #include <io.h>
+#else
+    #include <sys/mman.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/syscall.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    #define VOTOS_SIMD_X86 1
+    #include <immintrin.h>
+#endif
+
+#include "votos.h"
+
+double obtenerTiempoAlta(void) {
+    #ifdef _WIN32
+        LARGE_INTEGER frequency, counter;
+        QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&counter);
+        return (double)counter.QuadPart / (double)frequency.QuadPart;
+    #else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    #endif
+}
+
+int anchoMascara(int numCandidatos) {
+    if (numCandidatos <= 16) return 16;
+    if (numCandidatos <= 32) return 32;
+    return 64;
+}
+
+// Una sola reserva contigua con paso fijo por boleta, en lugar de un malloc por fila
+static int reservarAlmacen(AlmacenBoletas *almacen, long long numBoletas, int numCandidatos, 
+                           int usarHugePages) {
+    almacen->numBoletas = numBoletas;
+    almacen->numCandidatos = numCandidatos;
+    almacen->anchoBits = anchoMascara(numCandidatos);
+    almacen->palabras = numCandidatos > 64 ? (numCandidatos + 63) / 64 : 1;
+    almacen->paso = (size_t)(almacen->anchoBits / 8) * (size_t)almacen->palabras;
+    almacen->enHugePages = 0;
+    almacen->reservadoConMmap = 0;
+    almacen->enArena = 0;
+    almacen->datos = NULL;
+    almacen->regiones = NULL;
+    almacen->numTramos = 0;
+    
+    size_t bytes = almacen->paso * (size_t)numBoletas;
+    bytes = (bytes + ALINEACION_BOLETAS - 1) & ~(size_t)(ALINEACION_BOLETAS - 1);
+    almacen->bytesReservados = bytes;
+    
+    // Con una arena activa el tipo de pagina lo decide la arena
+    if (arenaActiva() != NULL) {
+        TipoPagina tipo;
+        almacen->datos = (char *)reservarMemoriaConteo(bytes, ALINEACION_BOLETAS, &almacen->enArena, &tipo);
+        almacen->enHugePages = tipo != PAGINA_NORMAL;
+        return almacen->datos != NULL ? 0 : -1;
+    }
+    
+    #ifdef _WIN32
+        (void)usarHugePages;
+        almacen->datos = (char *)_aligned_malloc(bytes, ALINEACION_BOLETAS);
+    #else
+        if (usarHugePages) {
+            size_t bytesHuge = (bytes + TAMANO_HUGE_PAGE - 1) & ~(TAMANO_HUGE_PAGE - 1);
+            #ifdef MAP_HUGETLB
+            void *p = mmap(NULL, bytesHuge, PROT_READ | PROT_WRITE, 
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) {
+                almacen->datos = (char *)p;
+                almacen->bytesReservados = bytesHuge;
+                almacen->enHugePages = 1;
+                almacen->reservadoConMmap = 1;
+                return 0;
+            }
+            #endif
+            // Sin paginas reservadas en el sistema: pedir transparent huge pages
+            p = mmap(NULL, bytesHuge, PROT_READ | PROT_WRITE, 
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p != MAP_FAILED) {
+                #ifdef MADV_HUGEPAGE
+                if (madvise(p, bytesHuge, MADV_HUGEPAGE) == 0) {
+                    almacen->enHugePages = 1;
+                }
+                #endif
+                almacen->datos = (char *)p;
+                almacen->bytesReservados = bytesHuge;
+                almacen->reservadoConMmap = 1;
+                return 0;
+            }
+        }
+        void *p = NULL;
+        if (posix_memalign(&p, ALINEACION_BOLETAS, bytes) == 0) {
+            almacen->datos = (char *)p;
+        }
+    #endif
+    
+    return almacen->datos != NULL ? 0 : -1;
+}
+
+int crearAlmacenBoletas(AlmacenBoletas *almacen, long long numBoletas, int numCandidatos, 
+                        int usarHugePages) {
+    empezarFase(FASE_RESERVA);
+    int error = reservarAlmacen(almacen, numBoletas, numCandidatos, usarHugePages);
+    terminarFase(FASE_RESERVA);
+    return error;
+}
+
+void liberarAlmacenBoletas(AlmacenBoletas *almacen) {
+    free(almacen->regiones);
+    almacen->regiones = NULL;
+    if (almacen->datos == NULL || almacen->enArena) {
+        almacen->datos = NULL;
+        return;
+    }
+    #ifdef _WIN32
+        _aligned_free(almacen->datos);
+    #else
+        if (almacen->reservadoConMmap) {
+            munmap(almacen->datos, almacen->bytesReservados);
+        } else {
+            free(almacen->datos);
+        }
+    #endif
+    almacen->datos = NULL;
+}
+
+// Generador basado en contador: la boleta i depende solo de (semilla, i), asi que la
+// misma semilla produce las mismas boletas con cualquier numero de hilos.
+// Mantiene la mezcla 70% validas, 15% con 2-4 marcas y 15% en blanco.
+static inline int generarMarcasBoleta(uint64_t semilla, uint64_t i, int numCandidatos, int *marcas) {
+    uint64_t r = mezclarBits(semilla ^ mezclarBits(i));
+    int tipoVoto = reducirRango((uint32_t)r, 100);
+    
+    if (tipoVoto < 70) {
+        marcas[0] = reducirRango((uint32_t)(r >> 32), numCandidatos);
+        return 1;
+    }
+    if (tipoVoto >= 85) {
+        return 0;
+    }
+    
+    uint64_t r2 = mezclarBits(r);
+    int numMarcas = 2 + reducirRango((uint32_t)r2, 3);
+    marcas[0] = reducirRango((uint32_t)(r2 >> 32), numCandidatos);
+    uint64_t r3 = mezclarBits(r2);
+    for (int m = 1; m < numMarcas; m++) {
+        marcas[m] = reducirRango((uint32_t)r3, numCandidatos);
+        r3 = mezclarBits(r3);
+    }
+    return numMarcas;
+}
+
+static inline uint64_t generarMascaraBoleta(uint64_t semilla, uint64_t i, int numCandidatos) {
+    int marcas[4];
+    int numMarcas = generarMarcasBoleta(semilla, i, numCandidatos, marcas);
+    uint64_t mascara = 0;
+    for (int m = 0; m < numMarcas; m++) {
+        mascara |= 1ULL << marcas[m];
+    }
+    return mascara;
+}
+
+void escribirBoletaGenerada(AlmacenBoletas *almacen, long long destino, uint64_t semilla, uint64_t i) {
+    if (almacen->palabras == 1) {
+        escribirMascara(almacen, destino, generarMascaraBoleta(semilla, i, almacen->numCandidatos));
+        return;
+    }
+    
+    int marcas[4];
+    int numMarcas = generarMarcasBoleta(semilla, i, almacen->numCandidatos, marcas);
+    uint64_t *palabras = palabrasBoleta(almacen, destino);
+    memset(palabras, 0, almacen->paso);
+    for (int m = 0; m < numMarcas; m++) {
+        palabras[marcas[m] >> 6] |= 1ULL << (marcas[m] & 63);
+    }
+}
+
+// Mezclas adversarias para el benchmark de clasificacion: mitad validas y mitad con
+// dos marcas distintas (el peor caso para un predictor de saltos), todas para el
+// primer candidato, o todas con dos marcas. Siguen dependiendo solo de (semilla, i).
+static int generarMarcasMezcla(uint64_t semilla, uint64_t i, int numCandidatos, 
+                               MezclaBoletas mezcla, int *marcas) {
+    uint64_t r = mezclarBits(semilla ^ mezclarBits(i));
+    int primera = reducirRango((uint32_t)(r >> 32), numCandidatos);
+    int segunda = numCandidatos > 1 ? 
+                  (primera + 1 + reducirRango((uint32_t)mezclarBits(r), numCandidatos - 1)) % numCandidatos : 
+                  primera;
+    
+    switch (mezcla) {
+        case MEZCLA_MITAD_NULAS:
+            marcas[0] = primera;
+            marcas[1] = segunda;
+            return (r & 1) ? 2 : 1;
+        case MEZCLA_UN_CANDIDATO:
+            marcas[0] = 0;
+            return 1;
+        case MEZCLA_MULTIPLES:
+            marcas[0] = primera;
+            marcas[1] = segunda;
+            return 2;
+        default:
+            return generarMarcasBoleta(semilla, i, numCandidatos, marcas);
+    }
+}
+
+static void escribirBoletaMezcla(AlmacenBoletas *almacen, long long i, uint64_t semilla, 
+                                 MezclaBoletas mezcla) {
+    int marcas[4];
+    int numMarcas = generarMarcasMezcla(semilla, (uint64_t)i, almacen->numCandidatos, mezcla, marcas);
+    if (almacen->palabras == 1) {
+        uint64_t mascara = 0;
+        for (int m = 0; m < numMarcas; m++) {
+            mascara |= 1ULL << marcas[m];
+        }
+        escribirMascara(almacen, i, mascara);
+        return;
+    }
+    
+    uint64_t *palabras = palabrasBoleta(almacen, i);
+    memset(palabras, 0, almacen->paso);
+    for (int m = 0; m < numMarcas; m++) {
+        palabras[marcas[m] >> 6] |= 1ULL << (marcas[m] & 63);
+    }
+}
+
+// Mismo reparto por bloques que contarVotosParalelo con planificacion static: cada
+// hilo es el primero en escribir (first touch) las paginas que despues contara, y el
+// kernel las coloca en su nodo NUMA
+void generarBoletasMezcla(AlmacenBoletas *almacen, uint64_t semilla, MezclaBoletas mezcla, int numHilos) {
+    long long numBoletas = almacen->numBoletas;
+    long long numBloques = (numBoletas + BOLETAS_POR_BLOQUE - 1) / BOLETAS_POR_BLOQUE;
+    
+    #pragma omp parallel num_threads(numHilos)
+    {
+        empezarFase(FASE_GENERACION);
+        #pragma omp for schedule(static) nowait
+        for (long long b = 0; b < numBloques; b++) {
+            long long inicio = b * BOLETAS_POR_BLOQUE;
+            long long fin = inicio + BOLETAS_POR_BLOQUE < numBoletas ? inicio + BOLETAS_POR_BLOQUE : numBoletas;
+            for (long long i = inicio; i < fin; i++) {
+                if (mezcla == MEZCLA_ELECCION) {
+                    escribirBoletaGenerada(almacen, i, semilla, (uint64_t)i);
+                } else {
+                    escribirBoletaMezcla(almacen, i, semilla, mezcla);
+                }
+            }
+        }
+        terminarFase(FASE_GENERACION);
+    }
+}
+
+void generarBoletasAleatorias(AlmacenBoletas *almacen, uint64_t semilla, int numHilos) {
+    generarBoletasMezcla(almacen, semilla, MEZCLA_ELECCION, numHilos);
+}
+
+// Convierte filas de texto (' ' o 'X'/'x' por candidato) al formato empaquetado
+void empaquetarRango(AlmacenBoletas *almacen, const char *texto, size_t pasoTexto, 
+                     long long inicio, long long fin) {
+    if (almacen->palabras > 1) {
+        for (long long i = inicio; i < fin; i++) {
+            const char *fila = texto + (size_t)i * pasoTexto;
+            uint64_t *palabras = palabrasBoleta(almacen, i);
+            memset(palabras, 0, almacen->paso);
+            for (int j = 0; j < almacen->numCandidatos; j++) {
+                if (fila[j] == 'X' || fila[j] == 'x') {
+                    palabras[j >> 6] |= 1ULL << (j & 63);
+                }
+            }
+        }
+        return;
+    }
+    
+    for (long long i = inicio; i < fin; i++) {
+        const char *fila = texto + (size_t)i * pasoTexto;
+        uint64_t mascara = 0;
+        for (int j = 0; j < almacen->numCandidatos; j++) {
+            if (fila[j] == 'X' || fila[j] == 'x') {
+                mascara |= 1ULL << j;
+            }
+        }
+        escribirMascara(almacen, i, mascara);
+    }
+}
+
+void empaquetarBoletas(AlmacenBoletas *almacen, const char *texto, size_t pasoTexto) {
+    empaquetarRango(almacen, texto, pasoTexto, 0, almacen->numBoletas);
+}
+
+void desempaquetarBoletas(const AlmacenBoletas *almacen, char *texto, size_t pasoTexto) {
+    for (long long i = 0; i < almacen->numBoletas; i++) {
+        char *fila = texto + (size_t)i * pasoTexto;
+        for (int j = 0; j < almacen->numCandidatos; j++) {
+            fila[j] = tieneMarca(almacen, i, j) ? 'X' : ' ';
+        }
+    }
+}
+
+// Version con un salto por boleta: es el kernel escalar anterior y solo se conserva
+// para que el benchmark de clasificacion mida lo que cuestan las malas predicciones
+static void contarRangoConSaltos(const AlmacenBoletas *almacen, long long inicio, long long fin, 
+                                 long long *votosPorCandidato, long long *votosNulos) {
+    if (almacen->palabras > 1) {
+        int palabras = almacen->palabras;
+        for (long long i = inicio; i < fin; i++) {
+            const uint64_t *boleta = palabrasBoleta(almacen, i);
+            int marcas = 0;
+            int candidatoMarcado = 0;
+            for (int w = 0; w < palabras; w++) {
+                if (boleta[w] != 0) {
+                    marcas += __builtin_popcountll(boleta[w]);
+                    candidatoMarcado = w * 64 + __builtin_ctzll(boleta[w]);
+                }
+            }
+            
+            if (marcas == 1 && candidatoMarcado < almacen->numCandidatos) {
+                votosPorCandidato[candidatoMarcado]++;
+            } else {
+                (*votosNulos)++;
+            }
+        }
+        return;
+    }
+    
+    for (long long i = inicio; i < fin; i++) {
+        uint64_t mascara = leerMascara(almacen, i);
+        
+        if (__builtin_popcountll(mascara) == 1 && __builtin_ctzll(mascara) < almacen->numCandidatos) {
+            votosPorCandidato[__builtin_ctzll(mascara)]++;
+        } else {
+            (*votosNulos)++;
+        }
+    }
+}
+
+// Clasificacion sin saltos: la mascara es un voto valido si es potencia de dos y
+// entonces suma en la columna de su candidato; si no, en la columna numCandidatos
+// (nulos). Una marca fuera de los candidatos tambien es nula, como en los kernels
+// SIMD. El bit 63 de respaldo evita ctz(0) sin preguntar antes, y la columna se
+// elige con una mascara de bits porque gcc convierte el operador ?: en saltos.
+static inline __attribute__((always_inline)) int columnaMascara(uint64_t mascara, int numCandidatos) {
+    int candidato = __builtin_ctzll(mascara | (1ULL << 63));
+    int invalida = (mascara == 0) | ((mascara & (mascara - 1)) != 0) | (candidato >= numCandidatos);
+    return candidato ^ ((candidato ^ numCandidatos) & -invalida);
+}
+
+// Cuatro histogramas alternados: boletas seguidas del mismo candidato no esperan
+// cada una al incremento de la anterior
+#define COPIAS_HISTOGRAMA 4
+
+static inline __attribute__((always_inline)) 
+void clasificarMascaras(const void *datos, const int anchoBits, long long inicio, long long fin,
+                        int numCandidatos, const int separarBlancos, long long *histogramas) {
+    const int paso = numCandidatos + 1 + separarBlancos;
+    long long i = inicio;
+    
+    #define MASCARA_EN(k) (anchoBits == 16 ? ((const uint16_t *)datos)[k] : \
+                           anchoBits == 32 ? ((const uint32_t *)datos)[k] : ((const uint64_t *)datos)[k])
+    #define COLUMNA_EN(k) (columnaMascara(MASCARA_EN(k), numCandidatos) + (separarBlancos & (MASCARA_EN(k) == 0)))
+    for (; i + COPIAS_HISTOGRAMA <= fin; i += COPIAS_HISTOGRAMA) {
+        #pragma GCC unroll 4
+        for (int k = 0; k < COPIAS_HISTOGRAMA; k++) {
+            histogramas[k * paso + COLUMNA_EN(i + k)]++;
+        }
+    }
+    for (; i < fin; i++) {
+        histogramas[COLUMNA_EN(i)]++;
+    }
+    #undef COLUMNA_EN
+    #undef MASCARA_EN
+}
+
+// Deja en conteos los votos de cada candidato y en la columna numCandidatos los nulos.
+// Con separarBlancos (constante en cada llamada) las boletas sin ninguna marca van
+// aparte, a la columna numCandidatos + 1, en la misma pasada.
+static inline __attribute__((always_inline)) 
+void clasificarRangoEscalar(const AlmacenBoletas *almacen, long long inicio, long long fin,
+                            const int separarBlancos, long long *conteos) {
+    int numCandidatos = almacen->numCandidatos;
+    int paso = numCandidatos + 1 + separarBlancos;
+    memset(conteos, 0, paso * sizeof(long long));
+    
+    if (almacen->palabras > 1) {
+        // Valida si exactamente una palabra tiene marcas y esa palabra es potencia de
+        // dos; el candidato y la columna se eligen igual que en columnaMascara
+        int palabras = almacen->palabras;
+        for (long long i = inicio; i < fin; i++) {
+            const uint64_t *boleta = palabrasBoleta(almacen, i);
+            int palabrasMarcadas = 0, potencia = 1, candidato = 0;
+            for (int w = 0; w < palabras; w++) {
+                uint64_t x = boleta[w];
+                int marcada = x != 0;
+                palabrasMarcadas += marcada;
+                potencia &= (x & (x - 1)) == 0;
+                int posicion = w * 64 + __builtin_ctzll(x | (1ULL << 63));
+                candidato ^= (candidato ^ posicion) & -marcada;
+            }
+            int invalida = (palabrasMarcadas != 1) | !potencia | (candidato >= numCandidatos);
+            int blanca = separarBlancos & (palabrasMarcadas == 0);
+            conteos[(candidato ^ ((candidato ^ numCandidatos) & -invalida)) + blanca]++;
+        }
+        return;
+    }
+    
+    long long histogramas[COPIAS_HISTOGRAMA * (64 + 2)];
+    memset(histogramas, 0, COPIAS_HISTOGRAMA * paso * sizeof(long long));
+    switch (almacen->anchoBits) {
+        case 16: clasificarMascaras(almacen->datos, 16, inicio, fin, numCandidatos, separarBlancos, histogramas); break;
+        case 32: clasificarMascaras(almacen->datos, 32, inicio, fin, numCandidatos, separarBlancos, histogramas); break;
+        default: clasificarMascaras(almacen->datos, 64, inicio, fin, numCandidatos, separarBlancos, histogramas); break;
+    }
+    for (int k = 0; k < COPIAS_HISTOGRAMA; k++) {
+        for (int c = 0; c < paso; c++) {
+            conteos[c] += histogramas[k * paso + c];
+        }
+    }
+}
+
+void contarRangoEscalar(const AlmacenBoletas *almacen, long long inicio, long long fin, 
+                        long long *votosPorCandidato, long long *votosNulos) {
+    int numCandidatos = almacen->numCandidatos;
+    if (almacen->palabras > 1) {
+        long long conteos[MAX_CANDIDATOS + 1];
+        clasificarRangoEscalar(almacen, inicio, fin, 0, conteos);
+        for (int j = 0; j < numCandidatos; j++) {
+            votosPorCandidato[j] += conteos[j];
+        }
+        *votosNulos += conteos[numCandidatos];
+        return;
+    }
+    
+    long long histogramas[COPIAS_HISTOGRAMA * (64 + 1)];
+    int paso = numCandidatos + 1;
+    memset(histogramas, 0, COPIAS_HISTOGRAMA * paso * sizeof(long long));
+    switch (almacen->anchoBits) {
+        case 16: clasificarMascaras(almacen->datos, 16, inicio, fin, numCandidatos, 0, histogramas); break;
+        case 32: clasificarMascaras(almacen->datos, 32, inicio, fin, numCandidatos, 0, histogramas); break;
+        default: clasificarMascaras(almacen->datos, 64, inicio, fin, numCandidatos, 0, histogramas); break;
+    }
+    for (int k = 0; k < COPIAS_HISTOGRAMA; k++) {
+        for (int j = 0; j < numCandidatos; j++) {
+            votosPorCandidato[j] += histogramas[k * paso + j];
+        }
+        *votosNulos += histogramas[k * paso + numCandidatos];
+    }
+}
+
+// Fila de region: candidatos, blancos y marcas multiples (los nulos que no son blancos)
+static void contarRegionEscalar(const AlmacenBoletas *almacen, long long inicio, long long fin,
+                                long long *fila) {
+    long long conteos[MAX_CANDIDATOS + 2];
+    int numCandidatos = almacen->numCandidatos;
+    clasificarRangoEscalar(almacen, inicio, fin, 1, conteos);
+    for (int j = 0; j < numCandidatos; j++) {
+        fila[j] += conteos[j];
+    }
+    fila[numCandidatos] += conteos[numCandidatos + 1];
+    fila[numCandidatos + 1] += conteos[numCandidatos];
+}
+
+#ifdef VOTOS_SIMD_X86
+// Kernels vectoriales sobre mascaras de 16 bits: una boleta cuenta para el candidato j
+// solo si su mascara es exactamente (1 << j); lo que no coincide con ninguno es nulo.
+// Cada cuerpo se escribe una vez y se instancia con numCandidatos constante para los
+// valores habituales, de modo que el bucle de candidatos se desenrolla por completo y
+// los acumuladores quedan en registros; el resto usa la version generica. Con
+// separarBlancos las mascaras vacias se cuentan en la misma lectura, en BLANCOS_LOCALES.
+#define CANDIDATOS_ESPECIALIZADOS(CASO) \
+    CASO(2) CASO(3) CASO(4) CASO(5) CASO(6) CASO(8) CASO(10) CASO(12) CASO(16)
+#define BLANCOS_LOCALES 16
+
+static void sumarVotosLocales(const long long *votosLocales, int numCandidatos, long long boletas,
+                              long long *votosPorCandidato, long long *votosNulos) {
+    long long validos = 0;
+    for (int j = 0; j < numCandidatos; j++) {
+        votosPorCandidato[j] += votosLocales[j];
+        validos += votosLocales[j];
+    }
+    *votosNulos += boletas - validos;
+}
+
+static void sumarFilaRegion(const long long *votosLocales, int numCandidatos, long long boletas,
+                            long long *fila) {
+    long long validos = 0;
+    for (int j = 0; j < numCandidatos; j++) {
+        fila[j] += votosLocales[j];
+        validos += votosLocales[j];
+    }
+    fila[numCandidatos] += votosLocales[BLANCOS_LOCALES];
+    fila[numCandidatos + 1] += boletas - validos - votosLocales[BLANCOS_LOCALES];
+}
+
+__attribute__((target("sse4.2,popcnt"), always_inline))
+static inline long long clasificarSse(const uint16_t *mascaras, long long inicio, long long fin, 
+                                      const int numCandidatos, const int separarBlancos,
+                                      long long *votosLocales) {
+    long long i = inicio;
+    for (; i + 8 <= fin; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(mascaras + i));
+        #pragma GCC unroll 16
+        for (int j = 0; j < numCandidatos; j++) {
+            __m128i igual = _mm_cmpeq_epi16(v, _mm_set1_epi16((short)(1 << j)));
+            votosLocales[j] += _mm_popcnt_u32(_mm_movemask_epi8(igual)) >> 1;
+        }
+        if (separarBlancos) {
+            __m128i vacia = _mm_cmpeq_epi16(v, _mm_setzero_si128());
+            votosLocales[BLANCOS_LOCALES] += _mm_popcnt_u32(_mm_movemask_epi8(vacia)) >> 1;
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx2,popcnt"), always_inline))
+static inline long long clasificarAvx2(const uint16_t *mascaras, long long inicio, long long fin, 
+                                       const int numCandidatos, const int separarBlancos,
+                                       long long *votosLocales) {
+    long long i = inicio;
+    for (; i + 16 <= fin; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(mascaras + i));
+        #pragma GCC unroll 16
+        for (int j = 0; j < numCandidatos; j++) {
+            __m256i igual = _mm256_cmpeq_epi16(v, _mm256_set1_epi16((short)(1 << j)));
+            votosLocales[j] += _mm_popcnt_u32((unsigned)_mm256_movemask_epi8(igual)) >> 1;
+        }
+        if (separarBlancos) {
+            __m256i vacia = _mm256_cmpeq_epi16(v, _mm256_setzero_si256());
+            votosLocales[BLANCOS_LOCALES] += _mm_popcnt_u32((unsigned)_mm256_movemask_epi8(vacia)) >> 1;
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt"), always_inline))
+static inline long long clasificarAvx512(const uint16_t *mascaras, long long inicio, long long fin, 
+                                         const int numCandidatos, const int separarBlancos,
+                                         long long *votosLocales) {
+    long long i = inicio;
+    for (; i + 32 <= fin; i += 32) {
+        __m512i v = _mm512_loadu_si512((const void *)(mascaras + i));
+        #pragma GCC unroll 16
+        for (int j = 0; j < numCandidatos; j++) {
+            __mmask32 igual = _mm512_cmpeq_epi16_mask(v, _mm512_set1_epi16((short)(1 << j)));
+            votosLocales[j] += _mm_popcnt_u32(igual);
+        }
+        if (separarBlancos) {
+            __mmask32 vacia = _mm512_cmpeq_epi16_mask(v, _mm512_setzero_si512());
+            votosLocales[BLANCOS_LOCALES] += _mm_popcnt_u32(vacia);
+        }
+    }
+    return i;
+}
+
+// Genera, para cada nivel, la version generica (numCandidatos en tiempo de ejecucion),
+// la especializada, que despacha con un switch a las instancias constantes, y la de
+// region, que ademas separa los blancos
+#define DEFINIR_KERNEL_SIMD(Nivel, objetivo)                                                      \
+__attribute__((target(objetivo)))                                                                 \
+static void contarRango##Nivel##Generico(const AlmacenBoletas *almacen, long long inicio,        \
+                                         long long fin, long long *votosPorCandidato,            \
+                                         long long *votosNulos) {                                \
+    long long votosLocales[BLANCOS_LOCALES + 1] = {0};                                            \
+    const uint16_t *mascaras = (const uint16_t *)almacen->datos;                                  \
+    long long i = clasificar##Nivel(mascaras, inicio, fin, almacen->numCandidatos, 0, votosLocales); \
+    sumarVotosLocales(votosLocales, almacen->numCandidatos, i - inicio, votosPorCandidato, votosNulos); \
+    contarRangoEscalar(almacen, i, fin, votosPorCandidato, votosNulos);                           \
+}                                                                                                 \
+                                                                                                  \
+__attribute__((target(objetivo)))                                                                 \
+static void contarRango##Nivel(const AlmacenBoletas *almacen, long long inicio, long long fin,   \
+                               long long *votosPorCandidato, long long *votosNulos) {            \
+    long long votosLocales[BLANCOS_LOCALES + 1] = {0};                                            \
+    const uint16_t *mascaras = (const uint16_t *)almacen->datos;                                  \
+    const int separarBlancos = 0;                                                                 \
+    long long i;                                                                                  \
+    switch (almacen->numCandidatos) {                                                             \
+        CANDIDATOS_ESPECIALIZADOS(CASO_##Nivel)                                                   \
+        default:                                                                                  \
+            contarRango##Nivel##Generico(almacen, inicio, fin, votosPorCandidato, votosNulos);   \
+            return;                                                                               \
+    }                                                                                             \
+    sumarVotosLocales(votosLocales, almacen->numCandidatos, i - inicio, votosPorCandidato, votosNulos); \
+    contarRangoEscalar(almacen, i, fin, votosPorCandidato, votosNulos);                           \
+}                                                                                                 \
+                                                                                                  \
+__attribute__((target(objetivo)))                                                                 \
+static void contarRegion##Nivel(const AlmacenBoletas *almacen, long long inicio, long long fin,  \
+                                long long *fila) {                                                \
+    long long votosLocales[BLANCOS_LOCALES + 1] = {0};                                            \
+    const uint16_t *mascaras = (const uint16_t *)almacen->datos;                                  \
+    const int separarBlancos = 1;                                                                 \
+    long long i;                                                                                  \
+    switch (almacen->numCandidatos) {                                                             \
+        CANDIDATOS_ESPECIALIZADOS(CASO_##Nivel)                                                   \
+        default:                                                                                  \
+            i = clasificar##Nivel(mascaras, inicio, fin, almacen->numCandidatos, 1, votosLocales); \
+            break;                                                                                \
+    }                                                                                             \
+    sumarFilaRegion(votosLocales, almacen->numCandidatos, i - inicio, fila);                      \
+    if (i < fin) {                                                                                \
+        contarRegionEscalar(almacen, i, fin, fila);                                               \
+    }                                                                                             \
+}
+
+#define CASO_Sse(c) case c: i = clasificarSse(mascaras, inicio, fin, c, separarBlancos, votosLocales); break;
+#define CASO_Avx2(c) case c: i = clasificarAvx2(mascaras, inicio, fin, c, separarBlancos, votosLocales); break;
+#define CASO_Avx512(c) case c: i = clasificarAvx512(mascaras, inicio, fin, c, separarBlancos, votosLocales); break;
+
+DEFINIR_KERNEL_SIMD(Sse, "sse4.2,popcnt")
+DEFINIR_KERNEL_SIMD(Avx2, "avx2,popcnt")
+DEFINIR_KERNEL_SIMD(Avx512, "avx512f,avx512bw,popcnt")
+#endif
+
+static NivelSimd nivelesSimd[] = {
+    {"escalar", contarRangoEscalar, contarRegionEscalar, 1},
+#ifdef VOTOS_SIMD_X86
+    {"sse4.2", contarRangoSse, contarRegionSse, 0},
+    {"avx2", contarRangoAvx2, contarRegionAvx2, 0},
+    {"avx512bw", contarRangoAvx512, contarRegionAvx512, 0},
+#endif
+};
+
+#define NUM_NIVELES_SIMD ((int)(sizeof(nivelesSimd) / sizeof(nivelesSimd[0])))
+
+// Kernel de cada nivel sin especializar (el escalar, con saltos); solo para comparar
+static const KernelConteo kernelsGenericos[] = {
+    contarRangoConSaltos,
+#ifdef VOTOS_SIMD_X86
+    contarRangoSseGenerico,
+    contarRangoAvx2Generico,
+    contarRangoAvx512Generico,
+#endif
+};
+
+static int nivelesDetectados = 0;
+
+void detectarNivelesSimd(void) {
+    nivelesDetectados = 1;
+    #ifdef VOTOS_SIMD_X86
+        __builtin_cpu_init();
+        int popcnt = __builtin_cpu_supports("popcnt");
+        nivelesSimd[1].disponible = popcnt && __builtin_cpu_supports("sse4.2");
+        nivelesSimd[2].disponible = popcnt && __builtin_cpu_supports("avx2");
+        nivelesSimd[3].disponible = popcnt && __builtin_cpu_supports("avx512bw");
+    #endif
+}
+
+// Nivel mas alto soportado por la CPU, o el pedido con -isa si esta disponible.
+// Los kernels vectoriales solo cubren mascaras de 16 bits; el resto usa el escalar.
+const NivelSimd *elegirNivelSimd(const AlmacenBoletas *almacen, const char *isaPedida) {
+    const NivelSimd *elegido = &nivelesSimd[0];
+    if (!nivelesDetectados) {
+        detectarNivelesSimd();
+    }
+    
+    if (almacen->anchoBits != 16) {
+        return elegido;
+    }
+    
+    for (int n = 0; n < NUM_NIVELES_SIMD; n++) {
+        if (!nivelesSimd[n].disponible) {
+            continue;
+        }
+        if (isaPedida != NULL) {
+            if (strcmp(isaPedida, nivelesSimd[n].nombre) == 0) {
+                return &nivelesSimd[n];
+            }
+        } else {
+            elegido = &nivelesSimd[n];
+        }
+    }
+    
+    if (isaPedida != NULL) {
+        printf("Nivel SIMD '%s' no disponible, usando '%s'\n", isaPedida, elegido->nombre);
+    }
+    return elegido;
+}
+
+void ejecutarBenchmarkSimd(int usarHugePages, uint64_t semilla) {
+    long long numBoletas = 10000000;
+    int numCandidatos = 10;
+    int repeticiones = 5;
+    
+    printf("\n=== BENCHMARK DE KERNELS SIMD ===\n");
+    printf("Boletas: %lld, candidatos: %d, mejor de %d repeticiones\n\n", 
+           numBoletas, numCandidatos, repeticiones);
+    
+    AlmacenBoletas almacen;
+    if (crearAlmacenBoletas(&almacen, numBoletas, numCandidatos, usarHugePages) != 0) {
+        printf("Error: No se pudo reservar memoria para %lld boletas\n", numBoletas);
+        return;
+    }
+    generarBoletasAleatorias(&almacen, semilla, omp_get_max_threads());
+    
+    long long referencia[16] = {0};
+    long long nulosReferencia = 0;
+    contarRangoEscalar(&almacen, 0, numBoletas, referencia, &nulosReferencia);
+    
+    printf("  %-10s %14s %18s  %s\n", "Nivel", "Tiempo (ms)", "Boletas/segundo", "Resultado");
+    for (int n = 0; n < NUM_NIVELES_SIMD; n++) {
+        if (!nivelesSimd[n].disponible) {
+            printf("  %-10s %14s %18s  %s\n", nivelesSimd[n].nombre, "-", "-", "no soportado");
+            continue;
+        }
+        
+        double mejor = 0;
+        int coincide = 1;
+        for (int r = 0; r < repeticiones; r++) {
+            long long votos[16] = {0};
+            long long nulos = 0;
+            double inicio = obtenerTiempoAlta();
+            nivelesSimd[n].funcion(&almacen, 0, numBoletas, votos, &nulos);
+            double tiempo = obtenerTiempoAlta() - inicio;
+            if (r == 0 || tiempo < mejor) {
+                mejor = tiempo;
+            }
+            coincide = coincide && nulos == nulosReferencia && 
+                       memcmp(votos, referencia, sizeof(votos)) == 0;
+        }
+        
+        printf("  %-10s %14.3f %18.0f  %s\n", nivelesSimd[n].nombre, mejor * 1000, 
+               numBoletas / mejor, coincide ? "igual al escalar" : "DIFERENTE");
+    }
+    
+    liberarAlmacenBoletas(&almacen);
+}
+
+static const char *nombresMezclas[NUM_MEZCLAS] = {
+    "eleccion", "mitad-nulas", "un-candidato", "multiples"
+};
+
+// Mejor tiempo de varias pasadas de un kernel sobre todo el almacen con un hilo
+static double medirKernel(KernelConteo kernel, const AlmacenBoletas *almacen, int repeticiones,
+                          long long *votos, long long *nulos) {
+    double mejor = 0;
+    for (int r = 0; r < repeticiones; r++) {
+        memset(votos, 0, almacen->numCandidatos * sizeof(long long));
+        *nulos = 0;
+        double inicio = obtenerTiempoAlta();
+        kernel(almacen, 0, almacen->numBoletas, votos, nulos);
+        double tiempo = obtenerTiempoAlta() - inicio;
+        if (r == 0 || tiempo < mejor) {
+            mejor = tiempo;
+        }
+    }
+    return mejor;
+}
+
+// Clasificacion con y sin saltos (escalar) y generica contra especializada (mejor nivel
+// SIMD, solo mascaras de 16 bits) sobre la mezcla normal y las adversarias
+void ejecutarBenchmarkClasificacion(int usarHugePages, uint64_t semilla) {
+    long long numBoletas = 10000000;
+    int candidatos[] = {4, 10, 16, 24, 48, 200};
+    int numPruebas = (int)(sizeof(candidatos) / sizeof(candidatos[0]));
+    int repeticiones = 5;
+    
+    printf("\n=== BENCHMARK DE CLASIFICACION ===\n");
+    printf("Boletas: %lld, un hilo, mejor de %d repeticiones (millones de boletas/segundo)\n\n", 
+           numBoletas, repeticiones);
+    printf("  %-13s %5s %11s %11s %8s %10s %11s %13s %8s  %s\n", "Mezcla", "Cand.", "Con saltos",
+           "Sin saltos", "Mejora", "Nivel", "Generico", "Especializado", "Mejora", "Resultado");
+    
+    for (int m = 0; m < NUM_MEZCLAS; m++) {
+        for (int c = 0; c < numPruebas; c++) {
+            AlmacenBoletas almacen;
+            if (crearAlmacenBoletas(&almacen, numBoletas, candidatos[c], usarHugePages) != 0) {
+                printf("Error: No se pudo reservar memoria para %lld boletas\n", numBoletas);
+                return;
+            }
+            generarBoletasMezcla(&almacen, semilla, (MezclaBoletas)m, omp_get_max_threads());
+            
+            long long *votos = (long long *)malloc(4 * candidatos[c] * sizeof(long long));
+            long long nulos[4];
+            if (votos == NULL) {
+                printf("Error: No se pudo reservar memoria para los contadores\n");
+                liberarAlmacenBoletas(&almacen);
+                return;
+            }
+            
+            double conSaltos = medirKernel(contarRangoConSaltos, &almacen, repeticiones, votos, &nulos[0]);
+            double sinSaltos = medirKernel(contarRangoEscalar, &almacen, repeticiones, 
+                                           votos + candidatos[c], &nulos[1]);
+            int coincide = nulos[0] == nulos[1] && 
+                           memcmp(votos, votos + candidatos[c], candidatos[c] * sizeof(long long)) == 0;
+            
+            printf("  %-13s %5d %11.1f %11.1f %7.2fx", nombresMezclas[m], candidatos[c],
+                   numBoletas / conSaltos / 1e6, numBoletas / sinSaltos / 1e6, conSaltos / sinSaltos);
+            
+            const NivelSimd *nivel = elegirNivelSimd(&almacen, NULL);
+            int n = (int)(nivel - nivelesSimd);
+            if (n > 0) {
+                double generico = medirKernel(kernelsGenericos[n], &almacen, repeticiones, 
+                                              votos + 2 * candidatos[c], &nulos[2]);
+                double especializado = medirKernel(nivel->funcion, &almacen, repeticiones,
+                                                   votos + 3 * candidatos[c], &nulos[3]);
+                coincide = coincide && nulos[0] == nulos[2] && nulos[0] == nulos[3] &&
+                           memcmp(votos, votos + 2 * candidatos[c], candidatos[c] * sizeof(long long)) == 0 &&
+                           memcmp(votos, votos + 3 * candidatos[c], candidatos[c] * sizeof(long long)) == 0;
+                printf(" %10s %11.1f %13.1f %7.2fx", nivel->nombre, numBoletas / generico / 1e6,
+                       numBoletas / especializado / 1e6, generico / especializado);
+            } else {
+                printf(" %10s %11s %13s %8s", "-", "-", "-", "-");
+            }
+            printf("  %s\n", coincide ? "iguales" : "DIFERENTES");
+            
+            free(votos);
+            liberarAlmacenBoletas(&almacen);
+        }
+    }
+}
+
+#define LINEA_CACHE 64
+
+// Contadores privados de cada hilo: una fila por hilo con los votos de cada candidato
+// y, en la ultima columna, los nulos. Cada fila empieza en su propia linea de cache
+// para que dos hilos nunca escriban en la misma.
+typedef struct {
+    long long *filas;
+    int numHilos;
+    int columnas;
+    int paso;
+    int enArena;
+} ContadoresHilos;
+
+static int crearContadoresHilos(ContadoresHilos *contadores, int numHilos, int numCandidatos) {
+    int porLinea = LINEA_CACHE / (int)sizeof(long long);
+    contadores->numHilos = numHilos;
+    contadores->columnas = numCandidatos + 1;
+    contadores->paso = (contadores->columnas + porLinea - 1) / porLinea * porLinea;
+    
+    size_t bytes = (size_t)numHilos * contadores->paso * sizeof(long long);
+    contadores->filas = (long long *)reservarMemoriaConteo(bytes, LINEA_CACHE, &contadores->enArena, NULL);
+    if (contadores->filas == NULL) {
+        printf("Error: No se pudo reservar memoria para los contadores de %d hilos\n", numHilos);
+        return -1;
+    }
+    return 0;
+}
+
+static void liberarContadoresHilos(ContadoresHilos *contadores) {
+    liberarMemoriaConteo(contadores->filas, contadores->enArena);
+    contadores->filas = NULL;
+}
+
+// Devuelve la fila del hilo que llama ya puesta a cero (la escribe el propio hilo)
+static inline long long *filaContadores(ContadoresHilos *contadores) {
+    long long *fila = contadores->filas + (size_t)omp_get_thread_num() * contadores->paso;
+    memset(fila, 0, contadores->columnas * sizeof(long long));
+    return fila;
+}
+
+// Suma las filas de todos los hilos sin ningun critical: las columnas se reparten
+// por lineas de cache y cada hilo suma las de su tramo a traves de todas las filas,
+// de modo que el camino critico es de columnas/hilos lineas y no crece con los hilos.
+// La llaman todos los hilos del equipo; el total queda en la fila 0.
+static void combinarContadoresHilos(ContadoresHilos *contadores) {
+    int totalHilos = omp_get_num_threads();
+    int columnas = contadores->columnas;
+    int porLinea = LINEA_CACHE / (int)sizeof(long long);
+    int numLineas = (columnas + porLinea - 1) / porLinea;
+    
+    #pragma omp barrier
+    empezarFase(FASE_MEZCLA);
+    #pragma omp for schedule(static) nowait
+    for (int linea = 0; linea < numLineas; linea++) {
+        int desde = linea * porLinea;
+        int hasta = desde + porLinea < columnas ? desde + porLinea : columnas;
+        long long *destino = contadores->filas;
+        for (int h = 1; h < totalHilos; h++) {
+            const long long *origen = contadores->filas + (size_t)h * contadores->paso;
+            for (int i = desde; i < hasta; i++) {
+                destino[i] += origen[i];
+            }
+        }
+    }
+    terminarFase(FASE_MEZCLA);
+    #pragma omp barrier
+}
+
+static void copiarTotales(const ContadoresHilos *contadores, long long *votosPorCandidato, long long *votosNulos) {
+    int numCandidatos = contadores->columnas - 1;
+    memcpy(votosPorCandidato, contadores->filas, numCandidatos * sizeof(long long));
+    *votosNulos = contadores->filas[numCandidatos];
+}
+
+static void obtenerCpuNodo(int *cpu, int *nodo) {
+    *cpu = -1;
+    *nodo = 0;
+    #if defined(__linux__) && defined(SYS_getcpu)
+        unsigned c, n;
+        if (syscall(SYS_getcpu, &c, &n, NULL) == 0) {
+            *cpu = (int)c;
+            *nodo = (int)n;
+        }
+    #endif
+}
+
+// Reparte los bloques segun la planificacion fijada con aplicarConfiguracion.
+// tiempos puede ser NULL; si no, recibe una entrada por hilo. trabajo (o NULL) se
+// llama con cada bloque justo despues de contarlo, mientras sigue en cache
+int contarVotosParalelo(const AlmacenBoletas *almacen, const NivelSimd *nivel, 
+                        long long *votosPorCandidato, long long *votosNulos, int numHilos,
+                        TiempoHilo *tiempos, TrabajoBloque trabajo, void *contexto) {
+    long long numBoletas = almacen->numBoletas;
+    int numCandidatos = almacen->numCandidatos;
+    
+    for (int i = 0; i < numCandidatos; i++) {
+        votosPorCandidato[i] = 0;
+    }
+    *votosNulos = 0;
+    
+    ContadoresHilos contadores;
+    if (crearContadoresHilos(&contadores, numHilos, numCandidatos) != 0) {
+        return -1;
+    }
+    
+    long long numBloques = (numBoletas + BOLETAS_POR_BLOQUE - 1) / BOLETAS_POR_BLOQUE;
+    
+    #pragma omp parallel num_threads(numHilos)
+    {
+        long long *votosLocales = filaContadores(&contadores);
+        long long *nulosLocales = votosLocales + numCandidatos;
+        double inicioHilo = obtenerTiempoAlta();
+        long long primera = -1, contadas = 0;
+        empezarFase(FASE_CONTEO);
+        
+        #pragma omp for schedule(runtime) nowait
+        for (long long b = 0; b < numBloques; b++) {
+            long long inicio = b * BOLETAS_POR_BLOQUE;
+            long long fin = inicio + BOLETAS_POR_BLOQUE < numBoletas ? inicio + BOLETAS_POR_BLOQUE : numBoletas;
+            nivel->funcion(almacen, inicio, fin, votosLocales, nulosLocales);
+            if (trabajo != NULL) {
+                trabajo(almacen, b, contexto);
+            }
+            if (primera < 0) primera = inicio;
+            contadas += fin - inicio;
+        }
+        terminarFase(FASE_CONTEO);
+        
+        if (tiempos != NULL) {
+            TiempoHilo *t = &tiempos[omp_get_thread_num()];
+            t->segundos = obtenerTiempoAlta() - inicioHilo;
+            t->primera = primera;
+            t->boletas = contadas;
+            obtenerCpuNodo(&t->cpu, &t->nodo);
+        }
+        
+        combinarContadoresHilos(&contadores);
+    }
+    
+    copiarTotales(&contadores, votosPorCandidato, votosNulos);
+    liberarContadoresHilos(&contadores);
+    return 0;
+}
+
+// Tiempo de la mezcla de contadores por hilo: mezcla repartida por columnas frente
+// a la antigua suma dentro de un critical
+static double medirMezcla(ContadoresHilos *contadores, long long *totales, int numHilos, int repartida) {
+    int columnas = contadores->columnas;
+    double tiempo = 0;
+    
+    #pragma omp parallel num_threads(numHilos)
+    {
+        long long *fila = filaContadores(contadores);
+        for (int i = 0; i < columnas; i++) {
+            fila[i] = omp_get_thread_num() + i;
+        }
+        
+        #pragma omp barrier
+        double inicio = obtenerTiempoAlta();
+        if (repartida) {
+            combinarContadoresHilos(contadores);
+        } else {
+            #pragma omp critical
+            {
+                for (int i = 0; i < columnas; i++) {
+                    totales[i] += fila[i];
+                }
+            }
+            #pragma omp barrier
+        }
+        
+        #pragma omp master
+        {
+            tiempo = obtenerTiempoAlta() - inicio;
+        }
+    }
+    return tiempo;
+}
+
+void ejecutarBenchmarkHilos(int numCandidatos, const char *isa, int usarHugePages, uint64_t semilla) {
+    int hilos[] = {1, 2, 4, 8, 16, 32, 64};
+    int numPruebas = (int)(sizeof(hilos) / sizeof(hilos[0]));
+    long long numBoletas = 4000000;
+    int repeticiones = 3;
+    int repeticionesMezcla = 20;
+    
+    AlmacenBoletas almacen;
+    if (crearAlmacenBoletas(&almacen, numBoletas, numCandidatos, usarHugePages) != 0) {
+        printf("Error: No se pudo reservar memoria para %lld boletas\n", numBoletas);
+        return;
+    }
+    generarBoletasAleatorias(&almacen, semilla, omp_get_max_threads());
+    const NivelSimd *nivel = elegirNivelSimd(&almacen, isa);
+    long long *votos = (long long *)malloc((numCandidatos + 1) * sizeof(long long));
+    long long nulos;
+    if (votos == NULL) {
+        printf("Error: No se pudo reservar memoria para el conteo\n");
+        liberarAlmacenBoletas(&almacen);
+        return;
+    }
+    
+    printf("\n=== BENCHMARK POR NUMERO DE HILOS ===\n");
+    printf("Boletas: %lld, %d candidatos, kernel %s, %d nucleos\n\n", 
+           numBoletas, numCandidatos, nivel->nombre, omp_get_num_procs());
+    printf("  %6s %14s %18s %22s %22s\n", "Hilos", "Conteo (ms)", "Boletas/segundo", 
+           "Mezcla repartida (us)", "Mezcla critical (us)");
+    
+    for (int p = 0; p < numPruebas; p++) {
+        int numHilos = hilos[p];
+        double mejorConteo = 0;
+        int fallo = 0;
+        for (int r = 0; r < repeticiones && !fallo; r++) {
+            double inicio = obtenerTiempoAlta();
+            fallo = contarVotosParalelo(&almacen, nivel, votos, &nulos, numHilos, NULL, NULL, NULL) != 0;
+            double tiempo = obtenerTiempoAlta() - inicio;
+            if (r == 0 || tiempo < mejorConteo) {
+                mejorConteo = tiempo;
+            }
+        }
+        if (fallo) {
+            printf("  %6d  sin memoria suficiente\n", numHilos);
+            continue;
+        }
+        
+        ContadoresHilos contadores;
+        if (crearContadoresHilos(&contadores, numHilos, numCandidatos) != 0) {
+            break;
+        }
+        double mejorRepartida = 0, mejorCritical = 0;
+        for (int r = 0; r < repeticionesMezcla; r++) {
+            double repartida = medirMezcla(&contadores, votos, numHilos, 1);
+            memset(votos, 0, (numCandidatos + 1) * sizeof(long long));
+            double critical = medirMezcla(&contadores, votos, numHilos, 0);
+            if (r == 0 || repartida < mejorRepartida) mejorRepartida = repartida;
+            if (r == 0 || critical < mejorCritical) mejorCritical = critical;
+        }
+        liberarContadoresHilos(&contadores);
+        
+        printf("  %6d %14.3f %18.0f %22.2f %22.2f\n", numHilos, mejorConteo * 1000, 
+               numBoletas / mejorConteo, mejorRepartida * 1e6, mejorCritical * 1e6);
+    }
+    
+    free(votos);
+    liberarAlmacenBoletas(&almacen);
+}
+
+const char *nombrePlanificacion(omp_sched_t planificacion) {
+    switch (planificacion) {
+        case omp_sched_static:  return "static";
+        case omp_sched_dynamic: return "dynamic";
+        case omp_sched_guided:  return "guided";
+        default:                return "auto";
+    }
+}
+
+static int leerPlanificacion(const char *nombre, omp_sched_t *planificacion) {
+    if (strcmp(nombre, "static") == 0) *planificacion = omp_sched_static;
+    else if (strcmp(nombre, "dynamic") == 0) *planificacion = omp_sched_dynamic;
+    else if (strcmp(nombre, "guided") == 0) *planificacion = omp_sched_guided;
+    else return -1;
+    return 0;
+}
+
+// El conteo usa schedule(runtime), asi que la planificacion se fija antes de cada region
+void aplicarConfiguracion(const ConfiguracionConteo *config) {
+    omp_set_schedule(config->planificacion, config->bloque);
+}
+
+void configuracionPorDefecto(ConfiguracionConteo *config, int numHilos) {
+    config->numHilos = numHilos;
+    config->planificacion = omp_sched_static;
+    config->bloque = 0;
+    config->boletasPorSegundo = 0;
+}
+
+// Clave del perfil: la maquina y el tipo de entrada (ancho de boleta y orden de magnitud
+// del numero de boletas), porque la mejor configuracion cambia con ambos
+static void clavePerfil(const AlmacenBoletas *almacen, char *clave, size_t tamano) {
+    char maquina[128] = "desconocida";
+    #ifdef _WIN32
+        DWORD largo = sizeof(maquina);
+        GetComputerNameA(maquina, &largo);
+    #else
+        gethostname(maquina, sizeof(maquina) - 1);
+        maquina[sizeof(maquina) - 1] = '\0';
+    #endif
+    int escala = 0;
+    for (long long n = almacen->numBoletas; n >= 10; n /= 10) {
+        escala++;
+    }
+    snprintf(clave, tamano, "%s/%d/%d/%d", maquina, omp_get_num_procs(), 
+             almacen->anchoBits * almacen->palabras, escala);
+}
+
+// Cada linea del perfil: clave hilos planificacion bloque boletas/segundo.
+// Si la clave aparece varias veces vale la ultima.
+static int buscarEnPerfil(const char *clave, ConfiguracionConteo *config) {
+    FILE *archivo = fopen(ARCHIVO_PERFIL, "r");
+    if (archivo == NULL) {
+        return 0;
+    }
+    
+    char linea[512], claveLeida[256], planificacion[32];
+    int encontrado = 0;
+    while (fgets(linea, sizeof(linea), archivo) != NULL) {
+        ConfiguracionConteo leida;
+        if (sscanf(linea, "%255s %d %31s %d %lf", claveLeida, &leida.numHilos, planificacion, 
+                   &leida.bloque, &leida.boletasPorSegundo) != 5) {
+            continue;
+        }
+        if (strcmp(claveLeida, clave) == 0 && leida.numHilos > 0 &&
+            leerPlanificacion(planificacion, &leida.planificacion) == 0) {
+            *config = leida;
+            encontrado = 1;
+        }
+    }
+    fclose(archivo);
+    return encontrado;
+}
+
+static void guardarEnPerfil(const char *clave, const ConfiguracionConteo *config) {
+    FILE *archivo = fopen(ARCHIVO_PERFIL, "a");
+    if (archivo == NULL) {
+        printf("Aviso: No se pudo guardar el perfil en '%s'\n", ARCHIVO_PERFIL);
+        return;
+    }
+    fprintf(archivo, "%s %d %s %d %.0f\n", clave, config->numHilos, 
+            nombrePlanificacion(config->planificacion), config->bloque, config->boletasPorSegundo);
+    fclose(archivo);
+}
+
+// Calibracion corta sobre las primeras boletas de la entrada real: prueba numeros de
+// hilos (potencias de dos hasta los nucleos), planificacion static/dynamic/guided y
+// varios tamanos de chunk, y se queda con la de mas boletas por segundo
+static void calibrarConfiguracion(const AlmacenBoletas *almacen, const NivelSimd *nivel, 
+                                  ConfiguracionConteo *mejor) {
+    omp_sched_t planificaciones[] = {omp_sched_static, omp_sched_dynamic, omp_sched_guided};
+    int bloques[] = {0, 1, 4, 16};
+    int repeticiones = 3;
+    int numCores = omp_get_num_procs();
+    
+    AlmacenBoletas muestra = *almacen;
+    if (muestra.numBoletas > 8LL * 1024 * 1024) {
+        muestra.numBoletas = 8LL * 1024 * 1024;
+    }
+    
+    long long *votos = (long long *)malloc(almacen->numCandidatos * sizeof(long long));
+    long long nulos;
+    int probadas = 0;
+    double inicioCalibracion = obtenerTiempoAlta();
+    configuracionPorDefecto(mejor, 1);
+    
+    for (int numHilos = 1; ; numHilos = numHilos * 2 < numCores ? numHilos * 2 : numCores) {
+        for (int p = 0; p < 3; p++) {
+            for (int b = 0; b < 4; b++) {
+                // dynamic y guided con chunk 0 equivalen a chunk 1
+                if (bloques[b] == 0 && planificaciones[p] != omp_sched_static) {
+                    continue;
+                }
+                ConfiguracionConteo prueba;
+                prueba.numHilos = numHilos;
+                prueba.planificacion = planificaciones[p];
+                prueba.bloque = bloques[b];
+                aplicarConfiguracion(&prueba);
+                
+                double mejorTiempo = 0;
+                for (int r = 0; r < repeticiones; r++) {
+                    double inicio = obtenerTiempoAlta();
+                    contarVotosParalelo(&muestra, nivel, votos, &nulos, numHilos, NULL, NULL, NULL);
+                    double tiempo = obtenerTiempoAlta() - inicio;
+                    if (r == 0 || tiempo < mejorTiempo) {
+                        mejorTiempo = tiempo;
+                    }
+                }
+                prueba.boletasPorSegundo = muestra.numBoletas / mejorTiempo;
+                probadas++;
+                if (prueba.boletasPorSegundo > mejor->boletasPorSegundo) {
+                    *mejor = prueba;
+                }
+            }
+        }
+        if (numHilos >= numCores) {
+            break;
+        }
+    }
+    
+    printf("Autoajuste: %d configuraciones probadas sobre %lld boletas en %.1f ms\n", probadas, 
+           muestra.numBoletas, (obtenerTiempoAlta() - inicioCalibracion) * 1000);
+    free(votos);
+}
+
+// Configuracion para contar este almacen: la del perfil local si ya se calibro esta
+// maquina para este tipo de entrada, o una calibracion nueva que se guarda en el perfil
+void elegirConfiguracion(const AlmacenBoletas *almacen, const NivelSimd *nivel, 
+                         int recalibrar, ConfiguracionConteo *config) {
+    char clave[256];
+    clavePerfil(almacen, clave, sizeof(clave));
+    
+    if (!recalibrar && buscarEnPerfil(clave, config)) {
+        printf("Configuracion leida de '%s'\n", ARCHIVO_PERFIL);
+    } else {
+        calibrarConfiguracion(almacen, nivel, config);
+        guardarEnPerfil(clave, config);
+    }
+    printf("- %d hilos, schedule(%s, %d), %.0f boletas/segundo en la calibracion\n", 
+           config->numHilos, nombrePlanificacion(config->planificacion), config->bloque, 
+           config->boletasPorSegundo);
+    aplicarConfiguracion(config);
+}
+
+int abrirLectorBoletas(LectorBoletas *lector, const char *ruta) {
+    FILE *archivo = fopen(ruta, "rb");
+    if (archivo == NULL) {
+        printf("Error: No se pudo abrir el archivo de boletas '%s'\n", ruta);
+        return -1;
+    }
+    
+    int c, ancho = 0, finLinea = 0;
+    while ((c = fgetc(archivo)) != EOF && c != '\n') {
+        if (c == '\r') {
+            finLinea++;
+        } else {
+            ancho++;
+        }
+    }
+    fseek(archivo, 0, SEEK_END);
+    long long tamano = (long long)ftell(archivo);
+    fclose(archivo);
+    
+    if (ancho <= 0 || ancho > MAX_CANDIDATOS) {
+        printf("Error: Linea de boleta con %d candidatos (debe estar entre 1 y %d)\n", 
+               ancho, MAX_CANDIDATOS);
+        return -1;
+    }
+    
+    lector->numCandidatos = ancho;
+    lector->pasoTexto = (size_t)(ancho + finLinea + 1);
+    lector->tamanoArchivo = tamano;
+    lector->numBoletas = tamano / (long long)lector->pasoTexto;
+    if (tamano % (long long)lector->pasoTexto >= ancho) {
+        lector->numBoletas++;
+    }
+    lector->siguiente = 0;
+    lector->boletasPorVentana = (int)(BYTES_POR_VENTANA / lector->pasoTexto);
+    
+    #ifdef _WIN32
+        lector->archivo = fopen(ruta, "rb");
+        lector->buffer = (char *)malloc((size_t)lector->boletasPorVentana * lector->pasoTexto);
+        if (lector->archivo == NULL || lector->buffer == NULL) {
+            printf("Error: No se pudo preparar la lectura de '%s'\n", ruta);
+            return -1;
+        }
+    #else
+        lector->descriptor = open(ruta, O_RDONLY);
+        lector->mapa = NULL;
+        lector->bytesMapa = 0;
+        if (lector->descriptor < 0) {
+            printf("Error: No se pudo abrir el archivo de boletas '%s'\n", ruta);
+            return -1;
+        }
+        #ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(lector->descriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+        #endif
+    #endif
+    
+    return 0;
+}
+
+// Devuelve el numero de boletas de la siguiente ventana (0 al terminar, -1 si la
+// lectura fallo) y deja en *texto el inicio de su primera fila. La ventana anterior
+// deja de ser valida.
+int leerVentanaBoletas(LectorBoletas *lector, const char **texto) {
+    long long restantes = lector->numBoletas - lector->siguiente;
+    int boletas = restantes < lector->boletasPorVentana ? (int)restantes : lector->boletasPorVentana;
+    if (boletas <= 0) {
+        return 0;
+    }
+    
+    long long desplazamiento = lector->siguiente * (long long)lector->pasoTexto;
+    long long bytes = (long long)boletas * (long long)lector->pasoTexto;
+    if (desplazamiento + bytes > lector->tamanoArchivo) {
+        bytes = lector->tamanoArchivo - desplazamiento;
+    }
+    
+    #ifdef _WIN32
+        if (fread(lector->buffer, 1, (size_t)bytes, lector->archivo) != (size_t)bytes) {
+            printf("Error: Lectura incompleta del archivo de boletas\n");
+            return -1;
+        }
+        *texto = lector->buffer;
+    #else
+        if (lector->mapa != NULL) {
+            munmap(lector->mapa, lector->bytesMapa);
+            lector->mapa = NULL;
+        }
+        
+        long long pagina = (long long)sysconf(_SC_PAGESIZE);
+        long long inicioMapa = desplazamiento - desplazamiento % pagina;
+        lector->bytesMapa = (size_t)(desplazamiento - inicioMapa + bytes);
+        void *p = mmap(NULL, lector->bytesMapa, PROT_READ, MAP_PRIVATE, 
+                       lector->descriptor, (off_t)inicioMapa);
+        if (p == MAP_FAILED) {
+            printf("Error: No se pudo mapear el archivo de boletas\n");
+            return -1;
+        }
+        lector->mapa = (char *)p;
+        madvise(p, lector->bytesMapa, MADV_SEQUENTIAL);
+        
+        // Pedir ya la siguiente ventana al kernel para que la lectura del disco
+        // se solape con el conteo de esta
+        #ifdef POSIX_FADV_WILLNEED
+        posix_fadvise(lector->descriptor, (off_t)(desplazamiento + bytes), 
+                      (off_t)BYTES_POR_VENTANA, POSIX_FADV_WILLNEED);
+        #endif
+        
+        *texto = lector->mapa + (desplazamiento - inicioMapa);
+    #endif
+    
+    lector->siguiente += boletas;
+    return boletas;
+}
+
+void cerrarLectorBoletas(LectorBoletas *lector) {
+    #ifdef _WIN32
+        if (lector->archivo != NULL) fclose(lector->archivo);
+        free(lector->buffer);
+    #else
+        if (lector->mapa != NULL) {
+            munmap(lector->mapa, lector->bytesMapa);
+            lector->mapa = NULL;
+        }
+        if (lector->descriptor >= 0) close(lector->descriptor);
+    #endif
+}
+
+int exportarBoletasTexto(const AlmacenBoletas *almacen, const char *ruta) {
+    FILE *archivo = fopen(ruta, "wb");
+    if (archivo == NULL) {
+        printf("Error: No se pudo crear el archivo '%s'\n", ruta);
+        return -1;
+    }
+    
+    int numCandidatos = almacen->numCandidatos;
+    char fila[MAX_CANDIDATOS + 1];
+    fila[numCandidatos] = '\n';
+    for (long long i = 0; i < almacen->numBoletas; i++) {
+        for (int j = 0; j < numCandidatos; j++) {
+            fila[j] = tieneMarca(almacen, i, j) ? 'X' : ' ';
+        }
+        fwrite(fila, 1, numCandidatos + 1, archivo);
+    }
+    
+    fclose(archivo);
+    printf("Boletas exportadas a '%s'\n", ruta);
+    return 0;
+}
+
+int contarArchivoParalelo(LectorBoletas *lector, AlmacenBoletas *ventana, 
+                          const NivelSimd *nivel, long long *votosPorCandidato, 
+                          long long *votosNulos, int numHilos) {
+    int numCandidatos = lector->numCandidatos;
+    size_t pasoTexto = lector->pasoTexto;
+    
+    for (int i = 0; i < numCandidatos; i++) {
+        votosPorCandidato[i] = 0;
+    }
+    *votosNulos = 0;
+    
+    ContadoresHilos contadores;
+    if (crearContadoresHilos(&contadores, numHilos, numCandidatos) != 0) {
+        return -1;
+    }
+    
+    int boletasVentana = 0;
+    const char *texto = NULL;
+    
+    // Un solo equipo de hilos para todo el archivo: un hilo mapea la ventana y
+    // todos empaquetan y cuentan su parte antes de pasar a la siguiente
+    #pragma omp parallel num_threads(numHilos)
+    {
+        long long *votosLocales = filaContadores(&contadores);
+        long long *nulosLocales = votosLocales + numCandidatos;
+        
+        while (1) {
+            #pragma omp single
+            {
+                boletasVentana = leerVentanaBoletas(lector, &texto);
+            }
+            if (boletasVentana <= 0) {
+                break;
+            }
+            
+            int numBloques = (boletasVentana + BOLETAS_POR_BLOQUE - 1) / BOLETAS_POR_BLOQUE;
+            
+            #pragma omp for schedule(static)
+            for (int b = 0; b < numBloques; b++) {
+                int inicio = b * BOLETAS_POR_BLOQUE;
+                int fin = inicio + BOLETAS_POR_BLOQUE < boletasVentana ? inicio + BOLETAS_POR_BLOQUE : boletasVentana;
+                empaquetarRango(ventana, texto, pasoTexto, inicio, fin);
+                nivel->funcion(ventana, inicio, fin, votosLocales, nulosLocales);
+            }
+        }
+        
+        combinarContadoresHilos(&contadores);
+    }
+    
+    copiarTotales(&contadores, votosPorCandidato, votosNulos);
+    liberarContadoresHilos(&contadores);
+    return boletasVentana < 0 ? -1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// Tuberia de lectura: mientras una ranura se llena con pread, las anteriores se
+// empaquetan y cuentan. Las dependencias entre tareas OpenMP hacen de colas
+// acotadas: la lectura de la ventana w espera a que terminen todas las tareas de la
+// ventana w - RANURAS_TUBERIA, que usaba la misma ranura. Los buffers se
+// reservan una vez; en todo el conteo no hay mas reservas.
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    char *buffer;
+    int bufferEnArena;
+    const char *texto;
+    AlmacenBoletas boletas;
+} RanuraTuberia;
+
+// Lee las filas [primera, primera + boletas) en el buffer de una ranura y devuelve
+// donde empieza la primera, o NULL si la lectura fallo. Con O_DIRECT el disco copia
+// directamente al buffer (sin pasar por la cache de paginas ni gastar CPU), pero la
+// posicion y el tamano deben ir alineados a ALINEACION_DIRECTA: se lee de mas por
+// delante y por detras.
+static char *leerVentanaEnBuffer(LectorBoletas *lector, int directo, long long primera, 
+                                 int boletas, char *buffer) {
+    long long desplazamiento = primera * (long long)lector->pasoTexto;
+    long long bytes = (long long)boletas * (long long)lector->pasoTexto;
+    if (desplazamiento + bytes > lector->tamanoArchivo) {
+        bytes = lector->tamanoArchivo - desplazamiento;
+    }
+    
+    #ifdef _WIN32
+        // Las lecturas estan serializadas por la tuberia, asi que basta con fseek
+        (void)directo;
+        if (_fseeki64(lector->archivo, desplazamiento, SEEK_SET) != 0 ||
+            fread(buffer, 1, (size_t)bytes, lector->archivo) != (size_t)bytes) {
+            return NULL;
+        }
+        return buffer;
+    #else
+        long long inicio = desplazamiento;
+        long long pedidos = bytes;
+        if (directo) {
+            inicio = desplazamiento - desplazamiento % ALINEACION_DIRECTA;
+            pedidos = (desplazamiento + bytes - inicio + ALINEACION_DIRECTA - 1) / ALINEACION_DIRECTA * ALINEACION_DIRECTA;
+        }
+        
+        long long hechos = 0;
+        while (hechos < pedidos) {
+            ssize_t n = pread(lector->descriptor, buffer + hechos, (size_t)(pedidos - hechos), (off_t)(inicio + hechos));
+            if (n < 0) {
+                return NULL;
+            }
+            if (n == 0) {
+                break;
+            }
+            hechos += n;
+        }
+        if (hechos < desplazamiento - inicio + bytes) {
+            return NULL;
+        }
+        return buffer + (desplazamiento - inicio);
+    #endif
+}
+
+int contarArchivoTuberia(LectorBoletas *lector, const NivelSimd *nivel, long long *votosPorCandidato, 
+                         long long *votosNulos, int numHilos, int usarHugePages) {
+    int numCandidatos = lector->numCandidatos;
+    size_t pasoTexto = lector->pasoTexto;
+    int boletasPorRanura = (int)(BYTES_POR_RANURA / pasoTexto) > 0 ? (int)(BYTES_POR_RANURA / pasoTexto) : 1;
+    long long numBoletas = lector->numBoletas;
+    long long numVentanas = (numBoletas + boletasPorRanura - 1) / boletasPorRanura;
+    
+    // Cada buffer lleva una pagina de mas por delante y por detras para las lecturas
+    // alineadas de O_DIRECT
+    size_t bytesBuffer = (size_t)boletasPorRanura * pasoTexto + 2 * ALINEACION_DIRECTA;
+    RanuraTuberia ranuras[RANURAS_TUBERIA];
+    int listas = 0, errorLectura = 0;
+    for (; listas < RANURAS_TUBERIA; listas++) {
+        ranuras[listas].buffer = (char *)reservarMemoriaConteo(bytesBuffer, ALINEACION_DIRECTA,
+                                                               &ranuras[listas].bufferEnArena, NULL);
+        if (ranuras[listas].buffer == NULL ||
+            crearAlmacenBoletas(&ranuras[listas].boletas, boletasPorRanura, numCandidatos, usarHugePages) != 0) {
+            liberarMemoriaConteo(ranuras[listas].buffer, ranuras[listas].bufferEnArena);
+            break;
+        }
+    }
+    
+    // Un hilo mas que los de conteo para que haya quien espere al disco sin dejar
+    // un nucleo sin trabajo
+    ContadoresHilos contadores;
+    if (listas < RANURAS_TUBERIA || crearContadoresHilos(&contadores, numHilos + 1, numCandidatos) != 0) {
+        printf("Error: No se pudo reservar memoria para la tuberia de lectura\n");
+        for (int r = 0; r < listas; r++) {
+            liberarMemoriaConteo(ranuras[r].buffer, ranuras[r].bufferEnArena);
+            liberarAlmacenBoletas(&ranuras[r].boletas);
+        }
+        return -1;
+    }
+    
+    // O_DIRECT solo mientras dura la tuberia, y solo si el sistema de archivos lo
+    // admite (tmpfs, por ejemplo, no)
+    int directo = 0;
+    #if !defined(_WIN32) && defined(O_DIRECT)
+        int banderas = fcntl(lector->descriptor, F_GETFL);
+        directo = banderas >= 0 && fcntl(lector->descriptor, F_SETFL, banderas | O_DIRECT) == 0;
+    #endif
+    
+    // Solo se usan sus direcciones, como claves de las dependencias entre tareas
+    __attribute__((unused)) char turnos[RANURAS_TUBERIA];
+    
+    #pragma omp parallel num_threads(numHilos + 1)
+    {
+        filaContadores(&contadores);
+        
+        // Un solo hilo lee y, tras cada lectura, crea las tareas que empaquetan y
+        // cuentan esa ventana; el resto del equipo las ejecuta. Mientras espera a que
+        // se libere una ranura, el lector tambien cuenta.
+        #pragma omp single
+        {
+            for (long long w = 0; w < numVentanas && !errorLectura; w++) {
+                int r = (int)(w % RANURAS_TUBERIA);
+                RanuraTuberia *ranura = &ranuras[r];
+                long long primera = w * boletasPorRanura;
+                int boletas = numBoletas - primera < boletasPorRanura ? (int)(numBoletas - primera) : boletasPorRanura;
+                
+                #pragma omp taskwait depend(inout: turnos[r])
+                ranura->texto = leerVentanaEnBuffer(lector, directo, primera, boletas, ranura->buffer);
+                if (ranura->texto == NULL) {
+                    errorLectura = 1;
+                    break;
+                }
+                
+                for (int inicio = 0; inicio < boletas; inicio += BOLETAS_POR_TAREA_TUBERIA) {
+                    int fin = inicio + BOLETAS_POR_TAREA_TUBERIA < boletas ? inicio + BOLETAS_POR_TAREA_TUBERIA : boletas;
+                    #pragma omp task depend(in: turnos[r])
+                    {
+                        long long *votosLocales = contadores.filas + (size_t)omp_get_thread_num() * contadores.paso;
+                        for (int bloque = inicio; bloque < fin; bloque += BOLETAS_POR_BLOQUE) {
+                            int finBloque = bloque + BOLETAS_POR_BLOQUE < fin ? bloque + BOLETAS_POR_BLOQUE : fin;
+                            empaquetarRango(&ranura->boletas, ranura->texto, pasoTexto, bloque, finBloque);
+                            nivel->funcion(&ranura->boletas, bloque, finBloque, votosLocales, 
+                                           votosLocales + numCandidatos);
+                        }
+                    }
+                }
+            }
+        }
+        
+        combinarContadoresHilos(&contadores);
+    }
+    
+    copiarTotales(&contadores, votosPorCandidato, votosNulos);
+    liberarContadoresHilos(&contadores);
+    #if !defined(_WIN32) && defined(O_DIRECT)
+        if (directo) {
+            fcntl(lector->descriptor, F_SETFL, banderas);
+        }
+    #endif
+    for (int r = 0; r < RANURAS_TUBERIA; r++) {
+        liberarMemoriaConteo(ranuras[r].buffer, ranuras[r].bufferEnArena);
+        liberarAlmacenBoletas(&ranuras[r].boletas);
+    }
+    if (errorLectura) {
+        printf("Error: Lectura incompleta del archivo de boletas\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Saca el archivo de la cache de paginas para medir lecturas en frio
+static void vaciarCacheArchivo(const char *ruta) {
+    #if !defined(_WIN32) && defined(POSIX_FADV_DONTNEED)
+        int descriptor = open(ruta, O_RDONLY);
+        if (descriptor >= 0) {
+            posix_fadvise(descriptor, 0, 0, POSIX_FADV_DONTNEED);
+            close(descriptor);
+        }
+    #else
+        (void)ruta;
+    #endif
+}
+
+// Disco solo (lecturas de la tuberia sin contar), CPU sola (empaquetar y contar una
+// ventana ya leida tantas veces como ventanas tiene el archivo) y los backends flujo
+// y tuberia en frio. Sin solapamiento el tiempo se acerca a la suma de disco y CPU;
+// con la tuberia, al maximo de los dos.
+void ejecutarBenchmarkTuberia(const char *ruta, int numHilos) {
+    LectorBoletas lector;
+    if (abrirLectorBoletas(&lector, ruta) != 0) {
+        return;
+    }
+    int numCandidatos = lector.numCandidatos;
+    int boletasPorRanura = (int)(BYTES_POR_RANURA / lector.pasoTexto) > 0 ? (int)(BYTES_POR_RANURA / lector.pasoTexto) : 1;
+    long long numVentanas = (lector.numBoletas + boletasPorRanura - 1) / boletasPorRanura;
+    if (numHilos <= 0) {
+        numHilos = omp_get_max_threads();
+    }
+    
+    int bufferEnArena;
+    AlmacenBoletas ventana;
+    char *buffer = (char *)reservarMemoriaConteo((size_t)boletasPorRanura * lector.pasoTexto + 2 * ALINEACION_DIRECTA,
+                                                 ALINEACION_DIRECTA, &bufferEnArena, NULL);
+    if (buffer == NULL || crearAlmacenBoletas(&ventana, boletasPorRanura, numCandidatos, 0) != 0) {
+        printf("Error: No se pudo reservar memoria para el benchmark\n");
+        liberarMemoriaConteo(buffer, bufferEnArena);
+        cerrarLectorBoletas(&lector);
+        return;
+    }
+    const NivelSimd *nivel = elegirNivelSimd(&ventana, NULL);
+    
+    printf("\n=== BENCHMARK DE LA TUBERIA DE LECTURA ===\n");
+    printf("Archivo: %s (%lld boletas, %.1f MB), %d hilos, %d ranuras de %lu MB\n\n", ruta, 
+           lector.numBoletas, lector.tamanoArchivo / 1e6, numHilos, RANURAS_TUBERIA, 
+           BYTES_POR_RANURA / (1024 * 1024));
+    
+    // Disco: las mismas lecturas que hace la tuberia
+    int directo = 0;
+    #if !defined(_WIN32) && defined(O_DIRECT)
+        int banderas = fcntl(lector.descriptor, F_GETFL);
+        directo = banderas >= 0 && fcntl(lector.descriptor, F_SETFL, banderas | O_DIRECT) == 0;
+    #endif
+    vaciarCacheArchivo(ruta);
+    double inicio = obtenerTiempoAlta();
+    for (long long w = 0; w < numVentanas; w++) {
+        long long primera = w * boletasPorRanura;
+        int boletas = lector.numBoletas - primera < boletasPorRanura ? (int)(lector.numBoletas - primera) : boletasPorRanura;
+        leerVentanaEnBuffer(&lector, directo, primera, boletas, buffer);
+    }
+    double disco = obtenerTiempoAlta() - inicio;
+    
+    // CPU: la primera ventana, empaquetada y contada numVentanas veces
+    const char *texto = leerVentanaEnBuffer(&lector, directo, 0, boletasPorRanura < lector.numBoletas ? 
+                                            boletasPorRanura : (int)lector.numBoletas, buffer);
+    #if !defined(_WIN32) && defined(O_DIRECT)
+        if (directo) {
+            fcntl(lector.descriptor, F_SETFL, banderas);
+        }
+    #endif
+    long long *votos = (long long *)calloc(numCandidatos + 1, sizeof(long long));
+    double cpu = 0;
+    if (texto != NULL && votos != NULL) {
+        int boletas = boletasPorRanura < lector.numBoletas ? boletasPorRanura : (int)lector.numBoletas;
+        int numBloques = (boletas + BOLETAS_POR_BLOQUE - 1) / BOLETAS_POR_BLOQUE;
+        inicio = obtenerTiempoAlta();
+        for (long long w = 0; w < numVentanas; w++) {
+            #pragma omp parallel for num_threads(numHilos) schedule(static)
+            for (int b = 0; b < numBloques; b++) {
+                long long votosLocales[MAX_CANDIDATOS + 1] = {0};
+                int primera = b * BOLETAS_POR_BLOQUE;
+                int fin = primera + BOLETAS_POR_BLOQUE < boletas ? primera + BOLETAS_POR_BLOQUE : boletas;
+                empaquetarRango(&ventana, texto, lector.pasoTexto, primera, fin);
+                nivel->funcion(&ventana, primera, fin, votosLocales, votosLocales + numCandidatos);
+                #pragma omp atomic
+                votos[numCandidatos] += votosLocales[numCandidatos];
+            }
+        }
+        cpu = obtenerTiempoAlta() - inicio;
+    }
+    free(votos);
+    liberarMemoriaConteo(buffer, bufferEnArena);
+    liberarAlmacenBoletas(&ventana);
+    cerrarLectorBoletas(&lector);
+    
+    double maximo = disco > cpu ? disco : cpu;
+    printf("  %-28s %10.1f ms %10.0f MB/s\n", "Disco (solo lectura)", disco * 1000, 
+           lector.tamanoArchivo / disco / 1e6);
+    printf("  %-28s %10.1f ms %10.0f MB/s\n", "CPU (empaquetar y contar)", cpu * 1000, 
+           lector.tamanoArchivo / cpu / 1e6);
+    printf("  %-28s %10.1f ms\n", "max(disco, CPU)", maximo * 1000);
+    printf("  %-28s %10.1f ms\n\n", "disco + CPU", (disco + cpu) * 1000);
+    
+    const char *backends[] = {"flujo", "tuberia"};
+    FuenteBoletas fuente = {NULL, ruta};
+    ParametrosConteo parametros = {NULL, numHilos, NULL, 0, NULL, 0};
+    for (int b = 0; b < 2; b++) {
+        double mejor = 0;
+        for (int r = 0; r < 3; r++) {
+            ResultadoConteo resultado;
+            vaciarCacheArchivo(ruta);
+            if (contarVotos(backends[b], &fuente, &parametros, &resultado) != 0) {
+                return;
+            }
+            if (r == 0 || resultado.segundos < mejor) {
+                mejor = resultado.segundos;
+            }
+            liberarResultado(&resultado);
+        }
+        printf("  %-28s %10.1f ms %10.0f MB/s  %.2fx el maximo\n", backends[b], mejor * 1000,
+               lector.tamanoArchivo / mejor / 1e6, mejor / maximo);
+    }
+}
+
+// Cada hilo toma chunks del contenedor, los lee con su propio buffer, comprueba el
+// CRC y los desempaqueta en su ventana (del tamano de un chunk, cabe en cache) y los
+// cuenta enseguida. La hoja de auditoria se calcula sobre el mismo buffer ya leido y
+// verificado. Un chunk danado no se cuenta ni se marca.
+long long contarContenedorParalelo(ContenedorBoletas *contenedor, const NivelSimd *nivel, 
+                                   long long *votosPorCandidato, long long *votosNulos, 
+                                   int numHilos, unsigned char *chunksContados,
+                                   ArbolAuditoria *arbol) {
+    int numCandidatos = (int)contenedor->cabecera.numCandidatos;
+    long long numChunks = (long long)contenedor->cabecera.numChunks;
+    long long danados = 0;
+    
+    ContadoresHilos contadores;
+    if (crearContadoresHilos(&contadores, numHilos, numCandidatos) != 0) {
+        return numChunks;
+    }
+    
+    #pragma omp parallel num_threads(numHilos) reduction(+:danados)
+    {
+        long long *votosLocales = filaContadores(&contadores);
+        long long *nulosLocales = votosLocales + numCandidatos;
+        AlmacenBoletas ventana;
+        uint8_t *datos = (uint8_t *)malloc(contenedor->bytesChunkMax);
+        int listo = datos != NULL && 
+                    crearAlmacenBoletas(&ventana, contenedor->cabecera.boletasPorChunk, numCandidatos, 0) == 0;
+        
+        #pragma omp for schedule(dynamic)
+        for (long long c = 0; c < numChunks; c++) {
+            if (chunksContados != NULL && chunksContados[c]) {
+                continue;
+            }
+            if (!listo || leerChunk(contenedor, c, datos) != 0) {
+                danados++;
+                continue;
+            }
+            decodificarChunk(contenedor, c, datos, &ventana);
+            nivel->funcion(&ventana, 0, ventana.numBoletas, votosLocales, nulosLocales);
+            if (arbol != NULL) {
+                calcularHojaChunk(datos, contenedor->indice[c].bytes, arbol->hojas[c]);
+            }
+            if (chunksContados != NULL) {
+                chunksContados[c] = 1;
+            }
+        }
+        
+        combinarContadoresHilos(&contadores);
+        if (listo) {
+            liberarAlmacenBoletas(&ventana);
+        }
+        free(datos);
+    }
+    
+    for (int i = 0; i < numCandidatos; i++) {
+        votosPorCandidato[i] += contadores.filas[i];
+    }
+    *votosNulos += contadores.filas[numCandidatos];
+    liberarContadoresHilos(&contadores);
+    return danados;
+}
+
+// Modo fusionado: cada hilo genera un bloque de boletas que cabe en cache y lo cuenta
+// enseguida. La matriz completa nunca existe, asi que el total no depende de la memoria.
+// Con registro, el trabajo se reparte por tramos: los que ya estan en el registro se
+// saltan y cada tramo nuevo se registra al terminarlo.
+int generarYContarFusionado(long long numBoletas, int numCandidatos, uint64_t semilla, 
+                            const NivelSimd *nivel, long long *votosPorCandidato, 
+                            long long *votosNulos, int numHilos, RegistroControl *registro) {
+    for (int i = 0; i < numCandidatos; i++) {
+        votosPorCandidato[i] = 0;
+    }
+    *votosNulos = 0;
+    
+    ContadoresHilos contadores;
+    if (crearContadoresHilos(&contadores, numHilos, numCandidatos) != 0) {
+        return -1;
+    }
+    
+    int errorReserva = 0;
+    long long numBloques = (numBoletas + BOLETAS_POR_BLOQUE - 1) / BOLETAS_POR_BLOQUE;
+    long long numTramos = registro != NULL ? registro->numTramos : 0;
+    long long bloquesPorTramo = BOLETAS_POR_TRAMO / BOLETAS_POR_BLOQUE;
+    
+    #pragma omp parallel num_threads(numHilos)
+    {
+        long long *votosLocales = filaContadores(&contadores);
+        long long *nulosLocales = votosLocales + numCandidatos;
+        long long conteoTramo[MAX_CANDIDATOS + 1];
+        AlmacenBoletas bloque;
+        int reservado = crearAlmacenBoletas(&bloque, BOLETAS_POR_BLOQUE, numCandidatos, 0) == 0;
+        if (!reservado) {
+            #pragma omp atomic write
+            errorReserva = 1;
+        }
+        
+        if (registro == NULL) {
+            #pragma omp for schedule(static) nowait
+            for (long long b = 0; b < numBloques; b++) {
+                if (!reservado) {
+                    continue;
+                }
+                long long inicio = b * BOLETAS_POR_BLOQUE;
+                int n = numBoletas - inicio < BOLETAS_POR_BLOQUE ? (int)(numBoletas - inicio) : BOLETAS_POR_BLOQUE;
+                for (int i = 0; i < n; i++) {
+                    escribirBoletaGenerada(&bloque, i, semilla, (uint64_t)(inicio + i));
+                }
+                nivel->funcion(&bloque, 0, n, votosLocales, nulosLocales);
+            }
+        } else {
+            // Dinamico: tras reanudar, los tramos que faltan pueden estar en cualquier parte
+            #pragma omp for schedule(dynamic) nowait
+            for (long long t = 0; t < numTramos; t++) {
+                if (!reservado || registro->tramosContados[t]) {
+                    continue;
+                }
+                memset(conteoTramo, 0, (numCandidatos + 1) * sizeof(long long));
+                long long ultimo = (t + 1) * bloquesPorTramo < numBloques ? (t + 1) * bloquesPorTramo : numBloques;
+                for (long long b = t * bloquesPorTramo; b < ultimo; b++) {
+                    long long inicio = b * BOLETAS_POR_BLOQUE;
+                    int n = numBoletas - inicio < BOLETAS_POR_BLOQUE ? (int)(numBoletas - inicio) : BOLETAS_POR_BLOQUE;
+                    for (int i = 0; i < n; i++) {
+                        escribirBoletaGenerada(&bloque, i, semilla, (uint64_t)(inicio + i));
+                    }
+                    nivel->funcion(&bloque, 0, n, conteoTramo, conteoTramo + numCandidatos);
+                }
+                registrarTramo(registro, t, conteoTramo);
+                for (int i = 0; i <= numCandidatos; i++) {
+                    votosLocales[i] += conteoTramo[i];
+                }
+            }
+        }
+        
+        if (reservado) {
+            liberarAlmacenBoletas(&bloque);
+        }
+        
+        combinarContadoresHilos(&contadores);
+    }
+    
+    if (errorReserva) {
+        printf("Error: Algun hilo no pudo reservar su bloque; el conteo esta incompleto\n");
+    }
+    copiarTotales(&contadores, votosPorCandidato, votosNulos);
+    liberarContadoresHilos(&contadores);
+    
+    // Los tramos que ya estaban en el registro
+    if (registro != NULL) {
+        for (int i = 0; i < numCandidatos; i++) {
+            votosPorCandidato[i] += registro->votosReanudados[i];
+        }
+        *votosNulos += registro->votosReanudados[numCandidatos];
+    }
+    return errorReserva ? -1 : 0;
+}
+
+// Nodo en el que el kernel puso cada pagina (-1 si no se puede saber)
+static void nodosDePaginas(void **paginas, int *nodos, long numPaginas) {
+    for (long p = 0; p < numPaginas; p++) {
+        nodos[p] = -1;
+    }
+    #if defined(__linux__) && defined(SYS_move_pages)
+        syscall(SYS_move_pages, 0, numPaginas, paginas, NULL, nodos, 0);
+    #else
+        (void)paginas;
+    #endif
+}
+
+// Rendimiento por nodo NUMA: cada nodo cuenta a la velocidad de su hilo mas lento.
+// Tambien muestrea las paginas de cada hilo para ver si estan en su propio nodo.
+void mostrarInformeNuma(const AlmacenBoletas *almacen, const TiempoHilo *tiempos, int numHilos) {
+    const char *enlace = getenv("OMP_PROC_BIND");
+    const char *lugares = getenv("OMP_PLACES");
+    printf("\n--- Informe NUMA (OMP_PROC_BIND=%s, OMP_PLACES=%s) ---\n", 
+           enlace ? enlace : "-", lugares ? lugares : "-");
+    
+    int maxNodo = 0;
+    for (int h = 0; h < numHilos; h++) {
+        if (tiempos[h].nodo > maxNodo) maxNodo = tiempos[h].nodo;
+    }
+    
+    long tamanoPagina = 4096;
+    #ifndef _WIN32
+        tamanoPagina = sysconf(_SC_PAGESIZE);
+    #endif
+    int muestrasPorHilo = 256;
+    void **paginas = (void **)malloc(muestrasPorHilo * sizeof(void *));
+    int *nodos = (int *)malloc(muestrasPorHilo * sizeof(int));
+    
+    printf("  %5s %6s %14s %12s %18s %10s %16s\n", "Nodo", "Hilos", "Boletas", "Tiempo (ms)", 
+           "Boletas/segundo", "GB/s", "Paginas locales");
+    for (int n = 0; n <= maxNodo; n++) {
+        int hilosNodo = 0;
+        long long boletasNodo = 0;
+        double peorTiempo = 0;
+        long muestras = 0, locales = 0;
+        
+        for (int h = 0; h < numHilos; h++) {
+            const TiempoHilo *t = &tiempos[h];
+            if (t->nodo != n) {
+                continue;
+            }
+            hilosNodo++;
+            boletasNodo += t->boletas;
+            if (t->segundos > peorTiempo) peorTiempo = t->segundos;
+            if (t->boletas == 0) {
+                continue;
+            }
+            
+            char *desde = almacen->datos + (size_t)t->primera * almacen->paso;
+            size_t bytes = (size_t)t->boletas * almacen->paso;
+            long numPaginas = (long)(bytes / tamanoPagina) + 1;
+            long salto = numPaginas > muestrasPorHilo ? numPaginas / muestrasPorHilo : 1;
+            long k = 0;
+            for (long p = 0; p < numPaginas && k < muestrasPorHilo; p += salto) {
+                paginas[k++] = (void *)((uintptr_t)(desde + p * tamanoPagina) & ~(uintptr_t)(tamanoPagina - 1));
+            }
+            nodosDePaginas(paginas, nodos, k);
+            for (long p = 0; p < k; p++) {
+                if (nodos[p] < 0) continue;
+                muestras++;
+                if (nodos[p] == n) locales++;
+            }
+        }
+        if (hilosNodo == 0) {
+            continue;
+        }
+        
+        char textoLocales[32];
+        if (muestras > 0) {
+            snprintf(textoLocales, sizeof(textoLocales), "%.1f%%", 100.0 * locales / muestras);
+        } else {
+            snprintf(textoLocales, sizeof(textoLocales), "desconocido");
+        }
+        double tasa = peorTiempo > 0 ? boletasNodo / peorTiempo : 0;
+        printf("  %5d %6d %14lld %12.3f %18.0f %10.2f %16s\n", n, hilosNodo, boletasNodo, 
+               peorTiempo * 1000, tasa, tasa * almacen->paso / 1e9, textoLocales);
+    }
+    
+    printf("  Hilo -> cpu/nodo:");
+    for (int h = 0; h < numHilos; h++) {
+        printf(" %d->%d/%d", h, tiempos[h].cpu, tiempos[h].nodo);
+    }
+    printf("\n");
+    
+    free(paginas);
+    free(nodos);
+}
+
+// OMP_PROC_BIND y OMP_PLACES solo se leen al arrancar el runtime de OpenMP, asi que
+// el modo NUMA se vuelve a ejecutar a si mismo con los hilos fijados a nucleos
+// repartidos entre los nodos. Si el usuario ya eligio una afinidad se respeta.
+void fijarAfinidadNuma(char *argv[]) {
+    #ifdef __linux__
+        if (getenv("OMP_PROC_BIND") != NULL) {
+            return;
+        }
+        setenv("OMP_PROC_BIND", "spread", 1);
+        if (getenv("OMP_PLACES") == NULL) {
+            setenv("OMP_PLACES", "cores", 1);
+        }
+        fflush(stdout);
+        execv("/proc/self/exe", argv);
+        printf("Aviso: No se pudo fijar la afinidad de los hilos; se sigue sin ella\n");
+    #else
+        (void)argv;
+    #endif
+}
+
+
+void contarVotosSecuencial(const AlmacenBoletas *almacen, const NivelSimd *nivel, 
+                           long long *votosPorCandidato, long long *votosNulos) {
+    int numCandidatos = almacen->numCandidatos;
+
+    for (int i = 0; i < numCandidatos; i++) {
+        votosPorCandidato[i] = 0;
+    }
+    *votosNulos = 0;
+    
+    nivel->funcion(almacen, 0, almacen->numBoletas, votosPorCandidato, votosNulos);
+}
+
+// ---------------------------------------------------------------------------
+// Backends de la API de conteo
+// ---------------------------------------------------------------------------
+
+static void anotarFormato(const AlmacenBoletas *almacen, ResultadoConteo *resultado) {
+    resultado->bytesBoletas = almacen->bytesReservados;
+    resultado->enHugePages = almacen->enHugePages;
+    resultado->anchoBits = almacen->anchoBits;
+    resultado->palabras = almacen->palabras;
+}
+
+static int exigirAlmacen(const FuenteBoletas *fuente, const char *backend) {
+    if (fuente->almacen == NULL) {
+        printf("Error: El backend '%s' cuenta boletas en memoria; para archivos use 'flujo'\n", backend);
+        return -1;
+    }
+    return 0;
+}
+
+static int contarConKernel(const FuenteBoletas *fuente, const char *isa, const char *backend, 
+                           ResultadoConteo *resultado) {
+    if (exigirAlmacen(fuente, backend) != 0) {
+        return -1;
+    }
+    const NivelSimd *nivel = elegirNivelSimd(fuente->almacen, isa);
+    contarVotosSecuencial(fuente->almacen, nivel, resultado->votosPorCandidato, &resultado->votosNulos);
+    resultado->kernel = nivel->nombre;
+    resultado->numHilos = 1;
+    anotarFormato(fuente->almacen, resultado);
+    return 0;
+}
+
+// Un hilo con el kernel escalar: la referencia con la que se comparan los demas
+static int contarBackendSecuencial(const FuenteBoletas *fuente, const ParametrosConteo *parametros, 
+                                   ResultadoConteo *resultado) {
+    (void)parametros;
+    return contarConKernel(fuente, "escalar", "secuencial", resultado);
+}
+
+// Un hilo con el mejor kernel vectorial de la CPU (o el pedido en isa)
+static int contarBackendSimd(const FuenteBoletas *fuente, const ParametrosConteo *parametros, 
+                             ResultadoConteo *resultado) {
+    return contarConKernel(fuente, parametros->isa, "simd", resultado);
+}
+
+static int contarBackendOpenmp(const FuenteBoletas *fuente, const ParametrosConteo *parametros, 
+                               ResultadoConteo *resultado) {
+    if (exigirAlmacen(fuente, "openmp") != 0) {
+        return -1;
+    }
+    ConfiguracionConteo config;
+    if (parametros->configuracion != NULL) {
+        config = *parametros->configuracion;
+    } else {
+        configuracionPorDefecto(&config, parametros->numHilos > 0 ? parametros->numHilos 
+                                                                 : omp_get_max_threads());
+    }
+    aplicarConfiguracion(&config);
+    
+    const NivelSimd *nivel = elegirNivelSimd(fuente->almacen, parametros->isa);
+    int error;
+    if (parametros->auditoria != NULL) {
+        error = contarVotosAuditado(fuente->almacen, nivel, resultado->votosPorCandidato, 
+                                    &resultado->votosNulos, config.numHilos, parametros->auditoria);
+    } else {
+        error = contarVotosParalelo(fuente->almacen, nivel, resultado->votosPorCandidato, 
+                                    &resultado->votosNulos, config.numHilos, parametros->tiempos, 
+                                    NULL, NULL);
+    }
+    resultado->kernel = nivel->nombre;
+    resultado->numHilos = config.numHilos;
+    anotarFormato(fuente->almacen, resultado);
+    return error;
+}
+
+// Archivo de ancho fijo leido por ventanas; con numHilos 1 no abre mas hilos
+static int contarBackendFlujo(const FuenteBoletas *fuente, const ParametrosConteo *parametros, 
+                              ResultadoConteo *resultado) {
+    LectorBoletas lector;
+    if (fuente->rutaArchivo == NULL) {
+        printf("Error: El backend 'flujo' necesita un archivo de boletas\n");
+        return -1;
+    }
+    if (esArchivoContenedor(fuente->rutaArchivo)) {
+        printf("Error: '%s' es un contenedor binario; use el backend 'contenedor'\n", fuente->rutaArchivo);
+        return -1;
+    }
+    if (abrirLectorBoletas(&lector, fuente->rutaArchivo) != 0) {
+        return -1;
+    }
+    if (lector.numBoletas > MAX_BOLETAS || lector.numCandidatos != resultado->numCandidatos) {
+        printf("Error: El archivo tiene %lld boletas de %d candidatos (maximo %lld boletas)\n", 
+               lector.numBoletas, lector.numCandidatos, MAX_BOLETAS);
+        cerrarLectorBoletas(&lector);
+        return -1;
+    }
+    
+    AlmacenBoletas ventana;
+    if (crearAlmacenBoletas(&ventana, lector.boletasPorVentana, lector.numCandidatos, 
+                            parametros->usarHugePages) != 0) {
+        printf("Error: No se pudo reservar memoria para la ventana de boletas\n");
+        cerrarLectorBoletas(&lector);
+        return -1;
+    }
+    
+    int numHilos = parametros->numHilos > 0 ? parametros->numHilos : omp_get_max_threads();
+    const NivelSimd *nivel = elegirNivelSimd(&ventana, parametros->isa);
+    int error = contarArchivoParalelo(&lector, &ventana, nivel, resultado->votosPorCandidato, 
+                                      &resultado->votosNulos, numHilos);
+    resultado->kernel = nivel->nombre;
+    resultado->numHilos = numHilos;
+    resultado->bytesLeidos = lector.tamanoArchivo;
+    anotarFormato(&ventana, resultado);
+    
+    liberarAlmacenBoletas(&ventana);
+    cerrarLectorBoletas(&lector);
+    return error;
+}
+
+// Archivo de ancho fijo con lectura, empaquetado y conteo solapados
+static int contarBackendTuberia(const FuenteBoletas *fuente, const ParametrosConteo *parametros, 
+                                ResultadoConteo *resultado) {
+    LectorBoletas lector;
+    if (fuente->rutaArchivo == NULL) {
+        printf("Error: El backend 'tuberia' necesita un archivo de boletas\n");
+        return -1;
+    }
+    if (esArchivoContenedor(fuente->rutaArchivo)) {
+        printf("Error: '%s' es un contenedor binario; use el backend 'contenedor'\n", fuente->rutaArchivo);
+        return -1;
+    }
+    if (abrirLectorBoletas(&lector, fuente->rutaArchivo) != 0) {
+        return -1;
+    }
+    if (lector.numCandidatos != resultado->numCandidatos) {
+        cerrarLectorBoletas(&lector);
+        return -1;
+    }
+    
+    AlmacenBoletas muestra;
+    if (crearAlmacenBoletas(&muestra, 1, lector.numCandidatos, 0) != 0) {
+        cerrarLectorBoletas(&lector);
+        return -1;
+    }
+    int numHilos = parametros->numHilos > 0 ? parametros->numHilos : omp_get_max_threads();
+    const NivelSimd *nivel = elegirNivelSimd(&muestra, parametros->isa);
+    int estado = contarArchivoTuberia(&lector, nivel, resultado->votosPorCandidato, &resultado->votosNulos, 
+                                      numHilos, parametros->usarHugePages);
+    resultado->kernel = nivel->nombre;
+    resultado->numHilos = numHilos;
+    resultado->bytesLeidos = lector.tamanoArchivo;
+    anotarFormato(&muestra, resultado);
+    resultado->bytesBoletas = RANURAS_TUBERIA * (BYTES_POR_RANURA / lector.pasoTexto) * muestra.paso;
+    
+    liberarAlmacenBoletas(&muestra);
+    cerrarLectorBoletas(&lector);
+    return estado;
+}
+
+// Contenedor binario: chunks leidos en paralelo, verificados y contados en una pasada
+static int contarBackendContenedor(const FuenteBoletas *fuente, const ParametrosConteo *parametros, 
+                                   ResultadoConteo *resultado) {
+    ContenedorBoletas contenedor;
+    if (fuente->rutaArchivo == NULL) {
+        printf("Error: El backend 'contenedor' necesita un archivo de boletas\n");
+        return -1;
+    }
+    if (abrirContenedor(&contenedor, fuente->rutaArchivo) != 0) {
+        return -1;
+    }
+    
+    AlmacenBoletas muestra;
+    if (crearAlmacenBoletas(&muestra, 1, resultado->numCandidatos, 0) != 0) {
+        cerrarContenedor(&contenedor);
+        return -1;
+    }
+    ArbolAuditoria *arbol = parametros->auditoria;
+    if (arbol != NULL && (arbol->numHojas != (long long)contenedor.cabecera.numChunks ||
+                          arbol->boletasPorHoja != contenedor.cabecera.boletasPorChunk)) {
+        printf("Error: El arbol de auditoria no corresponde a los chunks de '%s'\n", fuente->rutaArchivo);
+        liberarAlmacenBoletas(&muestra);
+        cerrarContenedor(&contenedor);
+        return -1;
+    }
+    int numHilos = parametros->numHilos > 0 ? parametros->numHilos : omp_get_max_threads();
+    const NivelSimd *nivel = elegirNivelSimd(&muestra, parametros->isa);
+    long long danados = contarContenedorParalelo(&contenedor, nivel, resultado->votosPorCandidato, 
+                                                 &resultado->votosNulos, numHilos, NULL, arbol);
+    if (arbol != NULL && danados == 0) {
+        calcularRaizAuditoria(arbol, numHilos);
+    }
+    resultado->kernel = nivel->nombre;
+    resultado->numHilos = numHilos;
+    resultado->bytesLeidos = contenedor.tamanoArchivo;
+    anotarFormato(&muestra, resultado);
+    resultado->bytesBoletas = (size_t)contenedor.cabecera.boletasPorChunk * muestra.paso;
+    
+    liberarAlmacenBoletas(&muestra);
+    cerrarContenedor(&contenedor);
+    if (danados > 0) {
+        printf("Error: %lld chunks de '%s' no pasaron la verificacion CRC\n", danados, fuente->rutaArchivo);
+        return -1;
+    }
+    return 0;
+}
+
+#define MAX_BACKENDS 16
+
+static BackendConteo backends[MAX_BACKENDS] = {
+    {"secuencial", "un hilo, kernel escalar", 0, contarBackendSecuencial},
+    {"simd", "un hilo, mejor kernel vectorial", 0, contarBackendSimd},
+    {"openmp", "varios hilos con OpenMP, mejor kernel vectorial", 1, contarBackendOpenmp},
+    {"flujo", "archivo de ancho fijo leido por ventanas", 1, contarBackendFlujo},
+    {"contenedor", "contenedor binario con chunks verificados por CRC", 1, contarBackendContenedor},
+    {"fragmentos", "contenedor repartido entre procesos trabajadores", 1, contarBackendFragmentos},
+    {"tuberia", "archivo de ancho fijo con lectura y conteo solapados", 1, contarBackendTuberia},
+};
+static int numBackends = 7;
+
+int registrarBackend(const BackendConteo *backend) {
+    for (int b = 0; b < numBackends; b++) {
+        if (strcmp(backends[b].nombre, backend->nombre) == 0) {
+            backends[b] = *backend;
+            return 0;
+        }
+    }
+    if (numBackends == MAX_BACKENDS) {
+        printf("Error: No caben mas backends (maximo %d)\n", MAX_BACKENDS);
+        return -1;
+    }
+    backends[numBackends++] = *backend;
+    return 0;
+}
+
+const BackendConteo *buscarBackend(const char *nombre) {
+    for (int b = 0; b < numBackends; b++) {
+        if (strcmp(backends[b].nombre, nombre) == 0) {
+            return &backends[b];
+        }
+    }
+    return NULL;
+}
+
+void mostrarBackends(void) {
+    printf("Backends disponibles:\n");
+    for (int b = 0; b < numBackends; b++) {
+        printf("  %-12s %s\n", backends[b].nombre, backends[b].descripcion);
+    }
+}
+
+// El numero de candidatos sale del almacen, de la cabecera del contenedor o de la
+// primera linea del archivo
+static int candidatosDeFuente(const FuenteBoletas *fuente) {
+    if (fuente->almacen != NULL) {
+        return fuente->almacen->numCandidatos;
+    }
+    if (fuente->rutaArchivo == NULL) {
+        return 0;
+    }
+    if (esArchivoContenedor(fuente->rutaArchivo)) {
+        ContenedorBoletas contenedor;
+        if (abrirContenedor(&contenedor, fuente->rutaArchivo) != 0) {
+            return 0;
+        }
+        int numCandidatos = (int)contenedor.cabecera.numCandidatos;
+        cerrarContenedor(&contenedor);
+        return numCandidatos;
+    }
+    LectorBoletas lector;
+    if (abrirLectorBoletas(&lector, fuente->rutaArchivo) != 0) {
+        return 0;
+    }
+    int numCandidatos = lector.numCandidatos;
+    cerrarLectorBoletas(&lector);
+    return numCandidatos;
+}
+
+int contarVotos(const char *nombreBackend, const FuenteBoletas *fuente, 
+                const ParametrosConteo *parametros, ResultadoConteo *resultado) {
+    memset(resultado, 0, sizeof(*resultado));
+    
+    const BackendConteo *backend = buscarBackend(nombreBackend);
+    if (backend == NULL) {
+        printf("Error: Backend de conteo desconocido '%s'\n", nombreBackend);
+        mostrarBackends();
+        return -1;
+    }
+    
+    ParametrosConteo porDefecto;
+    if (parametros == NULL) {
+        memset(&porDefecto, 0, sizeof(porDefecto));
+        parametros = &porDefecto;
+    }
+    // Las hojas de bloques en memoria las calcula openmp; las de chunks, contenedor
+    if (parametros->auditoria != NULL) {
+        int deChunks = parametros->auditoria->hojasDeChunks;
+        if (backend->contar != (deChunks ? contarBackendContenedor : contarBackendOpenmp)) {
+            printf("Error: La auditoria %s se calcula con el backend %s, no con '%s'\n",
+                   deChunks ? "de un contenedor" : "en memoria", deChunks ? "contenedor" : "openmp",
+                   nombreBackend);
+            return -1;
+        }
+    }
+    
+    int numCandidatos = candidatosDeFuente(fuente);
+    if (numCandidatos <= 0 || numCandidatos > MAX_CANDIDATOS) {
+        return -1;
+    }
+    resultado->votosPorCandidato = (long long *)calloc(numCandidatos, sizeof(long long));
+    if (resultado->votosPorCandidato == NULL) {
+        printf("Error: No se pudo reservar memoria para el resultado\n");
+        return -1;
+    }
+    resultado->backend = backend;
+    resultado->numCandidatos = numCandidatos;
+    
+    double inicio = obtenerTiempoAlta();
+    if (backend->contar(fuente, parametros, resultado) != 0) {
+        liberarResultado(resultado);
+        return -1;
+    }
+    resultado->segundos = obtenerTiempoAlta() - inicio;
+    
+    resultado->numBoletas = resultado->votosNulos;
+    for (int i = 0; i < numCandidatos; i++) {
+        resultado->numBoletas += resultado->votosPorCandidato[i];
+    }
+    return 0;
+}
+
+void liberarResultado(ResultadoConteo *resultado) {
+    free(resultado->votosPorCandidato);
+    resultado->votosPorCandidato = NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Presentacion de resultados
+// ---------------------------------------------------------------------------
+
+void mostrarResultados(const char *titulo, const ResultadoConteo *resultado) {
+    empezarFase(FASE_SALIDA);
+    printf("\n========================================\n");
+    printf("%s\n", titulo);
+    printf("========================================\n\n");
+    
+    long long totalVotosValidos = 0;
+    
+    for (int i = 0; i < resultado->numCandidatos; i++) {
+        printf("  Candidato %2d: %7lld votos\n", i + 1, resultado->votosPorCandidato[i]);
+        totalVotosValidos += resultado->votosPorCandidato[i];
+    }
+    
+    printf("\n----------------------------------------\n");
+    printf("  Votos validos:  %7lld\n", totalVotosValidos);
+    printf("  Votos nulos:    %7lld\n", resultado->votosNulos);
+    printf("  Total boletas:  %7lld\n", totalVotosValidos + resultado->votosNulos);
+    printf("----------------------------------------\n");
+    printf("\n  Tiempo de ejecucion: %.6f segundos\n", resultado->segundos);
+    printf("  Tiempo en milisegundos: %.3f ms\n", resultado->segundos * 1000);
+    printf("  Boletas por segundo: %.0f\n", resultado->numBoletas / resultado->segundos);
+    if (resultado->backend->paralelo) {
+        printf("  Numero de hilos utilizados: %d\n", resultado->numHilos);
+    }
+    printf("========================================\n");
+    terminarFase(FASE_SALIDA);
+}
+
+// Devuelve 0 solo si el archivo quedo escrito y sincronizado con el disco
+int guardarResultados(const char *ruta, const char *titulo, const ResultadoConteo *resultado) {
+    empezarFase(FASE_SALIDA);
+    FILE *archivo = fopen(ruta, "w");
+    if (archivo == NULL) {
+        printf("Error al crear archivo de resultados\n");
+        terminarFase(FASE_SALIDA);
+        return -1;
+    }
+    
+    fprintf(archivo, "%s\n", titulo);
+    for (size_t i = 0; i < strlen(titulo); i++) {
+        fputc('=', archivo);
+    }
+    fprintf(archivo, "\n\n");
+    fprintf(archivo, "Configuracion:\n");
+    fprintf(archivo, "- Numero de boletas: %lld\n", resultado->numBoletas);
+    fprintf(archivo, "- Numero de candidatos: %d\n", resultado->numCandidatos);
+    if (resultado->backend->paralelo) {
+        fprintf(archivo, "- Numero de hilos: %d\n", resultado->numHilos);
+    }
+    fprintf(archivo, "- Memoria de boletas: %zu bytes%s\n", resultado->bytesBoletas, 
+            resultado->enHugePages ? " (huge pages)" : "");
+    fprintf(archivo, "- Formato: %d x mascara de %d bits por boleta\n", resultado->palabras, 
+            resultado->anchoBits);
+    fprintf(archivo, "- Backend: %s\n", resultado->backend->nombre);
+    fprintf(archivo, "- Kernel de conteo: %s\n\n", resultado->kernel);
+    
+    fprintf(archivo, "Resultados por candidato:\n");
+    long long totalValidos = 0;
+    for (int i = 0; i < resultado->numCandidatos; i++) {
+        fprintf(archivo, "Candidato %d: %lld votos\n", i + 1, resultado->votosPorCandidato[i]);
+        totalValidos += resultado->votosPorCandidato[i];
+    }
+    
+    fprintf(archivo, "\nResumen:\n");
+    fprintf(archivo, "- Votos validos: %lld\n", totalValidos);
+    fprintf(archivo, "- Votos nulos: %lld\n", resultado->votosNulos);
+    fprintf(archivo, "- Total procesado: %lld\n", totalValidos + resultado->votosNulos);
+    fprintf(archivo, "\nTiempo de ejecucion: %.6f segundos\n", resultado->segundos);
+    fprintf(archivo, "Tiempo en milisegundos: %.3f ms\n", resultado->segundos * 1000);
+    fprintf(archivo, "Boletas por segundo: %.0f\n", resultado->numBoletas / resultado->segundos);
+    
+    int error = fflush(archivo) != 0 || ferror(archivo);
+    #ifdef _WIN32
+        error = error || _commit(_fileno(archivo)) != 0;
+    #else
+        error = error || fsync(fileno(archivo)) != 0;
+    #endif
+    error = fclose(archivo) != 0 || error;
+    terminarFase(FASE_SALIDA);
+    if (error) {
+        printf("Error: No se pudo escribir el archivo de resultados '%s'\n", ruta);
+        return -1;
+    }
+    printf("\nResultados guardados en '%s'\n", ruta);
+    return 0;
+}
+
+// Rendimiento del conteo segun el numero de candidatos (y por tanto el ancho de boleta)
+void ejecutarBenchmarkCandidatos(const char *nombreBackend, const ParametrosConteo *parametros, 
+                                 uint64_t semilla) {
+    int candidatos[] = {2, 4, 8, 10, 16, 24, 32, 48, 64, 100, 128, 256, 512, 1024};
+    int numPruebas = (int)(sizeof(candidatos) / sizeof(candidatos[0]));
+    long long numBoletas = 2000000;
+    int repeticiones = 3;
+    
+    printf("\n=== BENCHMARK POR NUMERO DE CANDIDATOS ===\n");
+    printf("Boletas: %lld, backend %s, mejor de %d repeticiones\n\n", numBoletas, nombreBackend, 
+           repeticiones);
+    printf("  %10s %14s %10s %6s %14s %18s %10s\n", "Candidatos", "Bytes/boleta", "Kernel", 
+           "Hilos", "Tiempo (ms)", "Boletas/segundo", "GB/s");
+    
+    for (int p = 0; p < numPruebas; p++) {
+        int numCandidatos = candidatos[p];
+        AlmacenBoletas almacen;
+        if (crearAlmacenBoletas(&almacen, numBoletas, numCandidatos, parametros->usarHugePages) != 0) {
+            printf("  %10d  sin memoria suficiente\n", numCandidatos);
+            continue;
+        }
+        generarBoletasAleatorias(&almacen, semilla, omp_get_max_threads());
+        
+        FuenteBoletas fuente = {&almacen, NULL};
+        ResultadoConteo resultado;
+        double mejor = 0;
+        int numHilos = 0;
+        const char *kernel = "-";
+        ArenaMemoria arena;
+        ArenaMemoria *anterior = arenaActiva();
+        iniciarArena(&arena, parametros->usarHugePages);
+        activarArena(&arena);
+        
+        for (int r = 0; r < repeticiones; r++) {
+            if (contarVotos(nombreBackend, &fuente, parametros, &resultado) != 0) {
+                break;
+            }
+            if (r == 0 || resultado.segundos < mejor) {
+                mejor = resultado.segundos;
+            }
+            numHilos = resultado.numHilos;
+            kernel = resultado.kernel;
+            liberarResultado(&resultado);
+            vaciarArena(&arena);
+        }
+        activarArena(anterior);
+        destruirArena(&arena);
+        
+        if (mejor > 0) {
+            printf("  %10d %14zu %10s %6d %14.3f %18.0f %10.2f\n", numCandidatos, almacen.paso, 
+                   kernel, numHilos, mejor * 1000, numBoletas / mejor, 
+                   (double)almacen.paso * numBoletas / mejor / 1e9);
+        }
+        liberarAlmacenBoletas(&almacen);
+    }
+}
@@ -0,0 +1,856 @@
+// libvotos: almacen de boletas empaquetadas, kernels de conteo y una API de conteo
+// unica con backends intercambiables (secuencial, simd, openmp, flujo).
+// La usan conteo_secuencial y conteo_paralelo, y se puede enlazar desde otro
+// programa (libvotos.a o libvotos.so) para contar sin lanzar el ejecutable.
+#ifndef VOTOS_H
+#define VOTOS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <omp.h>
+
+#define MAX_CANDIDATOS 1024
+#define MAX_BOLETAS 1000000000000LL
+
+#define ALINEACION_BOLETAS 64
+#define TAMANO_HUGE_PAGE (2UL * 1024 * 1024)
+#define SEMILLA_PRUEBA 20240601ULL
+#define BOLETAS_POR_BLOQUE 16384
+#define ARCHIVO_PERFIL "perfil_conteo.txt"
+
+// Boletas seguidas con la misma clave de region (ver CLAVE_REGION), por ejemplo una
+// urna: el tramo va de inicio hasta el inicio del siguiente o el final del almacen
+typedef struct {
+    long long inicio;
+    uint32_t clave;
+} TramoRegion;
+
+// Cada boleta es una mascara de bits (bit j = marca en el candidato j) de 16, 32 o 64 bits.
+// Con mas de 64 candidatos cada boleta ocupa varias palabras de 64 bits.
+typedef struct {
+    char *datos;
+    long long numBoletas;
+    int numCandidatos;
+    int anchoBits;
+    int palabras;
+    size_t paso;
+    size_t bytesReservados;
+    int enHugePages;
+    int reservadoConMmap;
+    // Los datos son de la arena activa: liberarAlmacenBoletas no los devuelve
+    int enArena;
+    // Claves de region por tramos ordenados, el primero en la boleta 0; NULL si no se reservaron
+    TramoRegion *regiones;
+    long long numTramos;
+} AlmacenBoletas;
+
+typedef void (*KernelConteo)(const AlmacenBoletas *almacen, long long inicio, long long fin,
+                             long long *votosPorCandidato, long long *votosNulos);
+
+// Kernel por region: suma en fila (candidatos, blancos y marcas multiples) las boletas
+// de [inicio, fin) en una sola pasada
+typedef void (*KernelRegion)(const AlmacenBoletas *almacen, long long inicio, long long fin,
+                             long long *fila);
+
+typedef struct {
+    const char *nombre;
+    KernelConteo funcion;
+    KernelRegion porRegion;
+    int disponible;
+} NivelSimd;
+
+// Configuracion del bucle de conteo: hilos y planificacion OpenMP (el bloque es el
+// chunk en bloques de BOLETAS_POR_BLOQUE boletas; 0 = reparto por defecto)
+typedef struct {
+    int numHilos;
+    omp_sched_t planificacion;
+    int bloque;
+    double boletasPorSegundo;
+} ConfiguracionConteo;
+
+// Donde corrio cada hilo y cuanto conto, para el informe por nodo NUMA
+typedef struct {
+    int cpu;
+    int nodo;
+    long long primera;
+    long long boletas;
+    double segundos;
+} TiempoHilo;
+
+// Lectura por ventanas de un archivo de boletas de ancho fijo: una linea por boleta,
+// un caracter por candidato (' ' o 'X'/'x'). La memoria usada no depende del tamano.
+#define BYTES_POR_VENTANA (64UL * 1024 * 1024)
+
+typedef struct {
+    int numCandidatos;
+    size_t pasoTexto;
+    long long numBoletas;
+    long long tamanoArchivo;
+    long long siguiente;
+    int boletasPorVentana;
+    #ifdef _WIN32
+        FILE *archivo;
+        char *buffer;
+    #else
+        int descriptor;
+        char *mapa;
+        size_t bytesMapa;
+    #endif
+} LectorBoletas;
+
+// splitmix64: base de los generadores basados en contador
+static inline uint64_t mezclarBits(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Lleva x (32 bits uniformes) a [0, n) sin division
+static inline int reducirRango(uint32_t x, int n) {
+    return (int)(((uint64_t)x * (uint64_t)n) >> 32);
+}
+
+static inline uint64_t leerMascara(const AlmacenBoletas *almacen, long long i) {
+    switch (almacen->anchoBits) {
+        case 16: return ((const uint16_t *)almacen->datos)[i];
+        case 32: return ((const uint32_t *)almacen->datos)[i];
+        default: return ((const uint64_t *)almacen->datos)[i];
+    }
+}
+
+static inline void escribirMascara(AlmacenBoletas *almacen, long long i, uint64_t mascara) {
+    switch (almacen->anchoBits) {
+        case 16: ((uint16_t *)almacen->datos)[i] = (uint16_t)mascara; break;
+        case 32: ((uint32_t *)almacen->datos)[i] = (uint32_t)mascara; break;
+        default: ((uint64_t *)almacen->datos)[i] = mascara; break;
+    }
+}
+
+static inline uint64_t *palabrasBoleta(const AlmacenBoletas *almacen, long long i) {
+    return (uint64_t *)(almacen->datos + (size_t)i * almacen->paso);
+}
+
+static inline int tieneMarca(const AlmacenBoletas *almacen, long long i, int j) {
+    if (almacen->palabras == 1) {
+        return (int)((leerMascara(almacen, i) >> j) & 1);
+    }
+    return (int)((palabrasBoleta(almacen, i)[j >> 6] >> (j & 63)) & 1);
+}
+
+// ---------------------------------------------------------------------------
+// API de conteo
+// ---------------------------------------------------------------------------
+
+// De donde salen las boletas: un almacen en memoria o un archivo de ancho fijo
+typedef struct {
+    const AlmacenBoletas *almacen;
+    const char *rutaArchivo;
+} FuenteBoletas;
+
+struct ArbolAuditoria;
+
+// Parametros comunes; los backends ignoran los que no usan. Todo a cero da el
+// comportamiento por defecto (mejor kernel, todos los nucleos, planificacion static).
+typedef struct {
+    const char *isa;
+    int numHilos;
+    const ConfiguracionConteo *configuracion;
+    int usarHugePages;
+    TiempoHilo *tiempos;
+    // Procesos trabajadores del backend "fragmentos" (0: uno por procesador, hasta 4)
+    int numProcesos;
+    // Si no es NULL, el backend openmp (o contenedor, con hojas de chunks) calcula el
+    // arbol de Merkle en la misma pasada
+    struct ArbolAuditoria *auditoria;
+} ParametrosConteo;
+
+struct BackendConteo;
+
+typedef struct {
+    const struct BackendConteo *backend;
+    int numCandidatos;
+    long long numBoletas;
+    long long *votosPorCandidato;
+    long long votosNulos;
+    double segundos;
+    const char *kernel;
+    int numHilos;
+    // Formato de las boletas contadas (o de la ventana, si vienen de un archivo)
+    size_t bytesBoletas;
+    int enHugePages;
+    int anchoBits;
+    int palabras;
+    long long bytesLeidos;
+} ResultadoConteo;
+
+// Un backend cuenta una fuente y llena votosPorCandidato (ya reservado para
+// numCandidatos), votosNulos, kernel, numHilos y el formato. Devuelve 0 si pudo.
+typedef int (*FuncionBackend)(const FuenteBoletas *fuente, const ParametrosConteo *parametros,
+                              ResultadoConteo *resultado);
+
+typedef struct BackendConteo {
+    const char *nombre;
+    const char *descripcion;
+    int paralelo;
+    FuncionBackend contar;
+} BackendConteo;
+
+// Backends incluidos: "secuencial", "simd", "openmp", "flujo", "tuberia", "contenedor" y
+// "fragmentos". registrarBackend anade otro (o reemplaza uno con el mismo nombre).
+int registrarBackend(const BackendConteo *backend);
+const BackendConteo *buscarBackend(const char *nombre);
+void mostrarBackends(void);
+
+// Cuenta la fuente con el backend indicado. El resultado reserva memoria que se
+// libera con liberarResultado. Devuelve 0 si pudo contar.
+int contarVotos(const char *nombreBackend, const FuenteBoletas *fuente,
+                const ParametrosConteo *parametros, ResultadoConteo *resultado);
+void liberarResultado(ResultadoConteo *resultado);
+
+void mostrarResultados(const char *titulo, const ResultadoConteo *resultado);
+int guardarResultados(const char *ruta, const char *titulo, const ResultadoConteo *resultado);
+
+// ---------------------------------------------------------------------------
+// Piezas sueltas, para quien necesite mas control que contarVotos
+// ---------------------------------------------------------------------------
+
+// Reloj monotono en segundos: solo sirve para medir intervalos
+double obtenerTiempoAlta(void);
+
+int anchoMascara(int numCandidatos);
+int crearAlmacenBoletas(AlmacenBoletas *almacen, long long numBoletas, int numCandidatos,
+                        int usarHugePages);
+void liberarAlmacenBoletas(AlmacenBoletas *almacen);
+
+void escribirBoletaGenerada(AlmacenBoletas *almacen, long long destino, uint64_t semilla, uint64_t i);
+void generarBoletasAleatorias(AlmacenBoletas *almacen, uint64_t semilla, int numHilos);
+
+// Reparto de boletas del generador: la eleccion normal (70% validas, 15% multiples,
+// 15% en blanco) y casos adversarios para medir la clasificacion
+typedef enum {
+    MEZCLA_ELECCION,
+    MEZCLA_MITAD_NULAS,
+    MEZCLA_UN_CANDIDATO,
+    MEZCLA_MULTIPLES,
+    NUM_MEZCLAS
+} MezclaBoletas;
+
+void generarBoletasMezcla(AlmacenBoletas *almacen, uint64_t semilla, MezclaBoletas mezcla, int numHilos);
+
+void empaquetarRango(AlmacenBoletas *almacen, const char *texto, size_t pasoTexto,
+                     long long inicio, long long fin);
+void empaquetarBoletas(AlmacenBoletas *almacen, const char *texto, size_t pasoTexto);
+void desempaquetarBoletas(const AlmacenBoletas *almacen, char *texto, size_t pasoTexto);
+
+void contarRangoEscalar(const AlmacenBoletas *almacen, long long inicio, long long fin,
+                        long long *votosPorCandidato, long long *votosNulos);
+void detectarNivelesSimd(void);
+const NivelSimd *elegirNivelSimd(const AlmacenBoletas *almacen, const char *isaPedida);
+
+void contarVotosSecuencial(const AlmacenBoletas *almacen, const NivelSimd *nivel,
+                           long long *votosPorCandidato, long long *votosNulos);
+// Trabajo extra sobre cada bloque, llamado por el hilo que lo acaba de contar
+typedef void (*TrabajoBloque)(const AlmacenBoletas *almacen, long long bloque, void *contexto);
+// Las funciones de conteo devuelven 0, o -1 si no pudieron reservar sus contadores
+// (o algun bloque) y los totales no son validos
+int contarVotosParalelo(const AlmacenBoletas *almacen, const NivelSimd *nivel,
+                        long long *votosPorCandidato, long long *votosNulos, int numHilos,
+                        TiempoHilo *tiempos, TrabajoBloque trabajo, void *contexto);
+// registro: puntos de control para reanudar el conteo (ver RegistroControl); NULL = sin ellos
+typedef struct RegistroControl RegistroControl;
+int generarYContarFusionado(long long numBoletas, int numCandidatos, uint64_t semilla,
+                            const NivelSimd *nivel, long long *votosPorCandidato,
+                            long long *votosNulos, int numHilos, RegistroControl *registro);
+
+const char *nombrePlanificacion(omp_sched_t planificacion);
+void configuracionPorDefecto(ConfiguracionConteo *config, int numHilos);
+void aplicarConfiguracion(const ConfiguracionConteo *config);
+void elegirConfiguracion(const AlmacenBoletas *almacen, const NivelSimd *nivel,
+                         int recalibrar, ConfiguracionConteo *config);
+
+int abrirLectorBoletas(LectorBoletas *lector, const char *ruta);
+int leerVentanaBoletas(LectorBoletas *lector, const char **texto);
+void cerrarLectorBoletas(LectorBoletas *lector);
+// Devuelve -1 si no pudo leer el archivo completo (los totales quedan a medias)
+int contarArchivoParalelo(LectorBoletas *lector, AlmacenBoletas *ventana,
+                          const NivelSimd *nivel, long long *votosPorCandidato,
+                          long long *votosNulos, int numHilos);
+
+// Tuberia de lectura: RANURAS_TUBERIA buffers de BYTES_POR_RANURA que se reutilizan
+// entre la lectura con pread y el empaquetado y conteo con OpenMP
+#define RANURAS_TUBERIA 4
+#define BYTES_POR_RANURA (8UL * 1024 * 1024)
+#define ALINEACION_DIRECTA 4096
+// Pocas tareas por ventana: libgomp deja de diferir tareas si hay muchas en cola
+#define BOLETAS_POR_TAREA_TUBERIA (4 * BOLETAS_POR_BLOQUE)
+
+int contarArchivoTuberia(LectorBoletas *lector, const NivelSimd *nivel, long long *votosPorCandidato,
+                         long long *votosNulos, int numHilos, int usarHugePages);
+void ejecutarBenchmarkTuberia(const char *ruta, int numHilos);
+int exportarBoletasTexto(const AlmacenBoletas *almacen, const char *ruta);
+
+// ---------------------------------------------------------------------------
+// Conteo incremental (votos_incremental.c): los lotes llegan durante la noche
+// electoral y cada uno cuesta lo que mide el lote, no lo que mide el total.
+// Los escritores se turnan con un cerrojo; los lectores toman instantaneas
+// consistentes sin bloquearlos (seqlock).
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    int numCandidatos;
+    int numHilos;
+    long long *votosPorCandidato;
+    long long votosNulos;
+    long long numBoletas;
+    long long lotesActivos;
+    // Conteo de cada lote (candidatos, nulos y numero de boletas al final) para poder
+    // corregirlo o retirarlo; NULL si el lote se retiro
+    long long **conteoLote;
+    long long numLotes;
+    long long capacidadLotes;
+    unsigned long long secuencia;
+    omp_lock_t cerrojoEscritura;
+} ConteoIncremental;
+
+typedef struct {
+    unsigned long long version;
+    int numCandidatos;
+    long long *votosPorCandidato;
+    long long votosNulos;
+    long long numBoletas;
+    long long lotes;
+} InstantaneaConteo;
+
+int crearConteoIncremental(ConteoIncremental *conteo, int numCandidatos, int numHilos);
+void liberarConteoIncremental(ConteoIncremental *conteo);
+long long agregarLote(ConteoIncremental *conteo, const AlmacenBoletas *lote);
+int corregirLote(ConteoIncremental *conteo, long long idLote, const AlmacenBoletas *loteCorregido);
+int retirarLote(ConteoIncremental *conteo, long long idLote);
+int tomarInstantanea(ConteoIncremental *conteo, InstantaneaConteo *instantanea);
+
+// ---------------------------------------------------------------------------
+// Conteo por region (votos_regiones.c): recinto, municipio y departamento en una
+// sola pasada, separando los nulos en blancos y marcas multiples.
+// ---------------------------------------------------------------------------
+
+#define CLAVE_REGION(departamento, municipio, recinto) \
+    (((uint32_t)(departamento) << 24) | ((uint32_t)(municipio) << 16) | (uint32_t)(recinto))
+#define DEPARTAMENTO_DE(clave) ((clave) >> 24)
+#define MUNICIPIO_DE(clave) (((clave) >> 16) & 0xFF)
+#define RECINTO_DE(clave) ((clave) & 0xFFFF)
+
+// Las boletas de una misma urna van seguidas y comparten recinto: un tramo de region
+#define BOLETAS_POR_URNA 256
+
+typedef struct {
+    int numDepartamentos;
+    int municipiosPorDepartamento;
+    int recintosPorMunicipio;
+} Geografia;
+
+// Un nivel de agregacion: numGrupos filas de columnas = candidatos + blancos + multiples,
+// ordenadas por clave
+typedef struct {
+    long long numGrupos;
+    int columnas;
+    uint32_t *claves;
+    long long *conteos;
+} ResultadoRegiones;
+
+int reservarRegiones(AlmacenBoletas *almacen, long long numTramos);
+void generarRegionesAleatorias(AlmacenBoletas *almacen, const Geografia *geografia,
+                               uint64_t semilla, int numHilos);
+int contarPorRegion(const AlmacenBoletas *almacen, const char *isa, int numHilos, 
+                    ResultadoRegiones niveles[3]);
+void liberarResultadosRegiones(ResultadoRegiones niveles[3]);
+int guardarResultadosRegiones(const char *ruta, const ResultadoRegiones niveles[3]);
+
+// ---------------------------------------------------------------------------
+// Puntos de control (votos_control.c): registro de solo anexar con el conteo parcial
+// de cada tramo de BOLETAS_POR_TRAMO boletas ya contado. Cada registro lleva su
+// suma de comprobacion y el disco se sincroniza por tandas, como mucho cada
+// INTERVALO_SINCRONIZACION segundos. Un conteo que se reanuda suma los tramos del
+// registro y solo cuenta los que faltan: cada tramo entra una sola vez.
+// ---------------------------------------------------------------------------
+
+#define BOLETAS_POR_TRAMO (64LL * BOLETAS_POR_BLOQUE)
+#define INTERVALO_SINCRONIZACION 0.1
+#define MAGIA_REGISTRO 0x4C525456u
+#define MAGIA_TRAMO 0x4D525456u
+
+// Cabecera del archivo: identifica el conteo al que pertenece el registro
+typedef struct {
+    uint32_t magia;
+    uint32_t numCandidatos;
+    uint64_t numBoletas;
+    uint64_t semilla;
+    uint64_t boletasPorTramo;
+} CabeceraRegistro;
+
+// Cada tramo contado; le siguen numCandidatos + 1 contadores de 64 bits (nulos al final)
+typedef struct {
+    uint32_t magia;
+    uint32_t tramo;
+    uint64_t suma;
+} RegistroTramo;
+
+struct RegistroControl {
+    const char *ruta;
+    int descriptor;
+    int numCandidatos;
+    long long numTramos;
+    long long boletasPorTramo;
+    unsigned char *tramosContados;
+    // Lo que ya estaba en el registro al abrirlo
+    long long tramosReanudados;
+    long long *votosReanudados;
+    long long bytesDescartados;
+    long long tramosEscritos;
+    long long sincronizaciones;
+    double ultimaSincronizacion;
+    long long caerTrasTramos;
+    omp_lock_t cerrojoDisco;
+};
+
+int abrirRegistroControl(RegistroControl *registro, const char *ruta, long long numBoletas,
+                         int numCandidatos, uint64_t semilla);
+void registrarTramo(RegistroControl *registro, long long tramo, const long long *conteo);
+// Sincroniza lo que falte; completo = 1 borra el registro (el conteo ya termino)
+int cerrarRegistroControl(RegistroControl *registro, int completo);
+// Semilla de la cabecera de un registro ya existente; -1 si no hay uno valido
+int leerSemillaRegistro(const char *ruta, uint64_t *semilla);
+// Solo para pruebas: el proceso termina de golpe tras escribir tantos tramos
+void simularCaidaRegistro(RegistroControl *registro, long long tramos);
+
+// ---------------------------------------------------------------------------
+// Voto preferencial (votos_preferencial.c): cada boleta ordena hasta RANGOS_PREFERENCIA
+// candidatos. Con un escano se tabula por segunda vuelta instantanea (IRV); con varios,
+// por voto unico transferible (STV, cuota Droop y excedentes fraccionarios). Un indice
+// de boletas por candidato hace que cada ronda solo revise las boletas del candidato
+// eliminado o electo, no todas.
+// ---------------------------------------------------------------------------
+
+#define RANGOS_PREFERENCIA 16
+#define PREFERENCIA_VACIA 0xFFFF
+
+// numBoletas filas de rangos entradas (candidato de cada preferencia, de la primera a
+// la ultima); PREFERENCIA_VACIA cierra la fila. Una fila vacia es una boleta en blanco.
+typedef struct {
+    uint16_t *preferencias;
+    long long numBoletas;
+    int numCandidatos;
+    int rangos;
+} AlmacenPreferencias;
+
+// Cada ronda elige o elimina un candidato. votosPorRonda tiene una fila por ronda con
+// los votos de cada candidato al empezarla y, en la ultima columna, las agotadas.
+typedef struct {
+    int numCandidatos;
+    int escanos;
+    double cuota;
+    int numRondas;
+    double *votosPorRonda;
+    int *candidatoPorRonda;
+    int *electoEnRonda;
+    int numElectos;
+    int *electos;
+    long long boletasRevisadas;
+    double segundos;
+} ResultadoPreferencial;
+
+int crearAlmacenPreferencias(AlmacenPreferencias *almacen, long long numBoletas, int numCandidatos);
+void liberarAlmacenPreferencias(AlmacenPreferencias *almacen);
+void generarPreferenciasAleatorias(AlmacenPreferencias *almacen, uint64_t semilla, int numHilos);
+int tabularPreferencial(const AlmacenPreferencias *almacen, int escanos, int numHilos,
+                        ResultadoPreferencial *resultado);
+// Referencia: vuelve a recorrer todas las boletas en cada ronda
+int tabularPreferencialRecontando(const AlmacenPreferencias *almacen, int escanos, int numHilos,
+                                  ResultadoPreferencial *resultado);
+int mismoResultadoPreferencial(const ResultadoPreferencial *a, const ResultadoPreferencial *b);
+void liberarResultadoPreferencial(ResultadoPreferencial *resultado);
+
+// ---------------------------------------------------------------------------
+// Contenedor binario (votos_contenedor.c): cabecera fija, boletas empaquetadas a
+// numCandidatos bits en chunks de BOLETAS_POR_CHUNK, indice de chunks al final y
+// CRC-32C de cada chunk. Los chunks se leen en cualquier orden desde varios hilos y
+// se verifican en la misma pasada en que se cuentan. Enteros en little-endian.
+// ---------------------------------------------------------------------------
+
+#define MAGIA_CONTENEDOR "VOTOSBIN"
+#define VERSION_CONTENEDOR 1
+#define BOLETAS_POR_CHUNK 65536
+#define EXTENSION_CONTENEDOR ".vbin"
+
+typedef struct {
+    char magia[8];
+    uint32_t version;
+    uint32_t numCandidatos;
+    uint64_t numBoletas;
+    uint32_t boletasPorChunk;
+    uint32_t reservado;
+    uint64_t numChunks;
+    uint64_t inicioIndice;
+    uint32_t crcIndice;
+    uint32_t crcCabecera;
+} CabeceraContenedor;
+
+typedef struct {
+    uint64_t desplazamiento;
+    uint32_t bytes;
+    uint32_t crc;
+} EntradaChunk;
+
+typedef struct {
+    CabeceraContenedor cabecera;
+    EntradaChunk *indice;
+    size_t bytesChunkMax;
+    long long tamanoArchivo;
+    #ifdef _WIN32
+        FILE *archivo;
+    #else
+        int descriptor;
+    #endif
+} ContenedorBoletas;
+
+uint32_t calcularCrc32c(const void *datos, size_t bytes);
+int esArchivoContenedor(const char *ruta);
+int esRutaContenedor(const char *ruta);
+int exportarContenedor(const AlmacenBoletas *almacen, const char *ruta, int numHilos);
+int abrirContenedor(ContenedorBoletas *contenedor, const char *ruta);
+int leerChunk(ContenedorBoletas *contenedor, long long chunk, uint8_t *datos);
+void decodificarChunk(const ContenedorBoletas *contenedor, long long chunk, const uint8_t *datos,
+                      AlmacenBoletas *ventana);
+void cerrarContenedor(ContenedorBoletas *contenedor);
+
+// Suma a los totales los chunks que no esten marcados en chunksContados (puede ser
+// NULL) y marca los que cuenta. Con arbol (puede ser NULL) deja tambien la hoja de
+// auditoria de cada chunk contado. Devuelve cuantos chunks no pasaron la verificacion.
+long long contarContenedorParalelo(ContenedorBoletas *contenedor, const NivelSimd *nivel,
+                                   long long *votosPorCandidato, long long *votosNulos,
+                                   int numHilos, unsigned char *chunksContados,
+                                   struct ArbolAuditoria *arbol);
+
+void mostrarInformeNuma(const AlmacenBoletas *almacen, const TiempoHilo *tiempos, int numHilos);
+void fijarAfinidadNuma(char *argv[]);
+
+// ---------------------------------------------------------------------------
+// Conteo fragmentado (votos_fragmentos.c): un coordinador reparte rangos de chunks
+// de un contenedor entre procesos trabajadores, cada uno con su propio equipo
+// OpenMP. Cada trabajador devuelve un conteo parcial por un socket; si muere, su
+// fragmento se reintenta en otro proceso y los ya terminados no se repiten.
+// ---------------------------------------------------------------------------
+
+#define FRAGMENTOS_POR_PROCESO 4
+#define MAX_INTENTOS_FRAGMENTO 3
+
+// Peticion del coordinador: contar los chunks [chunkInicio, chunkFin). Un fragmento
+// FIN_FRAGMENTOS pide al trabajador que termine.
+#define FIN_FRAGMENTOS 0xFFFFFFFFu
+
+typedef struct {
+    uint32_t fragmento;
+    uint32_t intento;
+    uint64_t chunkInicio;
+    uint64_t chunkFin;
+} PeticionFragmento;
+
+// Respuesta del trabajador; le siguen numCandidatos + 1 contadores de 64 bits (el
+// ultimo son los nulos)
+typedef struct {
+    uint32_t fragmento;
+    uint32_t numCandidatos;
+    uint64_t boletas;
+    uint64_t danados;
+} RespuestaFragmento;
+
+// Atiende peticiones por un socket ya conectado (local o TCP) hasta FIN_FRAGMENTOS o
+// hasta que se cierre. Devuelve 0 si termino bien.
+int atenderFragmentos(int descriptor, const char *ruta, const char *isa, int numHilos);
+int contarBackendFragmentos(const FuenteBoletas *fuente, const ParametrosConteo *parametros,
+                            ResultadoConteo *resultado);
+// Solo para pruebas: el primer intento de ese fragmento termina el proceso trabajador
+void simularFalloFragmento(long long fragmento);
+// Programa que se lanza para cada trabajador con "-trabajador-fragmentos <descriptor>
+// -archivo <ruta> -hilos <n> [-isa <isa>] [-fallo-fragmento <f>]"; debe acabar
+// llamando a atenderFragmentos con ese descriptor
+void registrarProgramaFragmentos(const char *programa);
+// Lectura y escritura completas sobre un socket (tambien las usa el servicio de conteo)
+int recibirTodo(int descriptor, void *buffer, size_t bytes);
+int enviarTodo(int descriptor, const void *buffer, size_t bytes);
+
+// ---------------------------------------------------------------------------
+// Servicio de conteo (votos_servidor.c): un proceso que se queda escuchando en un
+// socket Unix con un ConteoIncremental, el almacen de agrupacion y el equipo OpenMP
+// ya calientes. Los lotes que llegan a la vez de varios clientes se juntan y se
+// cuentan como uno solo. Los mensajes van en el orden de bytes de la maquina: el
+// servicio es local.
+// ---------------------------------------------------------------------------
+
+#define MAGIA_SERVICIO 0x31544F56u
+#define MAX_BOLETAS_MENSAJE (1u << 20)
+// Como mucho se agrupan tantas boletas antes de contar
+#define MAX_BOLETAS_AGRUPADAS (4u << 20)
+#define MAX_CLIENTES_SERVICIO 256
+
+typedef enum {
+    MENSAJE_LOTE = 1,
+    MENSAJE_INSTANTANEA = 2,
+    MENSAJE_CERRAR = 3
+} TipoMensaje;
+
+// Lo primero que recibe cada cliente al conectarse
+typedef struct {
+    uint32_t magia;
+    uint32_t numCandidatos;
+    uint32_t pasoBoleta;
+    uint32_t maxBoletasMensaje;
+} SaludoServicio;
+
+// Un MENSAJE_LOTE lleva detras numBoletas mascaras de pasoBoleta bytes, con el mismo
+// formato que AlmacenBoletas
+typedef struct {
+    uint32_t tipo;
+    uint32_t numBoletas;
+} CabeceraMensaje;
+
+typedef enum {
+    LOTE_CONTADO = 0,
+    LOTE_ERROR = 1,
+    // Alguna mascara marca bits de candidatos que no existen: no se cuenta nada del mensaje
+    LOTE_MARCAS_INVALIDAS = 2
+} EstadoLote;
+
+// Respuesta a MENSAJE_LOTE y MENSAJE_CERRAR: el lote agrupado en que se conto y con
+// cuantos mensajes de cuantas boletas se agrupo. estado distinto de LOTE_CONTADO = error.
+typedef struct {
+    int64_t idLote;
+    int64_t boletasAgrupadas;
+    int32_t mensajesAgrupados;
+    int32_t estado;
+} RespuestaLote;
+
+// Respuesta a MENSAJE_INSTANTANEA; le siguen numCandidatos contadores de 64 bits
+typedef struct {
+    uint64_t version;
+    int64_t numBoletas;
+    int64_t votosNulos;
+    int64_t lotes;
+} CabeceraInstantanea;
+
+int ejecutarServidor(const char *ruta, int numCandidatos, int numHilos);
+// Generador de carga: numClientes conexiones mandan lotesPorCliente lotes cada una y
+// miden la latencia de cada lote hasta su respuesta. cerrar = 1 apaga el servicio.
+int ejecutarCargaServicio(const char *ruta, int numClientes, int lotesPorCliente, int boletasPorLote,
+                          uint64_t semilla, int cerrar);
+
+// ---------------------------------------------------------------------------
+// Arena de memoria (votos_arena.c): regiones grandes pedidas una vez, en paginas de
+// 1 GB o 2 MB si el sistema las tiene reservadas y si no con transparent huge pages,
+// de las que se reparte con un puntero que avanza. Con una arena activa, los almacenes,
+// los contadores por hilo y los buffers de la tuberia salen de ella; vaciarArena al
+// final de cada ejecucion deja todo listo para la siguiente sin volver al sistema.
+// ---------------------------------------------------------------------------
+
+#define TAMANO_PAGINA_GIGANTE (1UL * 1024 * 1024 * 1024)
+#define REGION_ARENA_MINIMA (64UL * 1024 * 1024)
+
+typedef enum {
+    PAGINA_NORMAL,
+    PAGINA_TRANSPARENTE,
+    PAGINA_2MB,
+    PAGINA_1GB
+} TipoPagina;
+
+typedef struct RegionArena {
+    struct RegionArena *siguiente;
+    char *inicio;
+    size_t bytes;
+    TipoPagina tipoPagina;
+} RegionArena;
+
+typedef struct {
+    RegionArena *primera;
+    RegionArena *actual;
+    size_t usados;
+    size_t bytesRegiones;
+    size_t bytesEntregados;
+    int regionesPedidas;
+    int paginasGrandes;
+    TipoPagina paginaUltimaReserva;
+} ArenaMemoria;
+
+void iniciarArena(ArenaMemoria *arena, int paginasGrandes);
+void *reservarEnArena(ArenaMemoria *arena, size_t bytes, size_t alineacion);
+void vaciarArena(ArenaMemoria *arena);
+void destruirArena(ArenaMemoria *arena);
+const char *nombreTipoPagina(TipoPagina tipo);
+
+// La arena activa la usan las reservas de la biblioteca; NULL (por defecto) = malloc.
+// No se puede vaciar mientras haya un conteo en curso.
+void activarArena(ArenaMemoria *arena);
+ArenaMemoria *arenaActiva(void);
+void *reservarMemoriaConteo(size_t bytes, size_t alineacion, int *enArena, TipoPagina *tipoPagina);
+void liberarMemoriaConteo(void *memoria, int enArena);
+void ejecutarBenchmarkArena(long long numBoletas, int numCandidatos, int numHilos, uint64_t semilla);
+
+// ---------------------------------------------------------------------------
+// Auditoria (votos_auditoria.c): arbol de Merkle SHA-256 sobre los bloques de
+// BOLETAS_POR_BLOQUE boletas, con la misma forma que RFC 6962 (hoja = H(0x00 || bytes),
+// nodo = H(0x01 || izquierda || derecha)), para que se pueda comprobar con cualquier
+// herramienta. Las hojas se calculan mientras se cuenta; el verificador recalcula solo
+// una muestra de bloques y la raiz a partir de las hojas guardadas. Al contar un
+// contenedor, cada hoja es un chunk tal como esta en el archivo, calculada al leerlo y
+// comprobar su CRC, y el verificador vuelve a leer del archivo los chunks de la muestra.
+// ---------------------------------------------------------------------------
+
+#define BYTES_HASH 32
+#define MUESTRA_AUDITORIA 32
+
+typedef struct ArbolAuditoria {
+    long long numBoletas;
+    int numCandidatos;
+    size_t pasoBoleta;
+    long long boletasPorHoja;
+    long long numHojas;
+    int hojasDeChunks;          // 1: una hoja por chunk de contenedor; 0: bloques en memoria
+    uint8_t (*hojas)[BYTES_HASH];
+    uint8_t raiz[BYTES_HASH];
+} ArbolAuditoria;
+
+void calcularSha256(const void *datos, size_t bytes, uint8_t hash[BYTES_HASH]);
+// "sha-ni" si la CPU tiene las instrucciones SHA, si no "portable"
+const char *implementacionSha256(void);
+
+int crearArbolAuditoria(ArbolAuditoria *arbol, const AlmacenBoletas *almacen);
+int crearArbolContenedor(ArbolAuditoria *arbol, const ContenedorBoletas *contenedor);
+void liberarArbolAuditoria(ArbolAuditoria *arbol);
+void calcularHojaAuditoria(const AlmacenBoletas *almacen, long long hoja, uint8_t hash[BYTES_HASH]);
+void calcularHojaChunk(const uint8_t *datos, size_t bytes, uint8_t hash[BYTES_HASH]);
+void calcularRaizAuditoria(ArbolAuditoria *arbol, int numHilos);
+// Como contarVotosParalelo, calculando ademas las hojas y la raiz del arbol
+int contarVotosAuditado(const AlmacenBoletas *almacen, const NivelSimd *nivel,
+                        long long *votosPorCandidato, long long *votosNulos, int numHilos,
+                        ArbolAuditoria *arbol);
+// Anade la raiz y las hojas al final del archivo de resultados
+int guardarAuditoria(const char *ruta, const ArbolAuditoria *arbol);
+int leerAuditoria(const char *ruta, ArbolAuditoria *arbol);
+// Recalcula muestra hojas elegidas al azar y la raiz. Devuelve cuantas no coinciden
+// (la raiz cuenta como una mas) o -1 si no pudo verificar.
+long long verificarAuditoria(const ArbolAuditoria *arbol, const AlmacenBoletas *almacen,
+                             long long muestra, uint64_t semilla, int numHilos);
+// Igual para la auditoria de un contenedor, leyendo del archivo solo los chunks elegidos
+long long verificarAuditoriaContenedor(const ArbolAuditoria *arbol, ContenedorBoletas *contenedor,
+                                       long long muestra, uint64_t semilla, int numHilos);
+void ejecutarBenchmarkAuditoria(long long numBoletas, int numCandidatos, int numHilos, uint64_t semilla);
+
+// ---------------------------------------------------------------------------
+// Estimacion temprana (votos_estimacion.c): los bloques se cuentan en un orden
+// aleatorio estratificado (los bloques seguidos forman NUM_ESTRATOS estratos y cada
+// etapa toma el doble de bloques de cada uno que la anterior). Tras cada etapa se
+// publican las proporciones con su intervalo de confianza; la ultima etapa ya ha
+// contado todos los bloques y da los totales exactos de la misma pasada.
+// ---------------------------------------------------------------------------
+
+#define NUM_ESTRATOS 16
+#define BLOQUES_PRIMERA_ETAPA 2
+#define Z_CONFIANZA_95 1.959964
+
+// proporcion y margen tienen numCandidatos + 1 entradas: candidatos sobre los votos
+// validos y, al final, nulos sobre las boletas. El intervalo es proporcion +- margen.
+typedef struct {
+    int etapa;
+    int exacta;
+    int numCandidatos;
+    long long bloquesContados;
+    long long numBloques;
+    long long boletasContadas;
+    double segundos;
+    const double *proporcion;
+    const double *margen;
+} EstimacionConteo;
+
+typedef void (*PublicarEstimacion)(const EstimacionConteo *estimacion, void *contexto);
+
+// Cuenta todas las boletas como contarVotosParalelo y llama a publicar al terminar
+// cada etapa (desde el hilo que llamo). Devuelve 0 si pudo contar.
+int contarVotosEstimado(const AlmacenBoletas *almacen, const NivelSimd *nivel,
+                        long long *votosPorCandidato, long long *votosNulos, int numHilos,
+                        uint64_t semilla, PublicarEstimacion publicar, void *contexto);
+int ejecutarModoEstimacion(long long numBoletas, int numCandidatos, int numHilos, uint64_t semilla);
+
+// ---------------------------------------------------------------------------
+// Instrumentacion opcional (votos_instrumentacion.c): contadores perf_event de cada
+// hilo OpenMP por fase. Apagada, empezarFase/terminarFase solo comprueban un entero.
+// ---------------------------------------------------------------------------
+
+#define EVENTOS_INSTRUMENTACION 4
+
+typedef enum {
+    FASE_RESERVA,
+    FASE_GENERACION,
+    FASE_CONTEO,
+    FASE_MEZCLA,
+    FASE_SALIDA,
+    NUM_FASES
+} FaseConteo;
+
+// Hardware: ciclos, instrucciones, fallos LLC y fallos de prediccion de saltos.
+// Software (sin PMU): task-clock, fallos de pagina, cambios de contexto y migraciones.
+typedef enum {
+    INSTRUMENTACION_APAGADA,
+    INSTRUMENTACION_TIEMPO,
+    INSTRUMENTACION_SOFTWARE,
+    INSTRUMENTACION_HARDWARE
+} ModoInstrumentacion;
+
+ModoInstrumentacion activarInstrumentacion(void);
+void terminarInstrumentacion(void);
+void empezarFase(FaseConteo fase);
+void terminarFase(FaseConteo fase);
+void mostrarInformeInstrumentacion(void);
+
+// Contadores sueltos del hilo que llama, abiertos por el mismo camino perf_event que
+// las fases. abrirContadorHilo devuelve -1 si el sistema no lo permite (sin PMU, el
+// de la TLB); leer un descriptor -1 da 0.
+typedef enum {
+    CONTADOR_FALLOS_PAGINA,
+    CONTADOR_FALLOS_TLB,
+    NUM_CONTADORES_HILO
+} ContadorHilo;
+
+int abrirContadorHilo(ContadorHilo contador);
+uint64_t leerContadorHilo(int descriptor);
+void cerrarContadorHilo(int descriptor);
+
+// Resumen de varias repeticiones de un mismo conteo (votos_bench.c). speedup y
+// eficiencia los llena quien tenga la referencia; medirConteo los deja en 1.
+typedef struct {
+    const char *backend;
+    const char *kernel;
+    long long numBoletas;
+    int numCandidatos;
+    int numHilos;
+    int repeticiones;
+    double mediana;
+    double p95;
+    double media;
+    double desviacion;
+    double minimo;
+    double boletasPorSegundo;
+    double speedup;
+    double eficiencia;
+} MedicionBenchmark;
+
+int medirConteo(const char *nombreBackend, const FuenteBoletas *fuente, const ParametrosConteo *parametros,
+                int calentamiento, int repeticiones, MedicionBenchmark *medicion);
+int ejecutarSuiteBenchmark(const char *rutaCsv, const char *rutaJson, int rapida, uint64_t semilla);
+
+void ejecutarBenchmarkSimd(int usarHugePages, uint64_t semilla);
+void ejecutarBenchmarkClasificacion(int usarHugePages, uint64_t semilla);
+void ejecutarBenchmarkCandidatos(const char *nombreBackend, const ParametrosConteo *parametros,
+                                 uint64_t semilla);
+void ejecutarBenchmarkHilos(int numCandidatos, const char *isa, int usarHugePages, uint64_t semilla);
+
+#endif
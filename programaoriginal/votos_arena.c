@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <omp.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <malloc.h>
+#else
+    #include <sys/mman.h>
+#endif
+
+#include "votos.h"
+
+// Tamano de pagina pedido a MAP_HUGETLB (log2 en los bits MAP_HUGE_SHIFT)
+#if !defined(_WIN32) && defined(MAP_HUGETLB)
+    #ifndef MAP_HUGE_SHIFT
+        #define MAP_HUGE_SHIFT 26
+    #endif
+    #ifndef MAP_HUGE_2MB
+        #define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+    #endif
+    #ifndef MAP_HUGE_1GB
+        #define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+    #endif
+#endif
+
+static const char *nombresTipoPagina[] = {"4 KB", "THP", "2 MB", "1 GB"};
+
+const char *nombreTipoPagina(TipoPagina tipo) {
+    return nombresTipoPagina[tipo];
+}
+
+// Pide una region al sistema, probando de la pagina mas grande a la mas pequena
+static int mapearRegion(RegionArena *region, size_t bytes, int paginasGrandes) {
+    #ifdef _WIN32
+        (void)paginasGrandes;
+        region->inicio = (char *)VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        region->bytes = bytes;
+        region->tipoPagina = PAGINA_NORMAL;
+        return region->inicio != NULL ? 0 : -1;
+    #else
+        void *p = MAP_FAILED;
+        if (paginasGrandes) {
+            #ifdef MAP_HUGETLB
+            if (bytes >= TAMANO_PAGINA_GIGANTE) {
+                size_t redondeados = (bytes + TAMANO_PAGINA_GIGANTE - 1) & ~(TAMANO_PAGINA_GIGANTE - 1);
+                p = mmap(NULL, redondeados, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_1GB, -1, 0);
+                if (p != MAP_FAILED) {
+                    region->inicio = (char *)p;
+                    region->bytes = redondeados;
+                    region->tipoPagina = PAGINA_1GB;
+                    return 0;
+                }
+            }
+            size_t redondeados = (bytes + TAMANO_HUGE_PAGE - 1) & ~(TAMANO_HUGE_PAGE - 1);
+            p = mmap(NULL, redondeados, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+            if (p != MAP_FAILED) {
+                region->inicio = (char *)p;
+                region->bytes = redondeados;
+                region->tipoPagina = PAGINA_2MB;
+                return 0;
+            }
+            #endif
+            bytes = (bytes + TAMANO_HUGE_PAGE - 1) & ~(TAMANO_HUGE_PAGE - 1);
+        }
+
+        p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            return -1;
+        }
+        region->inicio = (char *)p;
+        region->bytes = bytes;
+        region->tipoPagina = PAGINA_NORMAL;
+        // Sin paginas reservadas en el sistema: pedir transparent huge pages
+        #ifdef MADV_HUGEPAGE
+        if (paginasGrandes && madvise(p, bytes, MADV_HUGEPAGE) == 0) {
+            region->tipoPagina = PAGINA_TRANSPARENTE;
+        }
+        #endif
+        return 0;
+    #endif
+}
+
+static void desmapearRegion(RegionArena *region) {
+    #ifdef _WIN32
+        VirtualFree(region->inicio, 0, MEM_RELEASE);
+    #else
+        munmap(region->inicio, region->bytes);
+    #endif
+}
+
+void iniciarArena(ArenaMemoria *arena, int paginasGrandes) {
+    memset(arena, 0, sizeof(*arena));
+    arena->paginasGrandes = paginasGrandes;
+}
+
+// Avanza el puntero de la region actual; si no cabe, pasa a la siguiente region ya
+// pedida en que quepa (las que quedan de ejecuciones anteriores) o pide otra, al
+// menos el doble de la ultima para que el numero de regiones crezca poco
+void *reservarEnArena(ArenaMemoria *arena, size_t bytes, size_t alineacion) {
+    while (arena->actual != NULL) {
+        uintptr_t base = (uintptr_t)arena->actual->inicio;
+        uintptr_t posicion = (base + arena->usados + alineacion - 1) & ~(uintptr_t)(alineacion - 1);
+        if (posicion + bytes <= base + arena->actual->bytes) {
+            arena->usados = posicion + bytes - base;
+            arena->bytesEntregados += bytes;
+            arena->paginaUltimaReserva = arena->actual->tipoPagina;
+            return (void *)posicion;
+        }
+        if (arena->actual->siguiente == NULL) {
+            break;
+        }
+        arena->actual = arena->actual->siguiente;
+        arena->usados = 0;
+    }
+
+    RegionArena *region = (RegionArena *)malloc(sizeof(RegionArena));
+    size_t pedidos = bytes + alineacion;
+    size_t ultima = arena->actual != NULL ? arena->actual->bytes : 0;
+    if (pedidos < 2 * ultima) pedidos = 2 * ultima;
+    if (pedidos < REGION_ARENA_MINIMA) pedidos = REGION_ARENA_MINIMA;
+    if (region == NULL || mapearRegion(region, pedidos, arena->paginasGrandes) != 0) {
+        free(region);
+        return NULL;
+    }
+    region->siguiente = NULL;
+    if (arena->actual != NULL) {
+        arena->actual->siguiente = region;
+    } else {
+        arena->primera = region;
+    }
+    arena->actual = region;
+    arena->usados = 0;
+    arena->bytesRegiones += region->bytes;
+    arena->regionesPedidas++;
+    return reservarEnArena(arena, bytes, alineacion);
+}
+
+// O(1): todo lo entregado deja de ser valido, las regiones se quedan
+void vaciarArena(ArenaMemoria *arena) {
+    arena->actual = arena->primera;
+    arena->usados = 0;
+    arena->bytesEntregados = 0;
+}
+
+void destruirArena(ArenaMemoria *arena) {
+    RegionArena *region = arena->primera;
+    while (region != NULL) {
+        RegionArena *siguiente = region->siguiente;
+        desmapearRegion(region);
+        free(region);
+        region = siguiente;
+    }
+    iniciarArena(arena, arena->paginasGrandes);
+}
+
+// ---------------------------------------------------------------------------
+// Arena activa de la biblioteca
+// ---------------------------------------------------------------------------
+
+static ArenaMemoria *arenaGlobal = NULL;
+
+void activarArena(ArenaMemoria *arena) {
+    arenaGlobal = arena;
+}
+
+ArenaMemoria *arenaActiva(void) {
+    return arenaGlobal;
+}
+
+// Los hilos de contarContenedorParalelo reservan sus ventanas a la vez, asi que la
+// arena se reparte dentro de un critical con nombre
+void *reservarMemoriaConteo(size_t bytes, size_t alineacion, int *enArena, TipoPagina *tipoPagina) {
+    void *memoria = NULL;
+    *enArena = 0;
+    if (tipoPagina != NULL) {
+        *tipoPagina = PAGINA_NORMAL;
+    }
+
+    if (arenaGlobal != NULL) {
+        #pragma omp critical(arenaMemoria)
+        {
+            memoria = reservarEnArena(arenaGlobal, bytes, alineacion);
+            if (memoria != NULL && tipoPagina != NULL) {
+                *tipoPagina = arenaGlobal->paginaUltimaReserva;
+            }
+        }
+        if (memoria != NULL) {
+            *enArena = 1;
+            return memoria;
+        }
+    }
+
+    #ifdef _WIN32
+        memoria = _aligned_malloc(bytes, alineacion);
+    #else
+        if (posix_memalign(&memoria, alineacion, bytes) != 0) {
+            memoria = NULL;
+        }
+    #endif
+    return memoria;
+}
+
+void liberarMemoriaConteo(void *memoria, int enArena) {
+    if (enArena) {
+        return;
+    }
+    #ifdef _WIN32
+        _aligned_free(memoria);
+    #else
+        free(memoria);
+    #endif
+}
+
+// ---------------------------------------------------------------------------
+// Benchmark: la misma ejecucion (reservar, generar, contar, liberar) repetida sin
+// arena, con arena de paginas normales y con arena de paginas grandes. Se mide el
+// tiempo de cada ejecucion, su dispersion, los fallos de pagina y, si hay PMU, los
+// fallos de la TLB de datos de todos los hilos.
+// ---------------------------------------------------------------------------
+
+#define EJECUCIONES_ARENA 12
+
+typedef struct {
+    int descriptores[2 * 256];
+    int numHilos;
+    int tlbDisponible;
+} ContadoresArena;
+
+// Cada hilo del equipo abre sus propios contadores; despues se leen desde el hilo
+// principal. libgomp reutiliza los mismos hilos en todas las regiones del mismo tamano.
+static void abrirContadoresArena(ContadoresArena *contadores, int numHilos) {
+    contadores->numHilos = numHilos < 256 ? numHilos : 256;
+    for (int i = 0; i < 2 * 256; i++) {
+        contadores->descriptores[i] = -1;
+    }
+    #pragma omp parallel num_threads(contadores->numHilos)
+    {
+        int h = omp_get_thread_num();
+        contadores->descriptores[2 * h] = abrirContadorHilo(CONTADOR_FALLOS_PAGINA);
+        contadores->descriptores[2 * h + 1] = abrirContadorHilo(CONTADOR_FALLOS_TLB);
+    }
+    contadores->tlbDisponible = contadores->descriptores[1] >= 0;
+}
+
+static void leerContadoresArena(const ContadoresArena *contadores, uint64_t *fallosPagina, uint64_t *fallosTlb) {
+    *fallosPagina = 0;
+    *fallosTlb = 0;
+    for (int h = 0; h < contadores->numHilos; h++) {
+        *fallosPagina += leerContadorHilo(contadores->descriptores[2 * h]);
+        *fallosTlb += leerContadorHilo(contadores->descriptores[2 * h + 1]);
+    }
+}
+
+static void cerrarContadoresArena(ContadoresArena *contadores) {
+    for (int i = 0; i < 2 * contadores->numHilos; i++) {
+        cerrarContadorHilo(contadores->descriptores[i]);
+    }
+}
+
+void ejecutarBenchmarkArena(long long numBoletas, int numCandidatos, int numHilos, uint64_t semilla) {
+    const char *modos[] = {"sin arena", "arena 4 KB", "arena paginas grandes"};
+    if (numHilos <= 0) {
+        numHilos = omp_get_max_threads();
+    }
+
+    ContadoresArena contadores;
+    abrirContadoresArena(&contadores, numHilos);
+
+    printf("\n=== BENCHMARK DE LA ARENA DE MEMORIA ===\n");
+    printf("%d ejecuciones de %lld boletas y %d candidatos con %d hilos: reservar, generar,\n",
+           EJECUCIONES_ARENA, numBoletas, numCandidatos, numHilos);
+    printf("contar con el backend openmp y liberar (o vaciar la arena)\n\n");
+    printf("  %-22s %6s %10s %10s %10s %8s %12s %14s\n", "Modo", "Pagina", "1a (ms)", "Media ms",
+           "Desv. ms", "CV", "Fallos pag.", "Fallos dTLB");
+
+    for (int modo = 0; modo < 3; modo++) {
+        ArenaMemoria arena;
+        iniciarArena(&arena, modo == 2);
+        activarArena(modo > 0 ? &arena : NULL);
+
+        double tiempos[EJECUCIONES_ARENA];
+        uint64_t fallosPagina = 0, fallosTlb = 0;
+        const char *pagina = "4 KB";
+        int error = 0;
+
+        for (int e = 0; e < EJECUCIONES_ARENA && !error; e++) {
+            uint64_t paginaAntes, tlbAntes, paginaDespues, tlbDespues;
+            leerContadoresArena(&contadores, &paginaAntes, &tlbAntes);
+            double inicio = obtenerTiempoAlta();
+
+            AlmacenBoletas almacen;
+            ResultadoConteo resultado;
+            if (crearAlmacenBoletas(&almacen, numBoletas, numCandidatos, 0) != 0) {
+                printf("Error: No se pudo reservar memoria para %lld boletas\n", numBoletas);
+                error = 1;
+                break;
+            }
+            generarBoletasAleatorias(&almacen, semilla, numHilos);
+            FuenteBoletas fuente = {&almacen, NULL};
+            ParametrosConteo parametros = {NULL, numHilos, NULL, 0, NULL, 0};
+            error = contarVotos("openmp", &fuente, &parametros, &resultado) != 0;
+            if (!error) {
+                liberarResultado(&resultado);
+            }
+            if (modo > 0) {
+                pagina = nombreTipoPagina(arena.paginaUltimaReserva);
+            }
+            liberarAlmacenBoletas(&almacen);
+            if (modo > 0) {
+                vaciarArena(&arena);
+            }
+
+            tiempos[e] = obtenerTiempoAlta() - inicio;
+            leerContadoresArena(&contadores, &paginaDespues, &tlbDespues);
+            // La primera ejecucion de cada modo incluye pedir las regiones; los fallos
+            // se cuentan en las siguientes, que son las de un servicio ya caliente
+            if (e > 0) {
+                fallosPagina += paginaDespues - paginaAntes;
+                fallosTlb += tlbDespues - tlbAntes;
+            }
+        }
+
+        activarArena(NULL);
+        destruirArena(&arena);
+        if (error) {
+            break;
+        }
+
+        // Media y desviacion sin la primera ejecucion
+        double suma = 0, cuadrados = 0;
+        int n = EJECUCIONES_ARENA - 1;
+        for (int e = 1; e <= n; e++) {
+            suma += tiempos[e];
+        }
+        double media = suma / n;
+        for (int e = 1; e <= n; e++) {
+            cuadrados += (tiempos[e] - media) * (tiempos[e] - media);
+        }
+        double desviacion = sqrt(cuadrados / (n - 1));
+
+        char tlb[32];
+        if (contadores.tlbDisponible) {
+            snprintf(tlb, sizeof(tlb), "%llu", (unsigned long long)(fallosTlb / n));
+        } else {
+            snprintf(tlb, sizeof(tlb), "sin PMU");
+        }
+        printf("  %-22s %6s %10.1f %10.1f %10.2f %7.1f%% %12llu %14s\n", modos[modo], pagina,
+               tiempos[0] * 1000, media * 1000, desviacion * 1000, desviacion / media * 100,
+               (unsigned long long)(fallosPagina / n), tlb);
+    }
+    printf("\n  Fallos por ejecucion, sin contar la primera de cada modo\n");
+    cerrarContadoresArena(&contadores);
+}
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <omp.h>
+
+#ifndef _WIN32
+    #include <unistd.h>
+#endif
+
+#include "votos.h"
+
+static int compararSegundos(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Cuenta la fuente calentamiento + repeticiones veces y resume las repeticiones:
+// mediana, p95 (rango mas cercano), media, desviacion estandar y minimo.
+// Los contadores y buffers de cada ejecucion salen de una arena que se vacia entre
+// ejecuciones, asi las repeticiones reutilizan la misma memoria ya tocada.
+int medirConteo(const char *nombreBackend, const FuenteBoletas *fuente, const ParametrosConteo *parametros,
+                int calentamiento, int repeticiones, MedicionBenchmark *medicion) {
+    memset(medicion, 0, sizeof(*medicion));
+    double *segundos = (double *)malloc(repeticiones * sizeof(double));
+    if (segundos == NULL || repeticiones <= 0) {
+        free(segundos);
+        return -1;
+    }
+
+    ArenaMemoria arena;
+    ArenaMemoria *anterior = arenaActiva();
+    iniciarArena(&arena, parametros->usarHugePages);
+    activarArena(&arena);
+
+    ResultadoConteo resultado;
+    for (int r = 0; r < calentamiento + repeticiones; r++) {
+        if (contarVotos(nombreBackend, fuente, parametros, &resultado) != 0) {
+            activarArena(anterior);
+            destruirArena(&arena);
+            free(segundos);
+            return -1;
+        }
+        if (r >= calentamiento) {
+            segundos[r - calentamiento] = resultado.segundos;
+        }
+        medicion->numBoletas = resultado.numBoletas;
+        medicion->numCandidatos = resultado.numCandidatos;
+        medicion->numHilos = resultado.numHilos;
+        medicion->kernel = resultado.kernel;
+        liberarResultado(&resultado);
+        vaciarArena(&arena);
+    }
+    activarArena(anterior);
+    destruirArena(&arena);
+
+    qsort(segundos, repeticiones, sizeof(double), compararSegundos);
+    double suma = 0, cuadrados = 0;
+    for (int r = 0; r < repeticiones; r++) {
+        suma += segundos[r];
+    }
+    medicion->media = suma / repeticiones;
+    for (int r = 0; r < repeticiones; r++) {
+        cuadrados += (segundos[r] - medicion->media) * (segundos[r] - medicion->media);
+    }
+    medicion->backend = nombreBackend;
+    medicion->repeticiones = repeticiones;
+    medicion->minimo = segundos[0];
+    medicion->mediana = repeticiones % 2 ? segundos[repeticiones / 2]
+                                         : (segundos[repeticiones / 2 - 1] + segundos[repeticiones / 2]) / 2;
+    medicion->p95 = segundos[(int)ceil(0.95 * repeticiones) - 1];
+    medicion->desviacion = repeticiones > 1 ? sqrt(cuadrados / (repeticiones - 1)) : 0;
+    medicion->boletasPorSegundo = medicion->numBoletas / medicion->mediana;
+    medicion->speedup = 1;
+    medicion->eficiencia = 1;
+    free(segundos);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Suite: boletas x candidatos x backends x hilos. El speedup y la eficiencia de cada
+// caso se miden contra el backend "simd" con un hilo sobre las mismas boletas.
+// ---------------------------------------------------------------------------
+
+#define CALENTAMIENTO_SUITE 2
+
+static void escribirCsv(FILE *archivo, const MedicionBenchmark *m) {
+    fprintf(archivo, "%s,%lld,%d,%d,%s,%d,%.6f,%.6f,%.6f,%.6f,%.6f,%.0f,%.4f,%.4f\n",
+            m->backend, m->numBoletas, m->numCandidatos, m->numHilos, m->kernel, m->repeticiones,
+            m->mediana * 1000, m->p95 * 1000, m->media * 1000, m->desviacion * 1000, m->minimo * 1000,
+            m->boletasPorSegundo, m->speedup, m->eficiencia);
+}
+
+static void escribirJson(FILE *archivo, const MedicionBenchmark *m, int primera) {
+    fprintf(archivo, "%s    {\"backend\": \"%s\", \"boletas\": %lld, \"candidatos\": %d, \"hilos\": %d, "
+            "\"kernel\": \"%s\", \"repeticiones\": %d, \"mediana_ms\": %.6f, \"p95_ms\": %.6f, "
+            "\"media_ms\": %.6f, \"desviacion_ms\": %.6f, \"min_ms\": %.6f, "
+            "\"boletas_por_segundo\": %.0f, \"speedup\": %.4f, \"eficiencia\": %.4f}",
+            primera ? "" : ",\n", m->backend, m->numBoletas, m->numCandidatos, m->numHilos,
+            m->kernel, m->repeticiones, m->mediana * 1000, m->p95 * 1000, m->media * 1000,
+            m->desviacion * 1000, m->minimo * 1000, m->boletasPorSegundo, m->speedup, m->eficiencia);
+}
+
+int ejecutarSuiteBenchmark(const char *rutaCsv, const char *rutaJson, int rapida, uint64_t semilla) {
+    long long boletasCompleta[] = {100000, 1000000, 10000000};
+    long long boletasRapida[] = {100000, 1000000};
+    int candidatos[] = {4, 16, 64, 256};
+    const char *backends[] = {"secuencial", "simd", "openmp"};
+    long long *boletas = rapida ? boletasRapida : boletasCompleta;
+    int numTamanos = rapida ? 2 : 3;
+    int numCandidatos = (int)(sizeof(candidatos) / sizeof(candidatos[0]));
+    int numBackends = (int)(sizeof(backends) / sizeof(backends[0]));
+    int repeticiones = rapida ? 5 : 9;
+
+    // Hilos: potencias de dos hasta el numero de procesadores, y este
+    int hilos[32], numPruebasHilos = 0, procesadores = omp_get_num_procs();
+    for (int h = 1; h < procesadores && numPruebasHilos < 31; h *= 2) {
+        hilos[numPruebasHilos++] = h;
+    }
+    hilos[numPruebasHilos++] = procesadores;
+
+    FILE *csv = fopen(rutaCsv, "w");
+    FILE *json = fopen(rutaJson, "w");
+    if (csv == NULL || json == NULL) {
+        printf("Error: No se pudieron crear '%s' y '%s'\n", rutaCsv, rutaJson);
+        if (csv != NULL) fclose(csv);
+        if (json != NULL) fclose(json);
+        return -1;
+    }
+
+    char host[128] = "desconocido";
+    #ifndef _WIN32
+        gethostname(host, sizeof(host) - 1);
+    #endif
+    time_t ahora = time(NULL);
+    char fecha[32];
+    strftime(fecha, sizeof(fecha), "%Y-%m-%dT%H:%M:%S", localtime(&ahora));
+
+    fprintf(csv, "backend,boletas,candidatos,hilos,kernel,repeticiones,mediana_ms,p95_ms,media_ms,"
+                 "desviacion_ms,min_ms,boletas_por_segundo,speedup,eficiencia\n");
+    fprintf(json, "{\n  \"fecha\": \"%s\",\n  \"host\": \"%s\",\n  \"procesadores\": %d,\n"
+                  "  \"compilador\": \"%s\",\n  \"semilla\": %llu,\n  \"calentamiento\": %d,\n"
+                  "  \"mediciones\": [\n", fecha, host, procesadores, __VERSION__,
+            (unsigned long long)semilla, CALENTAMIENTO_SUITE);
+
+    printf("\n=== SUITE DE BENCHMARK ===\n");
+    printf("%d calentamientos y %d repeticiones por caso, %d procesadores\n\n",
+           CALENTAMIENTO_SUITE, repeticiones, procesadores);
+    printf("  %-10s %10s %5s %5s %9s %12s %12s %12s %9s %8s\n", "Backend", "Boletas", "Cand.",
+           "Hilos", "Kernel", "Mediana ms", "p95 ms", "Desv. ms", "Speedup", "Efic.");
+
+    int primera = 1, errores = 0;
+    for (int t = 0; t < numTamanos; t++) {
+        for (int c = 0; c < numCandidatos; c++) {
+            AlmacenBoletas almacen;
+            if (crearAlmacenBoletas(&almacen, boletas[t], candidatos[c], 0) != 0) {
+                printf("  %10lld boletas de %d candidatos: sin memoria suficiente\n", boletas[t], candidatos[c]);
+                errores++;
+                continue;
+            }
+            generarBoletasAleatorias(&almacen, semilla, procesadores);
+            FuenteBoletas fuente = {&almacen, NULL};
+
+            ParametrosConteo base = {NULL, 1, NULL, 0, NULL};
+            MedicionBenchmark referencia;
+            if (medirConteo("simd", &fuente, &base, CALENTAMIENTO_SUITE, repeticiones, &referencia) != 0) {
+                liberarAlmacenBoletas(&almacen);
+                errores++;
+                continue;
+            }
+
+            for (int b = 0; b < numBackends; b++) {
+                int paralelo = buscarBackend(backends[b])->paralelo;
+                for (int h = 0; h < (paralelo ? numPruebasHilos : 1); h++) {
+                    ParametrosConteo parametros = {NULL, hilos[h], NULL, 0, NULL};
+                    MedicionBenchmark medicion = referencia;
+                    // La referencia ya es "simd" con un hilo; no se mide dos veces
+                    if (strcmp(backends[b], "simd") != 0 &&
+                        medirConteo(backends[b], &fuente, &parametros, CALENTAMIENTO_SUITE,
+                                    repeticiones, &medicion) != 0) {
+                        errores++;
+                        continue;
+                    }
+                    medicion.speedup = referencia.mediana / medicion.mediana;
+                    medicion.eficiencia = medicion.speedup / medicion.numHilos;
+                    printf("  %-10s %10lld %5d %5d %9s %12.3f %12.3f %12.3f %8.2fx %7.0f%%\n",
+                           medicion.backend, medicion.numBoletas, medicion.numCandidatos,
+                           medicion.numHilos, medicion.kernel, medicion.mediana * 1000,
+                           medicion.p95 * 1000, medicion.desviacion * 1000, medicion.speedup,
+                           medicion.eficiencia * 100);
+                    escribirCsv(csv, &medicion);
+                    escribirJson(json, &medicion, primera);
+                    primera = 0;
+                }
+            }
+            liberarAlmacenBoletas(&almacen);
+        }
+    }
+
+    fprintf(json, "\n  ]\n}\n");
+    fclose(csv);
+    fclose(json);
+    printf("\nResultados del benchmark guardados en '%s' y '%s'\n", rutaCsv, rutaJson);
+    return errores > 0 ? -1 : 0;
+}
@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <omp.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    #define VOTOS_SIMD_X86 1
+    #include <immintrin.h>
+#endif
+
+#include "votos.h"
+
+// ---------------------------------------------------------------------------
+// CRC-32C (Castagnoli): con la instruccion crc32 de SSE4.2 si la CPU la tiene
+// ---------------------------------------------------------------------------
+
+static uint32_t tablaCrc[256];
+static int crcPreparado = 0;
+static int crcHardware = 0;
+
+static void prepararCrc(void) {
+    for (uint32_t b = 0; b < 256; b++) {
+        uint32_t crc = b;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1)));
+        }
+        tablaCrc[b] = crc;
+    }
+    #ifdef VOTOS_SIMD_X86
+        __builtin_cpu_init();
+        crcHardware = __builtin_cpu_supports("sse4.2");
+    #endif
+    __atomic_store_n(&crcPreparado, 1, __ATOMIC_RELEASE);
+}
+
+#ifdef VOTOS_SIMD_X86
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHardware(uint32_t crc, const uint8_t *datos, size_t bytes) {
+    uint64_t acumulado = crc;
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t palabra;
+        memcpy(&palabra, datos + i, 8);
+        acumulado = _mm_crc32_u64(acumulado, palabra);
+    }
+    crc = (uint32_t)acumulado;
+    for (; i < bytes; i++) {
+        crc = _mm_crc32_u8(crc, datos[i]);
+    }
+    return crc;
+}
+#endif
+
+uint32_t calcularCrc32c(const void *datos, size_t bytes) {
+    const uint8_t *p = (const uint8_t *)datos;
+    uint32_t crc = 0xFFFFFFFFu;
+    if (!__atomic_load_n(&crcPreparado, __ATOMIC_ACQUIRE)) {
+        #pragma omp critical(prepararCrc)
+        {
+            if (!crcPreparado) {
+                prepararCrc();
+            }
+        }
+    }
+    #ifdef VOTOS_SIMD_X86
+        if (crcHardware) {
+            return crc32cHardware(crc, p, bytes) ^ 0xFFFFFFFFu;
+        }
+    #endif
+    for (size_t i = 0; i < bytes; i++) {
+        crc = (crc >> 8) ^ tablaCrc[(crc ^ p[i]) & 0xFF];
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// ---------------------------------------------------------------------------
+// Empaquetado: cada boleta ocupa exactamente numCandidatos bits seguidos dentro
+// del chunk (bit j de la boleta = candidato j), sin relleno entre boletas
+// ---------------------------------------------------------------------------
+
+// Hasta 57 bits con una sola lectura de 8 bytes; el relleno del final del chunk
+// garantiza que nunca se lee fuera
+static inline uint64_t leerBitsCortos(const uint8_t *datos, uint64_t posicion, uint64_t mascara) {
+    uint64_t palabra;
+    memcpy(&palabra, datos + (posicion >> 3), 8);
+    return (palabra >> (posicion & 7)) & mascara;
+}
+
+static inline uint64_t leerBits(const uint8_t *datos, uint64_t posicion, int n) {
+    int desplazamiento = (int)(posicion & 7);
+    uint64_t valor;
+    memcpy(&valor, datos + (posicion >> 3), 8);
+    valor >>= desplazamiento;
+    if (desplazamiento + n > 64) {
+        valor |= (uint64_t)datos[(posicion >> 3) + 8] << (64 - desplazamiento);
+    }
+    return n == 64 ? valor : valor & ((1ULL << n) - 1);
+}
+
+// Hace OR de n bits (n <= 64) en un buffer puesto a cero
+static inline void escribirBits(uint8_t *datos, uint64_t posicion, int n, uint64_t valor) {
+    int desplazamiento = (int)(posicion & 7);
+    uint64_t palabra;
+    memcpy(&palabra, datos + (posicion >> 3), 8);
+    palabra |= valor << desplazamiento;
+    memcpy(datos + (posicion >> 3), &palabra, 8);
+    if (desplazamiento + n > 64) {
+        datos[(posicion >> 3) + 8] |= (uint8_t)(valor >> (64 - desplazamiento));
+    }
+}
+
+static inline long long boletasDelChunk(const CabeceraContenedor *cabecera, long long chunk) {
+    long long inicio = chunk * (long long)cabecera->boletasPorChunk;
+    long long restantes = (long long)cabecera->numBoletas - inicio;
+    return restantes < cabecera->boletasPorChunk ? restantes : cabecera->boletasPorChunk;
+}
+
+// Bytes de datos de un chunk completo: sus bits redondeados a bytes y 16 de relleno
+// para las lecturas de 8 bytes de la ultima boleta
+static size_t bytesChunk(int numCandidatos, long long boletas) {
+    return (size_t)((boletas * numCandidatos + 7) / 8 + 16);
+}
+
+static void empaquetarChunk(const AlmacenBoletas *almacen, long long inicio, long long boletas,
+                            uint8_t *datos) {
+    int numCandidatos = almacen->numCandidatos;
+    memset(datos, 0, bytesChunk(numCandidatos, boletas));
+    for (long long i = 0; i < boletas; i++) {
+        uint64_t posicion = (uint64_t)i * numCandidatos;
+        if (almacen->palabras == 1) {
+            escribirBits(datos, posicion, numCandidatos, leerMascara(almacen, inicio + i));
+            continue;
+        }
+        const uint64_t *boleta = palabrasBoleta(almacen, inicio + i);
+        for (int w = 0; w * 64 < numCandidatos; w++) {
+            int n = numCandidatos - w * 64 < 64 ? numCandidatos - w * 64 : 64;
+            escribirBits(datos, posicion + (uint64_t)w * 64, n, boleta[w]);
+        }
+    }
+}
+
+// Hasta 16 candidatos, 8 boletas ocupan justo numCandidatos bytes: con numCandidatos
+// constante todos los desplazamientos de cada grupo de 8 se conocen al compilar
+static inline __attribute__((always_inline))
+void decodificarGrupos16(const uint8_t *datos, uint16_t *destino, long long grupos, const int numCandidatos) {
+    const uint64_t mascara = (1ULL << numCandidatos) - 1;
+    for (long long g = 0; g < grupos; g++) {
+        const uint8_t *grupo = datos + g * numCandidatos;
+        #pragma GCC unroll 8
+        for (int k = 0; k < 8; k++) {
+            uint64_t palabra;
+            memcpy(&palabra, grupo + (k * numCandidatos >> 3), 8);
+            destino[g * 8 + k] = (uint16_t)((palabra >> (k * numCandidatos & 7)) & mascara);
+        }
+    }
+}
+
+#define CASO_DECODIFICAR16(c) case c: decodificarGrupos16(datos, destino, grupos, c); break;
+
+static void decodificarChunk16(const uint8_t *datos, uint16_t *destino, long long boletas, int numCandidatos) {
+    long long grupos = boletas / 8;
+    switch (numCandidatos) {
+        CASO_DECODIFICAR16(1)  CASO_DECODIFICAR16(2)  CASO_DECODIFICAR16(3)  CASO_DECODIFICAR16(4)
+        CASO_DECODIFICAR16(5)  CASO_DECODIFICAR16(6)  CASO_DECODIFICAR16(7)  CASO_DECODIFICAR16(8)
+        CASO_DECODIFICAR16(9)  CASO_DECODIFICAR16(10) CASO_DECODIFICAR16(11) CASO_DECODIFICAR16(12)
+        CASO_DECODIFICAR16(13) CASO_DECODIFICAR16(14) CASO_DECODIFICAR16(15) CASO_DECODIFICAR16(16)
+    }
+    uint64_t mascara = (1ULL << numCandidatos) - 1;
+    for (long long i = grupos * 8; i < boletas; i++) {
+        destino[i] = (uint16_t)leerBitsCortos(datos, (uint64_t)i * numCandidatos, mascara);
+    }
+}
+
+// Desempaqueta las boletas de un chunk en las posiciones 0.. de la ventana, con un
+// bucle por ancho de mascara para no decidir el ancho en cada boleta
+void decodificarChunk(const ContenedorBoletas *contenedor, long long chunk, const uint8_t *datos,
+                      AlmacenBoletas *ventana) {
+    int numCandidatos = (int)contenedor->cabecera.numCandidatos;
+    long long boletas = boletasDelChunk(&contenedor->cabecera, chunk);
+    uint64_t mascara = numCandidatos < 64 ? (1ULL << numCandidatos) - 1 : ~0ULL;
+    ventana->numBoletas = boletas;
+
+    if (ventana->palabras == 1 && numCandidatos <= 57) {
+        switch (ventana->anchoBits) {
+            case 16:
+                decodificarChunk16(datos, (uint16_t *)ventana->datos, boletas, numCandidatos);
+                return;
+            case 32: {
+                uint32_t *destino = (uint32_t *)ventana->datos;
+                for (long long i = 0; i < boletas; i++) {
+                    destino[i] = (uint32_t)leerBitsCortos(datos, (uint64_t)i * numCandidatos, mascara);
+                }
+                return;
+            }
+            default: {
+                uint64_t *destino = (uint64_t *)ventana->datos;
+                for (long long i = 0; i < boletas; i++) {
+                    destino[i] = leerBitsCortos(datos, (uint64_t)i * numCandidatos, mascara);
+                }
+                return;
+            }
+        }
+    }
+
+    for (long long i = 0; i < boletas; i++) {
+        uint64_t posicion = (uint64_t)i * numCandidatos;
+        if (ventana->palabras == 1) {
+            escribirMascara(ventana, i, leerBits(datos, posicion, numCandidatos));
+            continue;
+        }
+        uint64_t *boleta = palabrasBoleta(ventana, i);
+        for (int w = 0; w < ventana->palabras; w++) {
+            int n = numCandidatos - w * 64;
+            boleta[w] = n <= 0 ? 0 : leerBits(datos, posicion + (uint64_t)w * 64, n < 64 ? n : 64);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Archivo: cabecera | chunks | indice (desplazamiento, bytes y CRC de cada chunk)
+// ---------------------------------------------------------------------------
+
+static uint32_t crcCabecera(const CabeceraContenedor *cabecera) {
+    return calcularCrc32c(cabecera, offsetof(CabeceraContenedor, crcCabecera));
+}
+
+// Lee o escribe bytes en una posicion del archivo. Con pread/pwrite los hilos no
+// comparten posicion; en Windows se turnan.
+static int accesoPosicional(ContenedorBoletas *contenedor, void *buffer, size_t bytes,
+                            long long desplazamiento, int escribir) {
+    #ifdef _WIN32
+        size_t hechos;
+        #pragma omp critical(archivoContenedor)
+        {
+            _fseeki64(contenedor->archivo, desplazamiento, SEEK_SET);
+            hechos = escribir ? fwrite(buffer, 1, bytes, contenedor->archivo)
+                              : fread(buffer, 1, bytes, contenedor->archivo);
+        }
+        return hechos == bytes ? 0 : -1;
+    #else
+        size_t hechos = 0;
+        while (hechos < bytes) {
+            ssize_t n = escribir
+                ? pwrite(contenedor->descriptor, (char *)buffer + hechos, bytes - hechos, (off_t)(desplazamiento + hechos))
+                : pread(contenedor->descriptor, (char *)buffer + hechos, bytes - hechos, (off_t)(desplazamiento + hechos));
+            if (n <= 0) {
+                return -1;
+            }
+            hechos += (size_t)n;
+        }
+        return 0;
+    #endif
+}
+
+static int abrirArchivoContenedor(ContenedorBoletas *contenedor, const char *ruta, int escribir) {
+    #ifdef _WIN32
+        contenedor->archivo = fopen(ruta, escribir ? "wb+" : "rb");
+        return contenedor->archivo != NULL ? 0 : -1;
+    #else
+        contenedor->descriptor = escribir ? open(ruta, O_RDWR | O_CREAT | O_TRUNC, 0644)
+                                          : open(ruta, O_RDONLY);
+        return contenedor->descriptor >= 0 ? 0 : -1;
+    #endif
+}
+
+int esArchivoContenedor(const char *ruta) {
+    char magia[8];
+    FILE *archivo = fopen(ruta, "rb");
+    if (archivo == NULL) {
+        return 0;
+    }
+    int leidos = (int)fread(magia, 1, sizeof(magia), archivo);
+    fclose(archivo);
+    return leidos == 8 && memcmp(magia, MAGIA_CONTENEDOR, 8) == 0;
+}
+
+int esRutaContenedor(const char *ruta) {
+    size_t largo = strlen(ruta), largoExtension = strlen(EXTENSION_CONTENEDOR);
+    return largo >= largoExtension && strcmp(ruta + largo - largoExtension, EXTENSION_CONTENEDOR) == 0;
+}
+
+// Escribe el almacen como contenedor: cada hilo empaqueta sus chunks y los escribe
+// en su sitio (el tamano de cada chunk se conoce de antemano)
+int exportarContenedor(const AlmacenBoletas *almacen, const char *ruta, int numHilos) {
+    ContenedorBoletas contenedor;
+    CabeceraContenedor *cabecera = &contenedor.cabecera;
+    memset(&contenedor, 0, sizeof(contenedor));
+    memcpy(cabecera->magia, MAGIA_CONTENEDOR, 8);
+    cabecera->version = VERSION_CONTENEDOR;
+    cabecera->numCandidatos = (uint32_t)almacen->numCandidatos;
+    cabecera->numBoletas = (uint64_t)almacen->numBoletas;
+    cabecera->boletasPorChunk = BOLETAS_POR_CHUNK;
+    cabecera->numChunks = (cabecera->numBoletas + BOLETAS_POR_CHUNK - 1) / BOLETAS_POR_CHUNK;
+
+    long long numChunks = (long long)cabecera->numChunks;
+    size_t bytesCompleto = bytesChunk(almacen->numCandidatos, BOLETAS_POR_CHUNK);
+    contenedor.indice = (EntradaChunk *)calloc(numChunks + 1, sizeof(EntradaChunk));
+    if (contenedor.indice == NULL) {
+        printf("Error: No se pudo reservar memoria para el indice de chunks\n");
+        return -1;
+    }
+    for (long long c = 0; c < numChunks; c++) {
+        contenedor.indice[c].desplazamiento = sizeof(CabeceraContenedor) + (uint64_t)c * bytesCompleto;
+        contenedor.indice[c].bytes = (uint32_t)bytesChunk(almacen->numCandidatos, boletasDelChunk(cabecera, c));
+    }
+    cabecera->inicioIndice = sizeof(CabeceraContenedor) + (uint64_t)numChunks * bytesCompleto;
+
+    if (abrirArchivoContenedor(&contenedor, ruta, 1) != 0) {
+        printf("Error: No se pudo crear el archivo '%s'\n", ruta);
+        free(contenedor.indice);
+        return -1;
+    }
+
+    int errores = 0;
+    #pragma omp parallel num_threads(numHilos) reduction(+:errores)
+    {
+        uint8_t *datos = (uint8_t *)malloc(bytesCompleto);
+        #pragma omp for schedule(dynamic)
+        for (long long c = 0; c < numChunks; c++) {
+            EntradaChunk *entrada = &contenedor.indice[c];
+            if (datos == NULL) {
+                errores++;
+                continue;
+            }
+            empaquetarChunk(almacen, c * BOLETAS_POR_CHUNK, boletasDelChunk(cabecera, c), datos);
+            entrada->crc = calcularCrc32c(datos, entrada->bytes);
+            errores += accesoPosicional(&contenedor, datos, entrada->bytes,
+                                        (long long)entrada->desplazamiento, 1) != 0;
+        }
+        free(datos);
+    }
+
+    size_t bytesIndice = (size_t)numChunks * sizeof(EntradaChunk);
+    cabecera->crcIndice = calcularCrc32c(contenedor.indice, bytesIndice);
+    cabecera->crcCabecera = crcCabecera(cabecera);
+    errores += accesoPosicional(&contenedor, contenedor.indice, bytesIndice,
+                                (long long)cabecera->inicioIndice, 1) != 0;
+    errores += accesoPosicional(&contenedor, cabecera, sizeof(CabeceraContenedor), 0, 1) != 0;
+    cerrarContenedor(&contenedor);
+
+    if (errores > 0) {
+        printf("Error: No se pudo escribir el contenedor '%s'\n", ruta);
+        return -1;
+    }
+    printf("Boletas exportadas a '%s' (%lld chunks, %.1f MB)\n", ruta, numChunks,
+           (cabecera->inicioIndice + bytesIndice) / 1e6);
+    return 0;
+}
+
+// Abre un contenedor y comprueba cabecera e indice; los chunks se verifican al leerlos
+int abrirContenedor(ContenedorBoletas *contenedor, const char *ruta) {
+    CabeceraContenedor *cabecera = &contenedor->cabecera;
+    memset(contenedor, 0, sizeof(*contenedor));
+    if (abrirArchivoContenedor(contenedor, ruta, 0) != 0) {
+        printf("Error: No se pudo abrir el archivo de boletas '%s'\n", ruta);
+        return -1;
+    }
+    if (accesoPosicional(contenedor, cabecera, sizeof(CabeceraContenedor), 0, 0) != 0 ||
+        memcmp(cabecera->magia, MAGIA_CONTENEDOR, 8) != 0) {
+        printf("Error: '%s' no es un contenedor de boletas\n", ruta);
+        cerrarContenedor(contenedor);
+        return -1;
+    }
+    if (cabecera->version != VERSION_CONTENEDOR || cabecera->crcCabecera != crcCabecera(cabecera)) {
+        printf("Error: Cabecera del contenedor '%s' danada o de otra version\n", ruta);
+        cerrarContenedor(contenedor);
+        return -1;
+    }
+    if (cabecera->numCandidatos == 0 || cabecera->numCandidatos > MAX_CANDIDATOS ||
+        cabecera->numBoletas > (uint64_t)MAX_BOLETAS || cabecera->boletasPorChunk == 0 ||
+        cabecera->numChunks != (cabecera->numBoletas + cabecera->boletasPorChunk - 1) / cabecera->boletasPorChunk) {
+        printf("Error: Cabecera del contenedor '%s' con valores fuera de rango\n", ruta);
+        cerrarContenedor(contenedor);
+        return -1;
+    }
+
+    size_t bytesIndice = (size_t)cabecera->numChunks * sizeof(EntradaChunk);
+    contenedor->indice = (EntradaChunk *)malloc(bytesIndice + 1);
+    if (contenedor->indice == NULL ||
+        accesoPosicional(contenedor, contenedor->indice, bytesIndice, (long long)cabecera->inicioIndice, 0) != 0 ||
+        calcularCrc32c(contenedor->indice, bytesIndice) != cabecera->crcIndice) {
+        printf("Error: Indice de chunks del contenedor '%s' danado\n", ruta);
+        cerrarContenedor(contenedor);
+        return -1;
+    }
+    contenedor->bytesChunkMax = bytesChunk((int)cabecera->numCandidatos, cabecera->boletasPorChunk);
+    contenedor->tamanoArchivo = (long long)(cabecera->inicioIndice + bytesIndice);
+    return 0;
+}
+
+// Lee un chunk en datos (al menos bytesChunkMax) y comprueba su CRC. Se puede llamar
+// desde varios hilos a la vez con buffers distintos.
+int leerChunk(ContenedorBoletas *contenedor, long long chunk, uint8_t *datos) {
+    const EntradaChunk *entrada = &contenedor->indice[chunk];
+    if (entrada->bytes > contenedor->bytesChunkMax ||
+        accesoPosicional(contenedor, datos, entrada->bytes, (long long)entrada->desplazamiento, 0) != 0) {
+        return -1;
+    }
+    return calcularCrc32c(datos, entrada->bytes) == entrada->crc ? 0 : -1;
+}
+
+void cerrarContenedor(ContenedorBoletas *contenedor) {
+    #ifdef _WIN32
+        if (contenedor->archivo != NULL) fclose(contenedor->archivo);
+        contenedor->archivo = NULL;
+    #else
+        if (contenedor->descriptor >= 0) close(contenedor->descriptor);
+        contenedor->descriptor = -1;
+    #endif
+    free(contenedor->indice);
+    contenedor->indice = NULL;
+}
@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <omp.h>
+
+#ifdef _WIN32
+    #include <io.h>
+    #include <fcntl.h>
+    #include <process.h>
+    #define open _open
+    #define read _read
+    #define write _write
+    #define close _close
+    #define lseek _lseeki64
+    #define unlink _unlink
+    #define fdatasync(descriptor) _commit(descriptor)
+    #define ftruncate(descriptor, bytes) _chsize_s(descriptor, bytes)
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#include "votos.h"
+
+static size_t bytesRegistroTramo(int numCandidatos) {
+    return sizeof(RegistroTramo) + (size_t)(numCandidatos + 1) * sizeof(long long);
+}
+
+static uint64_t sumaTramo(uint32_t tramo, const long long *conteo, int numCandidatos) {
+    uint64_t suma = mezclarBits(MAGIA_TRAMO ^ ((uint64_t)tramo << 32));
+    for (int i = 0; i <= numCandidatos; i++) {
+        suma = mezclarBits(suma ^ (uint64_t)conteo[i]);
+    }
+    return suma;
+}
+
+static int leerCompleto(int descriptor, void *buffer, size_t bytes) {
+    size_t hechos = 0;
+    while (hechos < bytes) {
+        long n = (long)read(descriptor, (char *)buffer + hechos, bytes - hechos);
+        if (n <= 0) {
+            return -1;
+        }
+        hechos += (size_t)n;
+    }
+    return 0;
+}
+
+static int escribirCompleto(int descriptor, const void *buffer, size_t bytes) {
+    size_t hechos = 0;
+    while (hechos < bytes) {
+        long n = (long)write(descriptor, (const char *)buffer + hechos, bytes - hechos);
+        if (n <= 0) {
+            return -1;
+        }
+        hechos += (size_t)n;
+    }
+    return 0;
+}
+
+// Lee los tramos ya registrados. Se queda con los validos hasta el primero roto (una
+// escritura a medias de la caida) y corta el archivo ahi para seguir anexando.
+static int cargarTramos(RegistroControl *registro, long long tamano) {
+    size_t bytesTramo = bytesRegistroTramo(registro->numCandidatos);
+    long long posicion = sizeof(CabeceraRegistro);
+    RegistroTramo *leido = (RegistroTramo *)malloc(bytesTramo);
+    if (leido == NULL) {
+        return -1;
+    }
+    const long long *conteo = (const long long *)(leido + 1);
+
+    while (posicion + (long long)bytesTramo <= tamano) {
+        if (leerCompleto(registro->descriptor, leido, bytesTramo) != 0 || leido->magia != MAGIA_TRAMO ||
+            leido->tramo >= registro->numTramos ||
+            leido->suma != sumaTramo(leido->tramo, conteo, registro->numCandidatos)) {
+            break;
+        }
+        // Un tramo repetido no se vuelve a sumar
+        if (!registro->tramosContados[leido->tramo]) {
+            registro->tramosContados[leido->tramo] = 1;
+            registro->tramosReanudados++;
+            for (int i = 0; i <= registro->numCandidatos; i++) {
+                registro->votosReanudados[i] += conteo[i];
+            }
+        }
+        posicion += bytesTramo;
+    }
+    free(leido);
+
+    registro->bytesDescartados = tamano - posicion;
+    if (registro->bytesDescartados > 0 && ftruncate(registro->descriptor, posicion) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int abrirRegistroControl(RegistroControl *registro, const char *ruta, long long numBoletas,
+                         int numCandidatos, uint64_t semilla) {
+    memset(registro, 0, sizeof(*registro));
+    registro->ruta = ruta;
+    registro->numCandidatos = numCandidatos;
+    registro->boletasPorTramo = BOLETAS_POR_TRAMO;
+    registro->numTramos = (numBoletas + BOLETAS_POR_TRAMO - 1) / BOLETAS_POR_TRAMO;
+    registro->caerTrasTramos = -1;
+    if (registro->numTramos > UINT32_MAX) {
+        printf("Error: Demasiados tramos para el registro de puntos de control\n");
+        return -1;
+    }
+    registro->tramosContados = (unsigned char *)calloc(registro->numTramos, 1);
+    registro->votosReanudados = (long long *)calloc(numCandidatos + 1, sizeof(long long));
+    if (registro->tramosContados == NULL || registro->votosReanudados == NULL) {
+        printf("Error: No se pudo reservar memoria para el registro de puntos de control\n");
+        free(registro->tramosContados);
+        free(registro->votosReanudados);
+        return -1;
+    }
+
+    // O_APPEND: cada tramo va al final con una sola escritura, sin cerrojo entre hilos
+    #ifdef _WIN32
+        registro->descriptor = open(ruta, _O_RDWR | _O_CREAT | _O_APPEND | _O_BINARY, 0644);
+    #else
+        registro->descriptor = open(ruta, O_RDWR | O_CREAT | O_APPEND, 0644);
+    #endif
+    if (registro->descriptor < 0) {
+        printf("Error: No se pudo abrir el registro de puntos de control %s\n", ruta);
+        free(registro->tramosContados);
+        free(registro->votosReanudados);
+        return -1;
+    }
+
+    CabeceraRegistro esperada = {MAGIA_REGISTRO, (uint32_t)numCandidatos, (uint64_t)numBoletas, semilla,
+                                 (uint64_t)BOLETAS_POR_TRAMO};
+    long long tamano = (long long)lseek(registro->descriptor, 0, SEEK_END);
+    lseek(registro->descriptor, 0, SEEK_SET);
+    int error = 0;
+    if (tamano < (long long)sizeof(CabeceraRegistro)) {
+        // Registro nuevo (o sin cabecera completa): se empieza de cero
+        error = ftruncate(registro->descriptor, 0) != 0 ||
+                escribirCompleto(registro->descriptor, &esperada, sizeof(esperada)) != 0 ||
+                fdatasync(registro->descriptor) != 0;
+    } else {
+        CabeceraRegistro cabecera;
+        error = leerCompleto(registro->descriptor, &cabecera, sizeof(cabecera)) != 0;
+        if (!error && memcmp(&cabecera, &esperada, sizeof(cabecera)) != 0) {
+            printf("Error: El registro %s es de otro conteo (boletas, candidatos o semilla distintos)\n", ruta);
+            close(registro->descriptor);
+            free(registro->tramosContados);
+            free(registro->votosReanudados);
+            return -1;
+        }
+        error = error || cargarTramos(registro, tamano) != 0;
+    }
+    if (error) {
+        printf("Error: No se pudo preparar el registro de puntos de control %s\n", ruta);
+        close(registro->descriptor);
+        free(registro->tramosContados);
+        free(registro->votosReanudados);
+        return -1;
+    }
+
+    omp_init_lock(&registro->cerrojoDisco);
+    registro->ultimaSincronizacion = obtenerTiempoAlta();
+    return 0;
+}
+
+int leerSemillaRegistro(const char *ruta, uint64_t *semilla) {
+    #ifdef _WIN32
+        int descriptor = open(ruta, _O_RDONLY | _O_BINARY);
+    #else
+        int descriptor = open(ruta, O_RDONLY);
+    #endif
+    if (descriptor < 0) {
+        return -1;
+    }
+    CabeceraRegistro cabecera;
+    int error = leerCompleto(descriptor, &cabecera, sizeof(cabecera)) != 0 || cabecera.magia != MAGIA_REGISTRO;
+    close(descriptor);
+    if (error) {
+        return -1;
+    }
+    *semilla = cabecera.semilla;
+    return 0;
+}
+
+void simularCaidaRegistro(RegistroControl *registro, long long tramos) {
+    registro->caerTrasTramos = tramos;
+}
+
+// Lo llama el hilo que termino el tramo. La escritura es inmediata; la sincronizacion
+// la hace un solo hilo cada INTERVALO_SINCRONIZACION y los demas no lo esperan.
+void registrarTramo(RegistroControl *registro, long long tramo, const long long *conteo) {
+    size_t bytesTramo = bytesRegistroTramo(registro->numCandidatos);
+    uint64_t buffer[sizeof(RegistroTramo) / sizeof(uint64_t) + MAX_CANDIDATOS + 1];
+    RegistroTramo *cabecera = (RegistroTramo *)buffer;
+    cabecera->magia = MAGIA_TRAMO;
+    cabecera->tramo = (uint32_t)tramo;
+    cabecera->suma = sumaTramo((uint32_t)tramo, conteo, registro->numCandidatos);
+    memcpy(cabecera + 1, conteo, (size_t)(registro->numCandidatos + 1) * sizeof(long long));
+    if (escribirCompleto(registro->descriptor, buffer, bytesTramo) != 0) {
+        printf("Error: No se pudo escribir el tramo %lld en el registro\n", tramo);
+        return;
+    }
+
+    long long escritos;
+    #pragma omp atomic capture
+    escritos = ++registro->tramosEscritos;
+    if (escritos == registro->caerTrasTramos) {
+        printf("Simulando una caida tras %lld tramos registrados\n", escritos);
+        fflush(stdout);
+        _exit(3);
+    }
+
+    if (obtenerTiempoAlta() - registro->ultimaSincronizacion >= INTERVALO_SINCRONIZACION &&
+        omp_test_lock(&registro->cerrojoDisco)) {
+        fdatasync(registro->descriptor);
+        registro->sincronizaciones++;
+        registro->ultimaSincronizacion = obtenerTiempoAlta();
+        omp_unset_lock(&registro->cerrojoDisco);
+    }
+}
+
+int cerrarRegistroControl(RegistroControl *registro, int completo) {
+    int error = fdatasync(registro->descriptor) != 0;
+    registro->sincronizaciones++;
+    close(registro->descriptor);
+    omp_destroy_lock(&registro->cerrojoDisco);
+    if (completo && !error) {
+        unlink(registro->ruta);
+    }
+    free(registro->tramosContados);
+    free(registro->votosReanudados);
+    registro->tramosContados = NULL;
+    registro->votosReanudados = NULL;
+    return error ? -1 : 0;
+}
@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <omp.h>
+
+#include "votos.h"
+
+#define LINEA_CACHE 64
+#define MAX_ETAPAS 64
+#define CANDIDATOS_MOSTRADOS 10
+
+// Estado de una pasada estimada. Cada bloque tiene su fila de conteos (candidatos y
+// nulos al final), alineada a una linea de cache para que los hilos no la compartan.
+typedef struct {
+    const AlmacenBoletas *almacen;
+    int numCandidatos;
+    int columnas;
+    int paso;
+    long long numBloques;
+    int numEstratos;
+    long long inicioEstrato[NUM_ESTRATOS + 1];
+    long long tomados[NUM_ESTRATOS];
+    // Bloques de cada estrato en orden aleatorio, uno tras otro
+    long long *orden;
+    long long *filas;
+    int filasEnArena;
+    long long *validos;
+    long long *boletas;
+    double *proporcion;
+    double *margen;
+} PasadaEstimada;
+
+static void liberarPasada(PasadaEstimada *pasada) {
+    free(pasada->orden);
+    liberarMemoriaConteo(pasada->filas, pasada->filasEnArena);
+    free(pasada->validos);
+    free(pasada->boletas);
+    free(pasada->proporcion);
+    free(pasada->margen);
+}
+
+static int prepararPasada(PasadaEstimada *pasada, const AlmacenBoletas *almacen, uint64_t semilla) {
+    int porLinea = LINEA_CACHE / (int)sizeof(long long);
+    memset(pasada, 0, sizeof(*pasada));
+    pasada->almacen = almacen;
+    pasada->numCandidatos = almacen->numCandidatos;
+    pasada->columnas = almacen->numCandidatos + 1;
+    pasada->paso = (pasada->columnas + porLinea - 1) / porLinea * porLinea;
+    pasada->numBloques = (almacen->numBoletas + BOLETAS_POR_BLOQUE - 1) / BOLETAS_POR_BLOQUE;
+    pasada->numEstratos = pasada->numBloques < NUM_ESTRATOS ? (int)pasada->numBloques : NUM_ESTRATOS;
+
+    size_t bloques = (size_t)(pasada->numBloques > 0 ? pasada->numBloques : 1);
+    pasada->orden = (long long *)malloc(bloques * sizeof(long long));
+    pasada->filas = (long long *)reservarMemoriaConteo(bloques * pasada->paso * sizeof(long long), LINEA_CACHE,
+                                                       &pasada->filasEnArena, NULL);
+    pasada->validos = (long long *)malloc(bloques * sizeof(long long));
+    pasada->boletas = (long long *)malloc(bloques * sizeof(long long));
+    pasada->proporcion = (double *)malloc(pasada->columnas * sizeof(double));
+    pasada->margen = (double *)malloc(pasada->columnas * sizeof(double));
+    if (pasada->orden == NULL || pasada->filas == NULL || pasada->validos == NULL ||
+        pasada->boletas == NULL || pasada->proporcion == NULL || pasada->margen == NULL) {
+        printf("Error: No se pudo reservar memoria para la estimacion de %lld bloques\n", pasada->numBloques);
+        liberarPasada(pasada);
+        return -1;
+    }
+
+    // Estratos de bloques seguidos (las boletas llegan por zonas y por hora); dentro
+    // de cada uno, una permutacion aleatoria
+    uint64_t estado = semilla;
+    for (int h = 0; h <= pasada->numEstratos; h++) {
+        pasada->inicioEstrato[h] = pasada->numEstratos > 0 ? pasada->numBloques * h / pasada->numEstratos : 0;
+    }
+    for (int h = 0; h < pasada->numEstratos; h++) {
+        long long inicio = pasada->inicioEstrato[h];
+        long long tamano = pasada->inicioEstrato[h + 1] - inicio;
+        for (long long i = 0; i < tamano; i++) {
+            pasada->orden[inicio + i] = inicio + i;
+        }
+        for (long long i = tamano - 1; i > 0; i--) {
+            estado = mezclarBits(estado);
+            long long j = (long long)((estado >> 32) * (uint64_t)(i + 1) >> 32);
+            long long t = pasada->orden[inicio + i];
+            pasada->orden[inicio + i] = pasada->orden[inicio + j];
+            pasada->orden[inicio + j] = t;
+        }
+    }
+    return 0;
+}
+
+// Estimador de razon estratificado: proporcion = Y / D con Y y D expandidos por
+// estrato (D son los validos, o las boletas para los nulos). La varianza sale de los
+// residuos y - p * d de los bloques de cada estrato, con correccion por poblacion
+// finita, asi que el margen llega a cero cuando se han contado todos los bloques.
+static void estimarProporciones(PasadaEstimada *pasada) {
+    for (int j = 0; j < pasada->columnas; j++) {
+        const long long *denominador = j < pasada->numCandidatos ? pasada->validos : pasada->boletas;
+        double totalY = 0, totalD = 0;
+        for (int h = 0; h < pasada->numEstratos; h++) {
+            long long tomados = pasada->tomados[h];
+            double expansion = (double)(pasada->inicioEstrato[h + 1] - pasada->inicioEstrato[h]) / tomados;
+            const long long *bloques = pasada->orden + pasada->inicioEstrato[h];
+            double sumaY = 0, sumaD = 0;
+            for (long long i = 0; i < tomados; i++) {
+                sumaY += pasada->filas[(size_t)bloques[i] * pasada->paso + j];
+                sumaD += denominador[bloques[i]];
+            }
+            totalY += expansion * sumaY;
+            totalD += expansion * sumaD;
+        }
+        double p = totalD > 0 ? totalY / totalD : 0;
+
+        double varianza = 0;
+        for (int h = 0; h < pasada->numEstratos; h++) {
+            long long tomados = pasada->tomados[h];
+            long long tamano = pasada->inicioEstrato[h + 1] - pasada->inicioEstrato[h];
+            if (tomados < 2 || tomados == tamano) {
+                continue;
+            }
+            const long long *bloques = pasada->orden + pasada->inicioEstrato[h];
+            double media = 0, cuadrados = 0;
+            for (long long i = 0; i < tomados; i++) {
+                double residuo = pasada->filas[(size_t)bloques[i] * pasada->paso + j] - p * denominador[bloques[i]];
+                media += residuo;
+                cuadrados += residuo * residuo;
+            }
+            media /= tomados;
+            double s2 = (cuadrados - tomados * media * media) / (tomados - 1);
+            varianza += (double)tamano * tamano * (1.0 - (double)tomados / tamano) * s2 / tomados;
+        }
+        pasada->proporcion[j] = p;
+        pasada->margen[j] = totalD > 0 && varianza > 0 ? Z_CONFIANZA_95 * sqrt(varianza) / totalD : 0;
+    }
+}
+
+int contarVotosEstimado(const AlmacenBoletas *almacen, const NivelSimd *nivel,
+                        long long *votosPorCandidato, long long *votosNulos, int numHilos,
+                        uint64_t semilla, PublicarEstimacion publicar, void *contexto) {
+    double inicio = obtenerTiempoAlta();
+    PasadaEstimada pasada;
+    if (prepararPasada(&pasada, almacen, semilla) != 0) {
+        return -1;
+    }
+    long long *pendientes = (long long *)malloc((size_t)(pasada.numBloques > 0 ? pasada.numBloques : 1) *
+                                                sizeof(long long));
+    if (pendientes == NULL) {
+        printf("Error: No se pudo reservar memoria para la estimacion\n");
+        liberarPasada(&pasada);
+        return -1;
+    }
+
+    int numCandidatos = pasada.numCandidatos;
+    long long contados = 0, boletasContadas = 0;
+    long long porEstrato = BLOQUES_PRIMERA_ETAPA;
+    for (int etapa = 1; contados < pasada.numBloques; etapa++, porEstrato *= 2) {
+        // Los bloques nuevos de la etapa: hasta porEstrato de cada estrato
+        long long numPendientes = 0;
+        for (int h = 0; h < pasada.numEstratos; h++) {
+            long long tamano = pasada.inicioEstrato[h + 1] - pasada.inicioEstrato[h];
+            long long hasta = porEstrato < tamano ? porEstrato : tamano;
+            for (long long i = pasada.tomados[h]; i < hasta; i++) {
+                pendientes[numPendientes++] = pasada.orden[pasada.inicioEstrato[h] + i];
+            }
+            pasada.tomados[h] = hasta;
+        }
+
+        long long boletasEtapa = 0;
+        #pragma omp parallel for schedule(static) num_threads(numHilos) reduction(+:boletasEtapa)
+        for (long long k = 0; k < numPendientes; k++) {
+            long long b = pendientes[k];
+            long long primera = b * BOLETAS_POR_BLOQUE;
+            long long fin = primera + BOLETAS_POR_BLOQUE < almacen->numBoletas ? primera + BOLETAS_POR_BLOQUE
+                                                                               : almacen->numBoletas;
+            long long *fila = pasada.filas + (size_t)b * pasada.paso;
+            memset(fila, 0, pasada.columnas * sizeof(long long));
+            nivel->funcion(almacen, primera, fin, fila, fila + numCandidatos);
+            long long validos = 0;
+            for (int i = 0; i < numCandidatos; i++) {
+                validos += fila[i];
+            }
+            pasada.validos[b] = validos;
+            pasada.boletas[b] = fin - primera;
+            boletasEtapa += fin - primera;
+        }
+        contados += numPendientes;
+        boletasContadas += boletasEtapa;
+
+        if (publicar != NULL) {
+            estimarProporciones(&pasada);
+            EstimacionConteo estimacion = {etapa, contados == pasada.numBloques, numCandidatos, contados,
+                                           pasada.numBloques, boletasContadas, obtenerTiempoAlta() - inicio,
+                                           pasada.proporcion, pasada.margen};
+            publicar(&estimacion, contexto);
+        }
+    }
+
+    // Totales exactos: suma de las filas de todos los bloques, por columnas
+    #pragma omp parallel for schedule(static) num_threads(numHilos)
+    for (int j = 0; j < pasada.columnas; j++) {
+        long long total = 0;
+        for (long long b = 0; b < pasada.numBloques; b++) {
+            total += pasada.filas[(size_t)b * pasada.paso + j];
+        }
+        if (j < numCandidatos) {
+            votosPorCandidato[j] = total;
+        } else {
+            *votosNulos = total;
+        }
+    }
+
+    free(pendientes);
+    liberarPasada(&pasada);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Modo de demostracion: publica cada etapa y, al final, cuantos intervalos
+// contenian el resultado exacto
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    int numEtapas;
+    int columnas;
+    EstimacionConteo etapas[MAX_ETAPAS];
+    double *proporciones;
+    double *margenes;
+} HistorialEstimacion;
+
+static void publicarEtapa(const EstimacionConteo *estimacion, void *contexto) {
+    HistorialEstimacion *historial = (HistorialEstimacion *)contexto;
+    int mostrados = estimacion->numCandidatos < CANDIDATOS_MOSTRADOS ? estimacion->numCandidatos
+                                                                     : CANDIDATOS_MOSTRADOS;
+    printf("\nEtapa %d%s: %lld de %lld bloques (%.1f%%), %lld boletas, %.3f ms\n", estimacion->etapa,
+           estimacion->exacta ? " (exacta)" : "", estimacion->bloquesContados, estimacion->numBloques,
+           100.0 * estimacion->bloquesContados / estimacion->numBloques, estimacion->boletasContadas,
+           estimacion->segundos * 1000);
+    for (int i = 0; i < mostrados; i++) {
+        printf("  Candidato %2d: %6.3f%% +- %.3f\n", i + 1, 100 * estimacion->proporcion[i],
+               100 * estimacion->margen[i]);
+    }
+    if (mostrados < estimacion->numCandidatos) {
+        printf("  ... (%d candidatos mas)\n", estimacion->numCandidatos - mostrados);
+    }
+    printf("  Nulos:        %6.3f%% +- %.3f\n", 100 * estimacion->proporcion[estimacion->numCandidatos],
+           100 * estimacion->margen[estimacion->numCandidatos]);
+
+    if (historial->numEtapas < MAX_ETAPAS) {
+        size_t desplazamiento = (size_t)historial->numEtapas * historial->columnas;
+        memcpy(historial->proporciones + desplazamiento, estimacion->proporcion, historial->columnas * sizeof(double));
+        memcpy(historial->margenes + desplazamiento, estimacion->margen, historial->columnas * sizeof(double));
+        historial->etapas[historial->numEtapas] = *estimacion;
+        historial->etapas[historial->numEtapas].proporcion = historial->proporciones + desplazamiento;
+        historial->etapas[historial->numEtapas].margen = historial->margenes + desplazamiento;
+        historial->numEtapas++;
+    }
+}
+
+int ejecutarModoEstimacion(long long numBoletas, int numCandidatos, int numHilos, uint64_t semilla) {
+    if (numHilos <= 0) {
+        numHilos = omp_get_max_threads();
+    }
+    AlmacenBoletas almacen;
+    if (crearAlmacenBoletas(&almacen, numBoletas, numCandidatos, 0) != 0) {
+        printf("Error: No se pudo reservar memoria para %lld boletas\n", numBoletas);
+        return -1;
+    }
+    HistorialEstimacion historial;
+    historial.numEtapas = 0;
+    historial.columnas = numCandidatos + 1;
+    historial.proporciones = (double *)malloc((size_t)MAX_ETAPAS * historial.columnas * sizeof(double));
+    historial.margenes = (double *)malloc((size_t)MAX_ETAPAS * historial.columnas * sizeof(double));
+    if (historial.proporciones == NULL || historial.margenes == NULL) {
+        printf("Error: No se pudo reservar memoria para el historial de la estimacion\n");
+        free(historial.proporciones);
+        free(historial.margenes);
+        liberarAlmacenBoletas(&almacen);
+        return -1;
+    }
+
+    printf("\n=== ESTIMACION TEMPRANA CON INTERVALOS DE CONFIANZA ===\n");
+    printf("%lld boletas, %d candidatos, %d hilos (semilla %llu)\n", numBoletas, numCandidatos, numHilos,
+           (unsigned long long)semilla);
+    generarBoletasAleatorias(&almacen, semilla, numHilos);
+    const NivelSimd *nivel = elegirNivelSimd(&almacen, NULL);
+
+    // Referencia: el conteo normal de las mismas boletas (mejor de 3)
+    long long *votos = (long long *)calloc(2 * (size_t)numCandidatos, sizeof(long long));
+    if (votos == NULL) {
+        printf("Error: No se pudo reservar memoria para los totales\n");
+        free(historial.proporciones);
+        free(historial.margenes);
+        liberarAlmacenBoletas(&almacen);
+        return -1;
+    }
+    long long *votosEstimados = votos + numCandidatos;
+    long long nulos = 0, nulosEstimados = 0;
+    double normal = 0;
+    for (int r = 0; r < 3; r++) {
+        double t = obtenerTiempoAlta();
+        contarVotosParalelo(&almacen, nivel, votos, &nulos, numHilos, NULL, NULL, NULL);
+        t = obtenerTiempoAlta() - t;
+        normal = r == 0 || t < normal ? t : normal;
+    }
+    printf("Conteo normal (contarVotosParalelo): %.3f ms\n", normal * 1000);
+    printf("Estratos: %d; intervalos al 95%% (candidatos sobre validos, nulos sobre boletas)\n", NUM_ESTRATOS);
+
+    int error = contarVotosEstimado(&almacen, nivel, votosEstimados, &nulosEstimados, numHilos, semilla,
+                                    publicarEtapa, &historial);
+    if (!error) {
+        int iguales = nulos == nulosEstimados &&
+                      memcmp(votos, votosEstimados, numCandidatos * sizeof(long long)) == 0;
+        long long validos = 0;
+        for (int i = 0; i < numCandidatos; i++) {
+            validos += votos[i];
+        }
+
+        printf("\n  %-6s %9s %11s %13s %12s %10s\n", "Etapa", "Bloques", "Tiempo ms", "% del normal",
+               "Margen max", "Cubiertos");
+        for (int e = 0; e < historial.numEtapas; e++) {
+            const EstimacionConteo *etapa = &historial.etapas[e];
+            double margenMaximo = 0;
+            int cubiertos = 0;
+            for (int j = 0; j <= numCandidatos; j++) {
+                double exacta = j < numCandidatos ? (validos > 0 ? (double)votos[j] / validos : 0)
+                                                  : (double)nulos / numBoletas;
+                margenMaximo = etapa->margen[j] > margenMaximo ? etapa->margen[j] : margenMaximo;
+                // Un poco de holgura para el redondeo de la etapa exacta
+                cubiertos += fabs(etapa->proporcion[j] - exacta) <= etapa->margen[j] + 1e-12;
+            }
+            printf("  %-6d %8.1f%% %11.3f %12.1f%% %11.3f%% %6d/%d\n", etapa->etapa,
+                   100.0 * etapa->bloquesContados / etapa->numBloques, etapa->segundos * 1000,
+                   100 * etapa->segundos / normal, 100 * margenMaximo, cubiertos, numCandidatos + 1);
+        }
+        printf("\nTotales de la ultima etapa: %s con contarVotosParalelo\n", iguales ? "coinciden" : "NO coinciden");
+        error = !iguales;
+    }
+
+    free(votos);
+    free(historial.proporciones);
+    free(historial.margenes);
+    liberarAlmacenBoletas(&almacen);
+    return error ? -1 : 0;
+}
@@ -0,0 +1,472 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <omp.h>
+
+#ifndef _WIN32
+    #include <errno.h>
+    #include <poll.h>
+    #include <signal.h>
+    #include <spawn.h>
+    #include <unistd.h>
+    #include <sys/socket.h>
+    #include <sys/wait.h>
+#endif
+
+#include "votos.h"
+
+static long long fragmentoConFallo = -1;
+static const char *programaTrabajador = NULL;
+
+void simularFalloFragmento(long long fragmento) {
+    fragmentoConFallo = fragmento;
+}
+
+void registrarProgramaFragmentos(const char *programa) {
+    programaTrabajador = programa;
+}
+
+#ifdef _WIN32
+
+int atenderFragmentos(int descriptor, const char *ruta, const char *isa, int numHilos) {
+    printf("Error: El conteo fragmentado necesita fork y sockets POSIX\n");
+    return -1;
+}
+
+int contarBackendFragmentos(const FuenteBoletas *fuente, const ParametrosConteo *parametros,
+                            ResultadoConteo *resultado) {
+    printf("Error: El conteo fragmentado necesita fork y sockets POSIX\n");
+    return -1;
+}
+
+#else
+
+// Lectura y escritura completas sobre el socket; MSG_NOSIGNAL evita que escribir a un
+// trabajador muerto mate al coordinador con SIGPIPE
+int recibirTodo(int descriptor, void *buffer, size_t bytes) {
+    size_t hechos = 0;
+    while (hechos < bytes) {
+        ssize_t n = recv(descriptor, (char *)buffer + hechos, bytes - hechos, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        hechos += (size_t)n;
+    }
+    return 0;
+}
+
+int enviarTodo(int descriptor, const void *buffer, size_t bytes) {
+    size_t hechos = 0;
+    while (hechos < bytes) {
+        ssize_t n = send(descriptor, (const char *)buffer + hechos, bytes - hechos, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        hechos += (size_t)n;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Trabajador: para cada peticion marca como ya contados los chunks fuera de su
+// rango y deja que contarContenedorParalelo cuente el resto con OpenMP
+// ---------------------------------------------------------------------------
+
+int atenderFragmentos(int descriptor, const char *ruta, const char *isa, int numHilos) {
+    ContenedorBoletas contenedor;
+    if (abrirContenedor(&contenedor, ruta) != 0) {
+        return -1;
+    }
+
+    int numCandidatos = (int)contenedor.cabecera.numCandidatos;
+    long long numChunks = (long long)contenedor.cabecera.numChunks;
+    AlmacenBoletas muestra;
+    unsigned char *chunksContados = (unsigned char *)malloc(numChunks > 0 ? numChunks : 1);
+    long long *conteos = (long long *)malloc((numCandidatos + 1) * sizeof(long long));
+    if (chunksContados == NULL || conteos == NULL ||
+        crearAlmacenBoletas(&muestra, 1, numCandidatos, 0) != 0) {
+        free(chunksContados);
+        free(conteos);
+        cerrarContenedor(&contenedor);
+        return -1;
+    }
+    const NivelSimd *nivel = elegirNivelSimd(&muestra, isa);
+
+    int estado = 0;
+    PeticionFragmento peticion;
+    while (recibirTodo(descriptor, &peticion, sizeof(peticion)) == 0) {
+        if (peticion.fragmento == FIN_FRAGMENTOS) {
+            break;
+        }
+        if (peticion.chunkInicio > peticion.chunkFin || peticion.chunkFin > (uint64_t)numChunks) {
+            estado = -1;
+            break;
+        }
+        if ((long long)peticion.fragmento == fragmentoConFallo && peticion.intento == 0) {
+            _exit(3);
+        }
+
+        memset(chunksContados, 1, numChunks);
+        memset(chunksContados + peticion.chunkInicio, 0, peticion.chunkFin - peticion.chunkInicio);
+        memset(conteos, 0, (numCandidatos + 1) * sizeof(long long));
+
+        RespuestaFragmento respuesta;
+        respuesta.fragmento = peticion.fragmento;
+        respuesta.numCandidatos = (uint32_t)numCandidatos;
+        respuesta.danados = (uint64_t)contarContenedorParalelo(&contenedor, nivel, conteos,
+                                                               &conteos[numCandidatos], numHilos,
+                                                               chunksContados, NULL);
+        respuesta.boletas = 0;
+        for (int i = 0; i <= numCandidatos; i++) {
+            respuesta.boletas += (uint64_t)conteos[i];
+        }
+
+        if (enviarTodo(descriptor, &respuesta, sizeof(respuesta)) != 0 ||
+            enviarTodo(descriptor, conteos, (numCandidatos + 1) * sizeof(long long)) != 0) {
+            estado = -1;
+            break;
+        }
+    }
+
+    liberarAlmacenBoletas(&muestra);
+    free(conteos);
+    free(chunksContados);
+    cerrarContenedor(&contenedor);
+    return estado;
+}
+
+// ---------------------------------------------------------------------------
+// Coordinador. Los trabajadores se lanzan con posix_spawn del mismo programa (ver
+// registrarProgramaFragmentos), no con fork: libgomp no admite usar OpenMP en un hijo
+// de fork si el padre ya tenia su equipo de hilos, y el coordinador puede tenerlo.
+// ---------------------------------------------------------------------------
+
+extern char **environ;
+
+enum { FRAGMENTO_PENDIENTE, FRAGMENTO_EN_CURSO, FRAGMENTO_TERMINADO };
+
+typedef struct {
+    long long chunkInicio;
+    long long chunkFin;
+    long long boletasEsperadas;
+    int estado;
+    int intentos;
+} Fragmento;
+
+typedef struct {
+    pid_t pid;
+    int descriptor;
+    int fragmento;    // el que esta contando, o -1 si esta libre
+} Trabajador;
+
+typedef struct {
+    Trabajador *trabajadores;
+    int numTrabajadores;
+    const char *ruta;
+    const char *isa;
+    int hilosPorTrabajador;
+} Coordinador;
+
+static int lanzarTrabajador(Coordinador *coordinador, int t) {
+    int par[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, par) != 0) {
+        return -1;
+    }
+
+    char descriptor[16], hilos[16], fallo[24];
+    snprintf(descriptor, sizeof(descriptor), "%d", par[1]);
+    snprintf(hilos, sizeof(hilos), "%d", coordinador->hilosPorTrabajador);
+    snprintf(fallo, sizeof(fallo), "%lld", fragmentoConFallo);
+    char *argumentos[12];
+    int n = 0;
+    argumentos[n++] = (char *)programaTrabajador;
+    argumentos[n++] = "-trabajador-fragmentos";
+    argumentos[n++] = descriptor;
+    argumentos[n++] = "-archivo";
+    argumentos[n++] = (char *)coordinador->ruta;
+    argumentos[n++] = "-hilos";
+    argumentos[n++] = hilos;
+    if (coordinador->isa != NULL) {
+        argumentos[n++] = "-isa";
+        argumentos[n++] = (char *)coordinador->isa;
+    }
+    if (fragmentoConFallo >= 0) {
+        argumentos[n++] = "-fallo-fragmento";
+        argumentos[n++] = fallo;
+    }
+    argumentos[n] = NULL;
+
+    // El trabajador solo conserva su extremo del socket
+    posix_spawn_file_actions_t acciones;
+    posix_spawn_file_actions_init(&acciones);
+    posix_spawn_file_actions_addclose(&acciones, par[0]);
+    for (int otro = 0; otro < coordinador->numTrabajadores; otro++) {
+        if (coordinador->trabajadores[otro].descriptor >= 0) {
+            posix_spawn_file_actions_addclose(&acciones, coordinador->trabajadores[otro].descriptor);
+        }
+    }
+    fflush(stdout);
+    pid_t pid;
+    int error = posix_spawnp(&pid, programaTrabajador, &acciones, NULL, argumentos, environ);
+    posix_spawn_file_actions_destroy(&acciones);
+    close(par[1]);
+    if (error != 0) {
+        close(par[0]);
+        return -1;
+    }
+
+    coordinador->trabajadores[t].pid = pid;
+    coordinador->trabajadores[t].descriptor = par[0];
+    coordinador->trabajadores[t].fragmento = -1;
+    return 0;
+}
+
+static void cerrarTrabajador(Coordinador *coordinador, int t) {
+    Trabajador *trabajador = &coordinador->trabajadores[t];
+    if (trabajador->descriptor >= 0) {
+        close(trabajador->descriptor);
+        trabajador->descriptor = -1;
+    }
+    if (trabajador->pid > 0) {
+        waitpid(trabajador->pid, NULL, 0);
+        trabajador->pid = -1;
+    }
+}
+
+// Un trabajador que muere o responde algo incoherente se sustituye por otro, y su
+// fragmento vuelve a la cola mientras no agote sus intentos
+static int reemplazarTrabajador(Coordinador *coordinador, int t, Fragmento *fragmentos) {
+    int f = coordinador->trabajadores[t].fragmento;
+    if (coordinador->trabajadores[t].pid > 0) {
+        kill(coordinador->trabajadores[t].pid, SIGKILL);
+    }
+    cerrarTrabajador(coordinador, t);
+    coordinador->trabajadores[t].fragmento = -1;
+
+    if (f >= 0) {
+        fragmentos[f].estado = FRAGMENTO_PENDIENTE;
+        printf("  Fragmento %d: el trabajador termino sin responder (intento %d de %d)\n",
+               f, fragmentos[f].intentos, MAX_INTENTOS_FRAGMENTO);
+        if (fragmentos[f].intentos >= MAX_INTENTOS_FRAGMENTO) {
+            printf("Error: El fragmento %d fallo %d veces\n", f, fragmentos[f].intentos);
+            return -1;
+        }
+    }
+    if (lanzarTrabajador(coordinador, t) != 0) {
+        printf("Error: No se pudo lanzar un proceso trabajador\n");
+        return -1;
+    }
+    return 0;
+}
+
+int contarBackendFragmentos(const FuenteBoletas *fuente, const ParametrosConteo *parametros,
+                            ResultadoConteo *resultado) {
+    ContenedorBoletas contenedor;
+    if (fuente->rutaArchivo == NULL || !esArchivoContenedor(fuente->rutaArchivo)) {
+        printf("Error: El backend 'fragmentos' necesita un contenedor binario (%s)\n",
+               EXTENSION_CONTENEDOR);
+        return -1;
+    }
+    if (programaTrabajador == NULL) {
+        printf("Error: El backend 'fragmentos' no tiene programa trabajador registrado\n");
+        return -1;
+    }
+    if (abrirContenedor(&contenedor, fuente->rutaArchivo) != 0) {
+        return -1;
+    }
+    CabeceraContenedor cabecera = contenedor.cabecera;
+    long long tamanoArchivo = contenedor.tamanoArchivo;
+    cerrarContenedor(&contenedor);
+
+    int numCandidatos = resultado->numCandidatos;
+    long long numChunks = (long long)cabecera.numChunks;
+    int procesadores = omp_get_num_procs();
+    int numTrabajadores = parametros->numProcesos > 0 ? parametros->numProcesos
+                                                      : (procesadores < 4 ? procesadores : 4);
+    int numHilos = parametros->numHilos > 0 ? parametros->numHilos : procesadores;
+    int hilosPorTrabajador = numHilos / numTrabajadores > 0 ? numHilos / numTrabajadores : 1;
+
+    // Fragmentos de chunks consecutivos; varios por trabajador para repartir la carga
+    // y para que un reintento repita poco trabajo
+    long long numFragmentos = (long long)numTrabajadores * FRAGMENTOS_POR_PROCESO;
+    if (numFragmentos > numChunks) {
+        numFragmentos = numChunks > 0 ? numChunks : 1;
+    }
+    Fragmento *fragmentos = (Fragmento *)calloc(numFragmentos, sizeof(Fragmento));
+    Trabajador *trabajadores = (Trabajador *)malloc(numTrabajadores * sizeof(Trabajador));
+    long long *parcial = (long long *)malloc((numCandidatos + 1) * sizeof(long long));
+    struct pollfd *esperas = (struct pollfd *)malloc(numTrabajadores * sizeof(struct pollfd));
+    if (fragmentos == NULL || trabajadores == NULL || parcial == NULL || esperas == NULL) {
+        printf("Error: No se pudo reservar memoria para el coordinador\n");
+        free(fragmentos);
+        free(trabajadores);
+        free(parcial);
+        free(esperas);
+        return -1;
+    }
+    for (long long f = 0; f < numFragmentos; f++) {
+        fragmentos[f].chunkInicio = numChunks * f / numFragmentos;
+        fragmentos[f].chunkFin = numChunks * (f + 1) / numFragmentos;
+        long long boletaFin = fragmentos[f].chunkFin * (long long)cabecera.boletasPorChunk;
+        if (boletaFin > (long long)cabecera.numBoletas) {
+            boletaFin = (long long)cabecera.numBoletas;
+        }
+        fragmentos[f].boletasEsperadas = boletaFin - fragmentos[f].chunkInicio * (long long)cabecera.boletasPorChunk;
+        fragmentos[f].estado = FRAGMENTO_PENDIENTE;
+    }
+
+    Coordinador coordinador = {trabajadores, numTrabajadores, fuente->rutaArchivo, parametros->isa,
+                               hilosPorTrabajador};
+    for (int t = 0; t < numTrabajadores; t++) {
+        trabajadores[t].pid = -1;
+        trabajadores[t].descriptor = -1;
+        trabajadores[t].fragmento = -1;
+    }
+
+    int error = 0;
+    for (int t = 0; t < numTrabajadores && !error; t++) {
+        if (lanzarTrabajador(&coordinador, t) != 0) {
+            printf("Error: No se pudo lanzar un proceso trabajador\n");
+            error = 1;
+        }
+    }
+
+    long long terminados = 0, siguiente = 0, reintentos = 0;
+    while (!error && terminados < numFragmentos) {
+        // Cada trabajador libre recibe el siguiente fragmento pendiente
+        for (int t = 0; t < numTrabajadores && !error; t++) {
+            if (trabajadores[t].fragmento >= 0) {
+                continue;
+            }
+            long long f = -1;
+            for (long long k = 0; k < numFragmentos && f < 0; k++) {
+                long long candidato = (siguiente + k) % numFragmentos;
+                if (fragmentos[candidato].estado == FRAGMENTO_PENDIENTE) {
+                    f = candidato;
+                }
+            }
+            if (f < 0) {
+                break;
+            }
+            siguiente = f + 1;
+
+            PeticionFragmento peticion = {(uint32_t)f, (uint32_t)fragmentos[f].intentos,
+                                          (uint64_t)fragmentos[f].chunkInicio, (uint64_t)fragmentos[f].chunkFin};
+            fragmentos[f].estado = FRAGMENTO_EN_CURSO;
+            fragmentos[f].intentos++;
+            trabajadores[t].fragmento = (int)f;
+            if (enviarTodo(trabajadores[t].descriptor, &peticion, sizeof(peticion)) != 0) {
+                reintentos++;
+                error = reemplazarTrabajador(&coordinador, t, fragmentos) != 0;
+            }
+        }
+        if (error) {
+            break;
+        }
+
+        for (int t = 0; t < numTrabajadores; t++) {
+            esperas[t].fd = trabajadores[t].fragmento >= 0 ? trabajadores[t].descriptor : -1;
+            esperas[t].events = POLLIN;
+            esperas[t].revents = 0;
+        }
+        if (poll(esperas, numTrabajadores, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("Error: Fallo la espera de los trabajadores\n");
+            error = 1;
+            break;
+        }
+
+        for (int t = 0; t < numTrabajadores && !error; t++) {
+            if (esperas[t].fd < 0 || esperas[t].revents == 0) {
+                continue;
+            }
+            int f = trabajadores[t].fragmento;
+            RespuestaFragmento respuesta;
+            int valida = recibirTodo(trabajadores[t].descriptor, &respuesta, sizeof(respuesta)) == 0 &&
+                         respuesta.fragmento == (uint32_t)f &&
+                         respuesta.numCandidatos == (uint32_t)numCandidatos &&
+                         recibirTodo(trabajadores[t].descriptor, parcial,
+                                     (numCandidatos + 1) * sizeof(long long)) == 0;
+            if (!valida) {
+                reintentos++;
+                error = reemplazarTrabajador(&coordinador, t, fragmentos) != 0;
+                continue;
+            }
+            if (respuesta.danados > 0) {
+                printf("Error: %llu chunks del fragmento %d no pasaron la verificacion CRC\n",
+                       (unsigned long long)respuesta.danados, f);
+                error = 1;
+                continue;
+            }
+            if ((long long)respuesta.boletas != fragmentos[f].boletasEsperadas) {
+                printf("Error: El fragmento %d conto %llu boletas de %lld\n", f,
+                       (unsigned long long)respuesta.boletas, fragmentos[f].boletasEsperadas);
+                error = 1;
+                continue;
+            }
+
+            for (int i = 0; i < numCandidatos; i++) {
+                resultado->votosPorCandidato[i] += parcial[i];
+            }
+            resultado->votosNulos += parcial[numCandidatos];
+            fragmentos[f].estado = FRAGMENTO_TERMINADO;
+            trabajadores[t].fragmento = -1;
+            terminados++;
+        }
+    }
+
+    // Fin ordenado: los trabajadores vivos reciben FIN_FRAGMENTOS y se recogen todos
+    PeticionFragmento fin = {FIN_FRAGMENTOS, 0, 0, 0};
+    for (int t = 0; t < numTrabajadores; t++) {
+        if (trabajadores[t].descriptor >= 0) {
+            if (error && trabajadores[t].pid > 0) {
+                kill(trabajadores[t].pid, SIGKILL);
+            } else {
+                enviarTodo(trabajadores[t].descriptor, &fin, sizeof(fin));
+            }
+        }
+        cerrarTrabajador(&coordinador, t);
+    }
+
+    long long total = resultado->votosNulos;
+    for (int i = 0; i < numCandidatos; i++) {
+        total += resultado->votosPorCandidato[i];
+    }
+    if (!error && total != (long long)cabecera.numBoletas) {
+        printf("Error: Los fragmentos suman %lld boletas y el contenedor tiene %llu\n", total,
+               (unsigned long long)cabecera.numBoletas);
+        error = 1;
+    }
+    if (!error) {
+        printf("Fragmentos: %lld en %d procesos de %d hilos, %lld reintentos\n", numFragmentos,
+               numTrabajadores, hilosPorTrabajador, reintentos);
+    }
+
+    AlmacenBoletas muestra;
+    if (!error && crearAlmacenBoletas(&muestra, 1, numCandidatos, 0) == 0) {
+        resultado->kernel = elegirNivelSimd(&muestra, parametros->isa)->nombre;
+        resultado->anchoBits = muestra.anchoBits;
+        resultado->palabras = muestra.palabras;
+        resultado->bytesBoletas = (size_t)cabecera.boletasPorChunk * muestra.paso;
+        liberarAlmacenBoletas(&muestra);
+    }
+    resultado->numHilos = numTrabajadores * hilosPorTrabajador;
+    resultado->bytesLeidos = tamanoArchivo;
+
+    free(fragmentos);
+    free(trabajadores);
+    free(parcial);
+    free(esperas);
+    return error ? -1 : 0;
+}
+
+#endif
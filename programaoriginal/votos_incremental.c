@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "votos.h"
+
+// Lotes mas grandes que esto se cuentan con varios hilos
+#define BOLETAS_LOTE_PARALELO (1LL << 20)
+
+int crearConteoIncremental(ConteoIncremental *conteo, int numCandidatos, int numHilos) {
+    memset(conteo, 0, sizeof(*conteo));
+    if (numCandidatos <= 0 || numCandidatos > MAX_CANDIDATOS) {
+        printf("Error: Numero de candidatos debe estar entre 1 y %d\n", MAX_CANDIDATOS);
+        return -1;
+    }
+    conteo->numCandidatos = numCandidatos;
+    conteo->numHilos = numHilos > 0 ? numHilos : omp_get_max_threads();
+    conteo->votosPorCandidato = (long long *)calloc(numCandidatos, sizeof(long long));
+    if (conteo->votosPorCandidato == NULL) {
+        printf("Error: No se pudo reservar memoria para el conteo incremental\n");
+        return -1;
+    }
+    omp_init_lock(&conteo->cerrojoEscritura);
+    return 0;
+}
+
+void liberarConteoIncremental(ConteoIncremental *conteo) {
+    for (long long l = 0; l < conteo->numLotes; l++) {
+        free(conteo->conteoLote[l]);
+    }
+    free(conteo->conteoLote);
+    free(conteo->votosPorCandidato);
+    omp_destroy_lock(&conteo->cerrojoEscritura);
+    conteo->conteoLote = NULL;
+    conteo->votosPorCandidato = NULL;
+}
+
+// Cuenta un lote fuera del cerrojo: candidatos y, al final, los nulos y las boletas
+static long long *contarLote(const ConteoIncremental *conteo, const AlmacenBoletas *lote) {
+    if (lote->numCandidatos != conteo->numCandidatos) {
+        printf("Error: El lote tiene %d candidatos y el conteo %d\n",
+               lote->numCandidatos, conteo->numCandidatos);
+        return NULL;
+    }
+    long long *resultado = (long long *)malloc((conteo->numCandidatos + 2) * sizeof(long long));
+    if (resultado == NULL) {
+        printf("Error: No se pudo reservar memoria para el conteo del lote\n");
+        return NULL;
+    }
+
+    const NivelSimd *nivel = elegirNivelSimd(lote, NULL);
+    long long *nulos = &resultado[conteo->numCandidatos];
+    if (lote->numBoletas >= BOLETAS_LOTE_PARALELO && conteo->numHilos > 1) {
+        if (contarVotosParalelo(lote, nivel, resultado, nulos, conteo->numHilos, NULL, NULL, NULL) != 0) {
+            free(resultado);
+            return NULL;
+        }
+    } else {
+        contarVotosSecuencial(lote, nivel, resultado, nulos);
+    }
+    resultado[conteo->numCandidatos + 1] = lote->numBoletas;
+    return resultado;
+}
+
+// Suma (signo 1) o resta (signo -1) el conteo de un lote a los totales. Se llama con el
+// cerrojo tomado y dentro de una escritura del seqlock: la secuencia es impar mientras
+// los totales estan a medias, y los lectores descartan lo que copiaron en ese tiempo.
+static void aplicarLote(ConteoIncremental *conteo, const long long *conteoLote, int signo) {
+    for (int i = 0; i < conteo->numCandidatos; i++) {
+        long long valor = __atomic_load_n(&conteo->votosPorCandidato[i], __ATOMIC_RELAXED);
+        __atomic_store_n(&conteo->votosPorCandidato[i], valor + signo * conteoLote[i], __ATOMIC_RELAXED);
+    }
+    long long nulos = conteoLote[conteo->numCandidatos];
+    long long boletas = conteoLote[conteo->numCandidatos + 1];
+    __atomic_store_n(&conteo->votosNulos, conteo->votosNulos + signo * nulos, __ATOMIC_RELAXED);
+    __atomic_store_n(&conteo->numBoletas, conteo->numBoletas + signo * boletas, __ATOMIC_RELAXED);
+}
+
+// La secuencia solo es impar mientras se tocan los totales; la tabla de lotes, que los
+// lectores no usan, se cambia con el cerrojo tomado pero fuera de ese tramo
+static void empezarEscritura(ConteoIncremental *conteo) {
+    __atomic_store_n(&conteo->secuencia, conteo->secuencia + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void terminarEscritura(ConteoIncremental *conteo) {
+    __atomic_store_n(&conteo->secuencia, conteo->secuencia + 1, __ATOMIC_RELEASE);
+}
+
+long long agregarLote(ConteoIncremental *conteo, const AlmacenBoletas *lote) {
+    long long *conteoLote = contarLote(conteo, lote);
+    if (conteoLote == NULL) {
+        return -1;
+    }
+
+    omp_set_lock(&conteo->cerrojoEscritura);
+    if (conteo->numLotes == conteo->capacidadLotes) {
+        long long capacidad = conteo->capacidadLotes > 0 ? conteo->capacidadLotes * 2 : 64;
+        long long **nuevos = (long long **)realloc(conteo->conteoLote, capacidad * sizeof(long long *));
+        if (nuevos == NULL) {
+            omp_unset_lock(&conteo->cerrojoEscritura);
+            free(conteoLote);
+            printf("Error: No se pudo ampliar la tabla de lotes\n");
+            return -1;
+        }
+        conteo->conteoLote = nuevos;
+        conteo->capacidadLotes = capacidad;
+    }
+    long long idLote = conteo->numLotes++;
+    conteo->conteoLote[idLote] = conteoLote;
+
+    empezarEscritura(conteo);
+    aplicarLote(conteo, conteoLote, 1);
+    __atomic_store_n(&conteo->lotesActivos, conteo->lotesActivos + 1, __ATOMIC_RELAXED);
+    terminarEscritura(conteo);
+    omp_unset_lock(&conteo->cerrojoEscritura);
+    return idLote;
+}
+
+// Reemplaza el contenido de un lote ya contado: se resta lo que aporto y se suma el
+// lote corregido, sin volver a contar nada mas
+int corregirLote(ConteoIncremental *conteo, long long idLote, const AlmacenBoletas *loteCorregido) {
+    long long *conteoNuevo = contarLote(conteo, loteCorregido);
+    if (conteoNuevo == NULL) {
+        return -1;
+    }
+
+    omp_set_lock(&conteo->cerrojoEscritura);
+    if (idLote < 0 || idLote >= conteo->numLotes || conteo->conteoLote[idLote] == NULL) {
+        omp_unset_lock(&conteo->cerrojoEscritura);
+        free(conteoNuevo);
+        printf("Error: El lote %lld no existe o fue retirado\n", idLote);
+        return -1;
+    }
+    long long *conteoViejo = conteo->conteoLote[idLote];
+    conteo->conteoLote[idLote] = conteoNuevo;
+
+    empezarEscritura(conteo);
+    aplicarLote(conteo, conteoViejo, -1);
+    aplicarLote(conteo, conteoNuevo, 1);
+    terminarEscritura(conteo);
+    omp_unset_lock(&conteo->cerrojoEscritura);
+
+    free(conteoViejo);
+    return 0;
+}
+
+int retirarLote(ConteoIncremental *conteo, long long idLote) {
+    omp_set_lock(&conteo->cerrojoEscritura);
+    if (idLote < 0 || idLote >= conteo->numLotes || conteo->conteoLote[idLote] == NULL) {
+        omp_unset_lock(&conteo->cerrojoEscritura);
+        printf("Error: El lote %lld no existe o fue retirado\n", idLote);
+        return -1;
+    }
+    long long *conteoViejo = conteo->conteoLote[idLote];
+    conteo->conteoLote[idLote] = NULL;
+
+    empezarEscritura(conteo);
+    aplicarLote(conteo, conteoViejo, -1);
+    __atomic_store_n(&conteo->lotesActivos, conteo->lotesActivos - 1, __ATOMIC_RELAXED);
+    terminarEscritura(conteo);
+    omp_unset_lock(&conteo->cerrojoEscritura);
+
+    free(conteoViejo);
+    return 0;
+}
+
+// Copia los totales sin bloquear a los escritores: si la secuencia era impar o cambio
+// mientras se copiaba, alguien escribio a la vez y se vuelve a intentar. Devuelve el
+// numero de reintentos. votosPorCandidato debe tener sitio para numCandidatos.
+int tomarInstantanea(ConteoIncremental *conteo, InstantaneaConteo *instantanea) {
+    int reintentos = 0;
+    while (1) {
+        unsigned long long inicio = __atomic_load_n(&conteo->secuencia, __ATOMIC_ACQUIRE);
+        if ((inicio & 1) == 0) {
+            for (int i = 0; i < conteo->numCandidatos; i++) {
+                instantanea->votosPorCandidato[i] =
+                    __atomic_load_n(&conteo->votosPorCandidato[i], __ATOMIC_RELAXED);
+            }
+            instantanea->votosNulos = __atomic_load_n(&conteo->votosNulos, __ATOMIC_RELAXED);
+            instantanea->numBoletas = __atomic_load_n(&conteo->numBoletas, __ATOMIC_RELAXED);
+            instantanea->lotes = __atomic_load_n(&conteo->lotesActivos, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&conteo->secuencia, __ATOMIC_RELAXED) == inicio) {
+                instantanea->version = inicio / 2;
+                instantanea->numCandidatos = conteo->numCandidatos;
+                return reintentos;
+            }
+        }
+        reintentos++;
+    }
+}
@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <omp.h>
+
+#ifdef _WIN32
+    #include <malloc.h>
+#endif
+
+#ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/syscall.h>
+    #include <sys/ioctl.h>
+    #include <unistd.h>
+#endif
+
+#include "votos.h"
+
+// Instrumentacion por fase y por hilo: cada hilo abre su propio grupo de contadores
+// perf_event (solo cuenta ese hilo, en modo usuario) la primera vez que entra en una
+// fase, y suma en su fila lo que cambian entre empezarFase y terminarFase. Sin PMU
+// (maquinas virtuales, perf_event_paranoid alto) se usan contadores de software del
+// kernel, y si tampoco hay, solo el tiempo.
+
+#define MAX_HILOS_INSTRUMENTADOS 256
+
+static const char *nombresFases[NUM_FASES] = {"reserva", "generacion", "conteo", "mezcla", "salida"};
+
+#ifdef __linux__
+typedef struct {
+    uint32_t tipo;
+    uint64_t configuracion;
+    const char *nombre;
+} EventoPerf;
+
+static const EventoPerf eventosHardware[EVENTOS_INSTRUMENTACION] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "ciclos"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instrucciones"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "fallos LLC"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "fallos salto"},
+};
+
+static const EventoPerf eventosSoftware[EVENTOS_INSTRUMENTACION] = {
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, "task-clock ns"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, "fallos pagina"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "cambios ctx"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS, "migraciones"},
+};
+#endif
+
+typedef struct {
+    int descriptores[EVENTOS_INSTRUMENTACION];
+    int abiertos;
+    long tid;
+    uint64_t inicio[EVENTOS_INSTRUMENTACION];
+    double inicioTiempo;
+    uint64_t eventos[NUM_FASES][EVENTOS_INSTRUMENTACION];
+    double segundos[NUM_FASES];
+    long long veces[NUM_FASES];
+} __attribute__((aligned(64))) ContadoresPerfHilo;
+
+static ContadoresPerfHilo *hilosInstrumentados = NULL;
+static ModoInstrumentacion modoInstrumentacion = INSTRUMENTACION_APAGADA;
+
+#ifdef __linux__
+static long idHilo(void) {
+    return (long)syscall(SYS_gettid);
+}
+
+// Unico punto que llama a perf_event_open: solo el hilo que llama y solo en modo
+// usuario (los fallos de pagina se siguen contando: los provoca el codigo de usuario)
+static int abrirEventoPerf(const EventoPerf *evento, int lider, uint64_t formato) {
+    struct perf_event_attr atributos;
+    memset(&atributos, 0, sizeof(atributos));
+    atributos.size = sizeof(atributos);
+    atributos.type = evento->tipo;
+    atributos.config = evento->configuracion;
+    atributos.exclude_kernel = 1;
+    atributos.exclude_hv = 1;
+    atributos.read_format = formato | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &atributos, 0, -1, lider, 0);
+}
+
+// Abre el grupo (el primer evento es el lider) para el hilo que llama
+static int abrirGrupo(const EventoPerf *eventos, int *descriptores) {
+    int lider = -1;
+    for (int e = 0; e < EVENTOS_INSTRUMENTACION; e++) {
+        int fd = abrirEventoPerf(&eventos[e], lider, PERF_FORMAT_GROUP);
+        if (fd < 0) {
+            for (int k = 0; k < e; k++) {
+                close(descriptores[k]);
+            }
+            return -1;
+        }
+        descriptores[e] = fd;
+        if (lider < 0) {
+            lider = fd;
+        }
+    }
+    return 0;
+}
+
+// Lee el grupo de una vez y escala si el kernel tuvo que multiplexar contadores
+static void leerGrupo(const ContadoresPerfHilo *hilo, uint64_t *valores) {
+    uint64_t datos[3 + EVENTOS_INSTRUMENTACION];
+    if (read(hilo->descriptores[0], datos, sizeof(datos)) != (ssize_t)sizeof(datos)) {
+        memset(valores, 0, EVENTOS_INSTRUMENTACION * sizeof(uint64_t));
+        return;
+    }
+    double escala = datos[2] > 0 && datos[2] < datos[1] ? (double)datos[1] / datos[2] : 1.0;
+    for (int e = 0; e < EVENTOS_INSTRUMENTACION; e++) {
+        valores[e] = (uint64_t)(datos[3 + e] * escala);
+    }
+}
+
+static void cerrarGrupo(ContadoresPerfHilo *hilo) {
+    if (hilo->abiertos) {
+        for (int e = 0; e < EVENTOS_INSTRUMENTACION; e++) {
+            close(hilo->descriptores[e]);
+        }
+    }
+    hilo->abiertos = 0;
+}
+
+// Contadores sueltos: el de la TLB necesita PMU y no tiene equivalente de software,
+// asi que sin PMU se queda cerrado y quien lo usa lo muestra como no disponible
+static const EventoPerf eventosSueltos[NUM_CONTADORES_HILO] = {
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, "fallos pagina"},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), "fallos dTLB"},
+};
+#endif
+
+int abrirContadorHilo(ContadorHilo contador) {
+    #ifdef __linux__
+        return abrirEventoPerf(&eventosSueltos[contador], -1, 0);
+    #else
+        (void)contador;
+        return -1;
+    #endif
+}
+
+// Valor acumulado, escalado igual que los grupos si el kernel multiplexo
+uint64_t leerContadorHilo(int descriptor) {
+    #ifdef __linux__
+        uint64_t datos[3];
+        if (descriptor < 0 || read(descriptor, datos, sizeof(datos)) != (ssize_t)sizeof(datos)) {
+            return 0;
+        }
+        double escala = datos[2] > 0 && datos[2] < datos[1] ? (double)datos[1] / datos[2] : 1.0;
+        return (uint64_t)(datos[0] * escala);
+    #else
+        (void)descriptor;
+        return 0;
+    #endif
+}
+
+void cerrarContadorHilo(int descriptor) {
+    #ifdef __linux__
+        if (descriptor >= 0) {
+            close(descriptor);
+        }
+    #else
+        (void)descriptor;
+    #endif
+}
+
+// Elige el mejor modo que permita el sistema y deja listas las filas de los hilos
+ModoInstrumentacion activarInstrumentacion(void) {
+    if (hilosInstrumentados == NULL) {
+        // Una fila por linea de cache: calloc no garantiza los 64 bytes del tipo
+        size_t bytes = MAX_HILOS_INSTRUMENTADOS * sizeof(ContadoresPerfHilo);
+        #ifdef _WIN32
+            hilosInstrumentados = (ContadoresPerfHilo *)_aligned_malloc(bytes, 64);
+        #else
+            void *p = NULL;
+            if (posix_memalign(&p, 64, bytes) == 0) {
+                hilosInstrumentados = (ContadoresPerfHilo *)p;
+            }
+        #endif
+        if (hilosInstrumentados == NULL) {
+            printf("Error: No se pudo reservar memoria para la instrumentacion\n");
+            return INSTRUMENTACION_APAGADA;
+        }
+        memset(hilosInstrumentados, 0, bytes);
+    }
+    modoInstrumentacion = INSTRUMENTACION_TIEMPO;
+    #ifdef __linux__
+        int prueba[EVENTOS_INSTRUMENTACION];
+        if (abrirGrupo(eventosHardware, prueba) == 0) {
+            modoInstrumentacion = INSTRUMENTACION_HARDWARE;
+        } else if (abrirGrupo(eventosSoftware, prueba) == 0) {
+            modoInstrumentacion = INSTRUMENTACION_SOFTWARE;
+        }
+        if (modoInstrumentacion != INSTRUMENTACION_TIEMPO) {
+            for (int e = 0; e < EVENTOS_INSTRUMENTACION; e++) {
+                close(prueba[e]);
+            }
+        }
+    #endif
+    return modoInstrumentacion;
+}
+
+void terminarInstrumentacion(void) {
+    if (hilosInstrumentados == NULL) {
+        return;
+    }
+    #ifdef __linux__
+        for (int h = 0; h < MAX_HILOS_INSTRUMENTADOS; h++) {
+            cerrarGrupo(&hilosInstrumentados[h]);
+        }
+    #endif
+    #ifdef _WIN32
+        _aligned_free(hilosInstrumentados);
+    #else
+        free(hilosInstrumentados);
+    #endif
+    hilosInstrumentados = NULL;
+    modoInstrumentacion = INSTRUMENTACION_APAGADA;
+}
+
+static ContadoresPerfHilo *filaDelHilo(void) {
+    int h = omp_get_thread_num();
+    return h < MAX_HILOS_INSTRUMENTADOS ? &hilosInstrumentados[h] : NULL;
+}
+
+void empezarFase(FaseConteo fase) {
+    (void)fase;
+    if (modoInstrumentacion == INSTRUMENTACION_APAGADA) {
+        return;
+    }
+    ContadoresPerfHilo *hilo = filaDelHilo();
+    if (hilo == NULL) {
+        return;
+    }
+    #ifdef __linux__
+        // Si otro hilo del sistema ocupa ahora este numero de hilo OpenMP, sus
+        // contadores no sirven: se cierran y se abren para el hilo actual
+        if (modoInstrumentacion != INSTRUMENTACION_TIEMPO) {
+            long tid = idHilo();
+            if (!hilo->abiertos || hilo->tid != tid) {
+                cerrarGrupo(hilo);
+                const EventoPerf *eventos = modoInstrumentacion == INSTRUMENTACION_HARDWARE
+                                            ? eventosHardware : eventosSoftware;
+                hilo->abiertos = abrirGrupo(eventos, hilo->descriptores) == 0;
+                hilo->tid = tid;
+            }
+            if (hilo->abiertos) {
+                leerGrupo(hilo, hilo->inicio);
+            }
+        }
+    #endif
+    hilo->inicioTiempo = obtenerTiempoAlta();
+}
+
+void terminarFase(FaseConteo fase) {
+    if (modoInstrumentacion == INSTRUMENTACION_APAGADA) {
+        return;
+    }
+    ContadoresPerfHilo *hilo = filaDelHilo();
+    if (hilo == NULL) {
+        return;
+    }
+    hilo->segundos[fase] += obtenerTiempoAlta() - hilo->inicioTiempo;
+    hilo->veces[fase]++;
+    #ifdef __linux__
+        if (hilo->abiertos) {
+            uint64_t fin[EVENTOS_INSTRUMENTACION];
+            leerGrupo(hilo, fin);
+            for (int e = 0; e < EVENTOS_INSTRUMENTACION; e++) {
+                hilo->eventos[fase][e] += fin[e] - hilo->inicio[e];
+            }
+        }
+    #endif
+}
+
+static void imprimirFila(const char *etiqueta, double segundos, const uint64_t *eventos) {
+    printf("  %-14s %10.3f", etiqueta, segundos * 1000);
+    if (modoInstrumentacion == INSTRUMENTACION_TIEMPO) {
+        printf("\n");
+        return;
+    }
+    for (int e = 0; e < EVENTOS_INSTRUMENTACION; e++) {
+        printf(" %14llu", (unsigned long long)eventos[e]);
+    }
+    if (modoInstrumentacion == INSTRUMENTACION_HARDWARE) {
+        double instrucciones = (double)eventos[1];
+        printf(" %6.2f %8.2f %8.2f", eventos[0] > 0 ? instrucciones / eventos[0] : 0,
+               instrucciones > 0 ? eventos[2] * 1000.0 / instrucciones : 0,
+               instrucciones > 0 ? eventos[3] * 1000.0 / instrucciones : 0);
+    }
+    printf("\n");
+}
+
+// Informe por fase (suma de los hilos) y, en las fases con varios hilos, por hilo
+// con el desbalance (tiempo del hilo mas lento sobre la media)
+void mostrarInformeInstrumentacion(void) {
+    if (modoInstrumentacion == INSTRUMENTACION_APAGADA || hilosInstrumentados == NULL) {
+        return;
+    }
+    const char *modos[] = {"", "solo tiempo: perf_event no disponible",
+                           "contadores de software (no hay PMU accesible)", "contadores de hardware"};
+    printf("\n=== INSTRUMENTACION POR FASE Y POR HILO ===\n");
+    printf("Modo: %s\n\n", modos[modoInstrumentacion]);
+
+    printf("  %-14s %10s", "Fase/hilo", "Tiempo ms");
+    #ifdef __linux__
+        if (modoInstrumentacion != INSTRUMENTACION_TIEMPO) {
+            const EventoPerf *eventos = modoInstrumentacion == INSTRUMENTACION_HARDWARE
+                                        ? eventosHardware : eventosSoftware;
+            for (int e = 0; e < EVENTOS_INSTRUMENTACION; e++) {
+                printf(" %14s", eventos[e].nombre);
+            }
+        }
+    #endif
+    if (modoInstrumentacion == INSTRUMENTACION_HARDWARE) {
+        printf(" %6s %8s %8s", "IPC", "LLC/ki", "salt/ki");
+    }
+    printf("\n");
+
+    for (int f = 0; f < NUM_FASES; f++) {
+        uint64_t total[EVENTOS_INSTRUMENTACION] = {0};
+        double segundos = 0, maximo = 0;
+        int hilos = 0;
+        for (int h = 0; h < MAX_HILOS_INSTRUMENTADOS; h++) {
+            const ContadoresPerfHilo *hilo = &hilosInstrumentados[h];
+            if (hilo->veces[f] == 0) {
+                continue;
+            }
+            hilos++;
+            segundos += hilo->segundos[f];
+            if (hilo->segundos[f] > maximo) {
+                maximo = hilo->segundos[f];
+            }
+            for (int e = 0; e < EVENTOS_INSTRUMENTACION; e++) {
+                total[e] += hilo->eventos[f][e];
+            }
+        }
+        if (hilos == 0) {
+            continue;
+        }
+
+        // El tiempo de la fase es el del hilo mas lento; los eventos, la suma
+        imprimirFila(nombresFases[f], maximo, total);
+        if (hilos > 1) {
+            for (int h = 0; h < MAX_HILOS_INSTRUMENTADOS; h++) {
+                const ContadoresPerfHilo *hilo = &hilosInstrumentados[h];
+                if (hilo->veces[f] > 0) {
+                    char etiqueta[32];
+                    snprintf(etiqueta, sizeof(etiqueta), "  hilo %d", h);
+                    imprimirFila(etiqueta, hilo->segundos[f], hilo->eventos[f]);
+                }
+            }
+            printf("  %-14s %9.2fx (%d hilos)\n", "  desbalance", maximo / (segundos / hilos), hilos);
+        }
+    }
+}
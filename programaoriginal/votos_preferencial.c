@@ -0,0 +1,541 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <omp.h>
+
+#include "votos.h"
+
+// Columnas de long long o double por linea de cache, para que las filas de dos
+// hilos no compartan linea
+#define COLUMNAS_POR_LINEA 8
+// Boletas de adelanto al recorrer el indice
+#define DISTANCIA_PREFETCH 16
+
+enum {
+    ESTADO_CONTINUA,
+    ESTADO_ELECTO,
+    ESTADO_ELIMINADO
+};
+
+// Las boletas que un candidato recibio en una ronda. El indice de cada candidato es
+// una lista de segmentos: la primera pasada deja uno por candidato y cada ronda
+// agrega otro a los candidatos que recibieron boletas.
+typedef struct SegmentoIndice {
+    struct SegmentoIndice *siguiente;
+    long long cantidad;
+    uint32_t boletas[];
+} SegmentoIndice;
+
+typedef struct {
+    const AlmacenPreferencias *almacen;
+    int numHilos;
+    int paso;
+    unsigned char *estado;
+    // Rango en que esta cada boleta y, con varios escanos, cuanto pesa
+    unsigned char *posicion;
+    double *pesos;
+    uint16_t *destinos;
+    long long *conteos;
+    double *sumas;
+    SegmentoIndice **indice;
+    // numCandidatos + 1: la ultima columna son las agotadas
+    double *votos;
+} Tabulacion;
+
+int crearAlmacenPreferencias(AlmacenPreferencias *almacen, long long numBoletas, int numCandidatos) {
+    almacen->numBoletas = numBoletas;
+    almacen->numCandidatos = numCandidatos;
+    almacen->rangos = numCandidatos < RANGOS_PREFERENCIA ? numCandidatos : RANGOS_PREFERENCIA;
+    almacen->preferencias = NULL;
+    // El indice guarda la boleta en 32 bits
+    if (numBoletas <= 0 || numBoletas > UINT32_MAX) {
+        return -1;
+    }
+    almacen->preferencias = (uint16_t *)malloc((size_t)numBoletas * almacen->rangos * sizeof(uint16_t));
+    return almacen->preferencias != NULL ? 0 : -1;
+}
+
+void liberarAlmacenPreferencias(AlmacenPreferencias *almacen) {
+    free(almacen->preferencias);
+    almacen->preferencias = NULL;
+}
+
+// Generador basado en contador como generarBoletasAleatorias. El 3% de las boletas
+// quedan en blanco; el resto ordena de 1 a rangos candidatos distintos. Cada
+// preferencia es el menor de dos candidatos al azar, asi que los primeros candidatos
+// son mas populares y la eliminacion sigue un orden con sentido.
+void generarPreferenciasAleatorias(AlmacenPreferencias *almacen, uint64_t semilla, int numHilos) {
+    int numCandidatos = almacen->numCandidatos;
+    int rangos = almacen->rangos;
+    if (numHilos <= 0) {
+        numHilos = omp_get_max_threads();
+    }
+
+    #pragma omp parallel for schedule(static) num_threads(numHilos)
+    for (long long i = 0; i < almacen->numBoletas; i++) {
+        uint16_t *fila = almacen->preferencias + (size_t)i * rangos;
+        uint64_t r = mezclarBits(semilla ^ mezclarBits((uint64_t)i));
+        int marcadas = reducirRango((uint32_t)r, 100) < 3 ? 0 : 1 + reducirRango((uint32_t)(r >> 32), rangos);
+
+        for (int k = 0; k < marcadas; k++) {
+            int candidato, repetido;
+            do {
+                r = mezclarBits(r);
+                int a = reducirRango((uint32_t)r, numCandidatos);
+                int b = reducirRango((uint32_t)(r >> 32), numCandidatos);
+                candidato = a < b ? a : b;
+                repetido = 0;
+                for (int j = 0; j < k; j++) {
+                    repetido |= fila[j] == candidato;
+                }
+            } while (repetido);
+            fila[k] = (uint16_t)candidato;
+        }
+        for (int k = marcadas; k < rangos; k++) {
+            fila[k] = PREFERENCIA_VACIA;
+        }
+    }
+}
+
+static int iniciarResultadoPreferencial(ResultadoPreferencial *resultado, int numCandidatos, int escanos) {
+    memset(resultado, 0, sizeof(*resultado));
+    resultado->numCandidatos = numCandidatos;
+    resultado->escanos = escanos;
+    // Cada ronda cambia el estado de un candidato: como mucho numCandidatos rondas
+    resultado->votosPorRonda = (double *)calloc((size_t)numCandidatos * (numCandidatos + 1), sizeof(double));
+    resultado->candidatoPorRonda = (int *)calloc(numCandidatos, sizeof(int));
+    resultado->electoEnRonda = (int *)calloc(numCandidatos, sizeof(int));
+    resultado->electos = (int *)calloc(escanos, sizeof(int));
+    if (resultado->votosPorRonda == NULL || resultado->candidatoPorRonda == NULL ||
+        resultado->electoEnRonda == NULL || resultado->electos == NULL) {
+        liberarResultadoPreferencial(resultado);
+        return -1;
+    }
+    return 0;
+}
+
+void liberarResultadoPreferencial(ResultadoPreferencial *resultado) {
+    free(resultado->votosPorRonda);
+    free(resultado->candidatoPorRonda);
+    free(resultado->electoEnRonda);
+    free(resultado->electos);
+    resultado->votosPorRonda = NULL;
+    resultado->candidatoPorRonda = NULL;
+    resultado->electoEnRonda = NULL;
+    resultado->electos = NULL;
+}
+
+// Cuota Droop sobre las boletas que no quedaron en blanco
+static void fijarCuota(ResultadoPreferencial *resultado, long long numBoletas, double agotadas) {
+    resultado->cuota = floor((numBoletas - agotadas) / (resultado->escanos + 1)) + 1;
+}
+
+// Empate al eliminar: pierde quien tuvo menos votos en la ronda anterior mas cercana
+// en que hubo diferencia; si siempre empataron, el de menor numero
+static int eliminarAntes(const ResultadoPreferencial *resultado, const double *votos, int c, int otro) {
+    if (votos[c] != votos[otro]) {
+        return votos[c] < votos[otro];
+    }
+    int columnas = resultado->numCandidatos + 1;
+    for (int r = resultado->numRondas - 1; r >= 0; r--) {
+        const double *fila = resultado->votosPorRonda + (size_t)r * columnas;
+        if (fila[c] != fila[otro]) {
+            return fila[c] < fila[otro];
+        }
+    }
+    return 0;
+}
+
+// Devuelve el candidato que se elige (*electo = 1) o se elimina en esta ronda, o -1
+// si ya no queda nada por decidir. Con un escano gana quien tenga la mayoria de las
+// boletas que siguen en juego; con varios, quien llegue a la cuota.
+static int decidirRonda(const ResultadoPreferencial *resultado, const unsigned char *estado,
+                        const double *votos, int *electo) {
+    int continuan = 0, mayor = -1, menor = -1;
+    double enJuego = 0;
+    for (int c = 0; c < resultado->numCandidatos; c++) {
+        if (estado[c] != ESTADO_CONTINUA) {
+            continue;
+        }
+        continuan++;
+        enJuego += votos[c];
+        if (mayor < 0 || votos[c] > votos[mayor]) mayor = c;
+        if (menor < 0 || eliminarAntes(resultado, votos, c, menor)) menor = c;
+    }
+    if (continuan == 0 || resultado->numElectos >= resultado->escanos) {
+        return -1;
+    }
+
+    *electo = 1;
+    if (continuan <= resultado->escanos - resultado->numElectos) {
+        return mayor;
+    }
+    if (resultado->escanos == 1 ? 2 * votos[mayor] > enJuego : votos[mayor] >= resultado->cuota) {
+        return mayor;
+    }
+    *electo = 0;
+    return menor;
+}
+
+static void anotarRonda(ResultadoPreferencial *resultado, const double *votos, int candidato, int electo) {
+    int columnas = resultado->numCandidatos + 1;
+    memcpy(resultado->votosPorRonda + (size_t)resultado->numRondas * columnas, votos, columnas * sizeof(double));
+    resultado->candidatoPorRonda[resultado->numRondas] = candidato;
+    resultado->electoEnRonda[resultado->numRondas] = electo;
+    resultado->numRondas++;
+    if (electo) {
+        resultado->electos[resultado->numElectos++] = candidato;
+    }
+}
+
+// Fraccion del voto que pasa a la siguiente preferencia cuando sale un candidato
+static double factorTransferencia(const ResultadoPreferencial *resultado, double votos, int electo) {
+    if (!electo) {
+        return 1.0;
+    }
+    return votos > resultado->cuota ? (votos - resultado->cuota) / votos : 0.0;
+}
+
+static void liberarTabulacion(Tabulacion *t) {
+    if (t->indice != NULL) {
+        for (int c = 0; c < t->almacen->numCandidatos; c++) {
+            while (t->indice[c] != NULL) {
+                SegmentoIndice *siguiente = t->indice[c]->siguiente;
+                free(t->indice[c]);
+                t->indice[c] = siguiente;
+            }
+        }
+    }
+    free(t->indice);
+    free(t->estado);
+    free(t->posicion);
+    free(t->pesos);
+    free(t->destinos);
+    free(t->conteos);
+    free(t->sumas);
+    free(t->votos);
+}
+
+static int crearTabulacion(Tabulacion *t, const AlmacenPreferencias *almacen, int escanos, int numHilos) {
+    int numCandidatos = almacen->numCandidatos;
+    memset(t, 0, sizeof(*t));
+    t->almacen = almacen;
+    t->numHilos = numHilos;
+    t->paso = (numCandidatos + 1 + COLUMNAS_POR_LINEA - 1) / COLUMNAS_POR_LINEA * COLUMNAS_POR_LINEA;
+    t->estado = (unsigned char *)calloc(numCandidatos, 1);
+    t->posicion = (unsigned char *)malloc((size_t)almacen->numBoletas);
+    t->destinos = (uint16_t *)malloc((size_t)almacen->numBoletas * sizeof(uint16_t));
+    t->conteos = (long long *)malloc((size_t)numHilos * t->paso * sizeof(long long));
+    t->sumas = (double *)malloc((size_t)numHilos * t->paso * sizeof(double));
+    t->indice = (SegmentoIndice **)calloc(numCandidatos, sizeof(SegmentoIndice *));
+    t->votos = (double *)calloc(numCandidatos + 1, sizeof(double));
+    int error = t->estado == NULL || t->posicion == NULL || t->destinos == NULL || t->conteos == NULL ||
+                t->sumas == NULL || t->indice == NULL || t->votos == NULL;
+    // Con un escano nadie transfiere fracciones: todas las boletas pesan 1
+    if (!error && escanos > 1) {
+        t->pesos = (double *)malloc((size_t)almacen->numBoletas * sizeof(double));
+        error = t->pesos == NULL;
+        for (long long b = 0; !error && b < almacen->numBoletas; b++) {
+            t->pesos[b] = 1.0;
+        }
+    }
+    if (error) {
+        liberarTabulacion(t);
+        return -1;
+    }
+    return 0;
+}
+
+// Una pasada paralela sobre las boletas de lista (todas, si es NULL). Cada boleta avanza
+// a su siguiente preferencia que sigue en carrera, suma su peso por factor a ese
+// candidato y se anota en un segmento nuevo de su indice. El reparto static da a
+// cada hilo las mismas boletas en los dos bucles, asi que cada uno escribe en su
+// propio tramo de cada segmento sin cerrojos.
+static int repartirBoletas(Tabulacion *t, const uint32_t *lista, long long cantidad, double factor) {
+    const AlmacenPreferencias *almacen = t->almacen;
+    int numCandidatos = almacen->numCandidatos;
+    int rangos = almacen->rangos;
+    SegmentoIndice *nuevos[MAX_CANDIDATOS];
+    int error = 0;
+
+    #pragma omp parallel num_threads(t->numHilos)
+    {
+        long long *conteo = t->conteos + (size_t)omp_get_thread_num() * t->paso;
+        double *suma = t->sumas + (size_t)omp_get_thread_num() * t->paso;
+        memset(conteo, 0, (numCandidatos + 1) * sizeof(long long));
+        memset(suma, 0, (numCandidatos + 1) * sizeof(double));
+
+        #pragma omp for schedule(static)
+        for (long long j = 0; j < cantidad; j++) {
+            uint32_t b = lista != NULL ? lista[j] : (uint32_t)j;
+            // Las boletas de la lista estan dispersas: pedir las de mas adelante
+            if (lista != NULL && j + DISTANCIA_PREFETCH < cantidad) {
+                uint32_t proxima = lista[j + DISTANCIA_PREFETCH];
+                __builtin_prefetch(almacen->preferencias + (size_t)proxima * rangos);
+                __builtin_prefetch(t->posicion + proxima, 1);
+                if (t->pesos != NULL) {
+                    __builtin_prefetch(t->pesos + proxima, 1);
+                }
+            }
+            const uint16_t *fila = almacen->preferencias + (size_t)b * rangos;
+            int p = lista != NULL ? t->posicion[b] + 1 : 0;
+            while (p < rangos && fila[p] != PREFERENCIA_VACIA && t->estado[fila[p]] != ESTADO_CONTINUA) {
+                p++;
+            }
+            int destino = p < rangos && fila[p] != PREFERENCIA_VACIA ? fila[p] : numCandidatos;
+            double peso = 1.0;
+            if (t->pesos != NULL) {
+                peso = t->pesos[b] * factor;
+                t->pesos[b] = peso;
+            }
+            t->posicion[b] = (unsigned char)p;
+            t->destinos[j] = (uint16_t)destino;
+            conteo[destino]++;
+            suma[destino] += peso;
+        }
+
+        // Totales por candidato y, en la fila de cada hilo, donde empieza su tramo
+        #pragma omp single
+        {
+            int hilos = omp_get_num_threads();
+            for (int d = 0; d <= numCandidatos; d++) {
+                long long total = 0;
+                for (int h = 0; h < hilos; h++) {
+                    long long *fila = t->conteos + (size_t)h * t->paso;
+                    long long propias = fila[d];
+                    fila[d] = total;
+                    total += propias;
+                    t->votos[d] += t->sumas[(size_t)h * t->paso + d];
+                }
+                if (d == numCandidatos) {
+                    break;
+                }
+                nuevos[d] = NULL;
+                if (total > 0 && !error) {
+                    nuevos[d] = (SegmentoIndice *)malloc(sizeof(SegmentoIndice) + (size_t)total * sizeof(uint32_t));
+                    if (nuevos[d] == NULL) {
+                        error = 1;
+                    } else {
+                        nuevos[d]->cantidad = total;
+                    }
+                }
+            }
+        }
+
+        if (!error) {
+            #pragma omp for schedule(static)
+            for (long long j = 0; j < cantidad; j++) {
+                int destino = t->destinos[j];
+                if (destino < numCandidatos) {
+                    nuevos[destino]->boletas[conteo[destino]++] = lista != NULL ? lista[j] : (uint32_t)j;
+                }
+            }
+        }
+    }
+
+    for (int d = 0; d < numCandidatos; d++) {
+        if (nuevos[d] == NULL) {
+            continue;
+        }
+        if (error) {
+            free(nuevos[d]);
+        } else {
+            nuevos[d]->siguiente = t->indice[d];
+            t->indice[d] = nuevos[d];
+        }
+    }
+    return error ? -1 : 0;
+}
+
+// Saca las boletas del indice de un candidato en un solo arreglo (el propio segmento
+// si solo tiene uno). *copia indica si hay que liberar el arreglo.
+static uint32_t *juntarIndice(Tabulacion *t, int candidato, long long *cantidad, int *copia) {
+    SegmentoIndice *segmento = t->indice[candidato];
+    *cantidad = 0;
+    *copia = 0;
+    if (segmento == NULL) {
+        return NULL;
+    }
+    if (segmento->siguiente == NULL) {
+        *cantidad = segmento->cantidad;
+        return segmento->boletas;
+    }
+    for (SegmentoIndice *s = segmento; s != NULL; s = s->siguiente) {
+        *cantidad += s->cantidad;
+    }
+    uint32_t *lista = (uint32_t *)malloc((size_t)*cantidad * sizeof(uint32_t));
+    if (lista == NULL) {
+        return NULL;
+    }
+    long long usados = 0;
+    for (SegmentoIndice *s = segmento; s != NULL; s = s->siguiente) {
+        memcpy(lista + usados, s->boletas, (size_t)s->cantidad * sizeof(uint32_t));
+        usados += s->cantidad;
+    }
+    *copia = 1;
+    return lista;
+}
+
+int tabularPreferencial(const AlmacenPreferencias *almacen, int escanos, int numHilos,
+                        ResultadoPreferencial *resultado) {
+    int numCandidatos = almacen->numCandidatos;
+    if (numHilos <= 0) {
+        numHilos = omp_get_max_threads();
+    }
+    double inicio = obtenerTiempoAlta();
+
+    Tabulacion t;
+    if (iniciarResultadoPreferencial(resultado, numCandidatos, escanos) != 0) {
+        return -1;
+    }
+    if (crearTabulacion(&t, almacen, escanos, numHilos) != 0) {
+        liberarResultadoPreferencial(resultado);
+        return -1;
+    }
+
+    // Primera pasada completa: primeras preferencias e indice inicial
+    int error = repartirBoletas(&t, NULL, almacen->numBoletas, 1.0);
+    resultado->boletasRevisadas = almacen->numBoletas;
+    fijarCuota(resultado, almacen->numBoletas, t.votos[numCandidatos]);
+
+    while (!error) {
+        int electo;
+        int candidato = decidirRonda(resultado, t.estado, t.votos, &electo);
+        if (candidato < 0) {
+            break;
+        }
+        anotarRonda(resultado, t.votos, candidato, electo);
+        t.estado[candidato] = electo ? ESTADO_ELECTO : ESTADO_ELIMINADO;
+        if (resultado->numElectos == escanos) {
+            break;
+        }
+
+        // Solo se revisan las boletas que estaban con el candidato que sale
+        double factor = factorTransferencia(resultado, t.votos[candidato], electo);
+        t.votos[candidato] = electo ? fmin(t.votos[candidato], resultado->cuota) : 0;
+        if (factor > 0) {
+            long long cantidad;
+            int copia;
+            uint32_t *lista = juntarIndice(&t, candidato, &cantidad, &copia);
+            if (cantidad > 0 && lista == NULL) {
+                error = 1;
+                break;
+            }
+            error = repartirBoletas(&t, lista, cantidad, factor) != 0;
+            resultado->boletasRevisadas += cantidad;
+            if (copia) {
+                free(lista);
+            }
+        }
+        while (t.indice[candidato] != NULL) {
+            SegmentoIndice *siguiente = t.indice[candidato]->siguiente;
+            free(t.indice[candidato]);
+            t.indice[candidato] = siguiente;
+        }
+    }
+
+    liberarTabulacion(&t);
+    if (error) {
+        printf("Error: No se pudo reservar memoria para el indice de boletas\n");
+        liberarResultadoPreferencial(resultado);
+        return -1;
+    }
+    resultado->segundos = obtenerTiempoAlta() - inicio;
+    return 0;
+}
+
+int tabularPreferencialRecontando(const AlmacenPreferencias *almacen, int escanos, int numHilos,
+                                  ResultadoPreferencial *resultado) {
+    int numCandidatos = almacen->numCandidatos;
+    int rangos = almacen->rangos;
+    if (numHilos <= 0) {
+        numHilos = omp_get_max_threads();
+    }
+    double inicio = obtenerTiempoAlta();
+
+    if (iniciarResultadoPreferencial(resultado, numCandidatos, escanos) != 0) {
+        return -1;
+    }
+    unsigned char *estado = (unsigned char *)calloc(numCandidatos, 1);
+    double *votos = (double *)malloc((numCandidatos + 1) * sizeof(double));
+    double *votosElectos = (double *)calloc(numCandidatos, sizeof(double));
+    uint16_t *actual = (uint16_t *)malloc((size_t)almacen->numBoletas * sizeof(uint16_t));
+    double *pesos = escanos > 1 ? (double *)malloc((size_t)almacen->numBoletas * sizeof(double)) : NULL;
+    if (estado == NULL || votos == NULL || votosElectos == NULL || actual == NULL || (escanos > 1 && pesos == NULL)) {
+        printf("Error: No se pudo reservar memoria para el recuento\n");
+        free(estado);
+        free(votos);
+        free(votosElectos);
+        free(actual);
+        free(pesos);
+        liberarResultadoPreferencial(resultado);
+        return -1;
+    }
+    for (long long b = 0; pesos != NULL && b < almacen->numBoletas; b++) {
+        pesos[b] = 1.0;
+    }
+
+    for (;;) {
+        memset(votos, 0, (numCandidatos + 1) * sizeof(double));
+        #pragma omp parallel for schedule(static) num_threads(numHilos) reduction(+: votos[:numCandidatos + 1])
+        for (long long b = 0; b < almacen->numBoletas; b++) {
+            const uint16_t *fila = almacen->preferencias + (size_t)b * rangos;
+            int p = 0;
+            while (p < rangos && fila[p] != PREFERENCIA_VACIA && estado[fila[p]] != ESTADO_CONTINUA) {
+                p++;
+            }
+            int destino = p < rangos && fila[p] != PREFERENCIA_VACIA ? fila[p] : numCandidatos;
+            actual[b] = (uint16_t)destino;
+            votos[destino] += pesos != NULL ? pesos[b] : 1.0;
+        }
+        resultado->boletasRevisadas += almacen->numBoletas;
+        for (int c = 0; c < numCandidatos; c++) {
+            if (estado[c] == ESTADO_ELECTO) {
+                votos[c] = votosElectos[c];
+            }
+        }
+        if (resultado->numRondas == 0) {
+            fijarCuota(resultado, almacen->numBoletas, votos[numCandidatos]);
+        }
+
+        int electo;
+        int candidato = decidirRonda(resultado, estado, votos, &electo);
+        if (candidato < 0) {
+            break;
+        }
+        anotarRonda(resultado, votos, candidato, electo);
+        estado[candidato] = electo ? ESTADO_ELECTO : ESTADO_ELIMINADO;
+        if (resultado->numElectos == escanos) {
+            break;
+        }
+        if (electo) {
+            double factor = factorTransferencia(resultado, votos[candidato], 1);
+            votosElectos[candidato] = fmin(votos[candidato], resultado->cuota);
+            #pragma omp parallel for schedule(static) num_threads(numHilos)
+            for (long long b = 0; b < almacen->numBoletas; b++) {
+                if (actual[b] == candidato) {
+                    pesos[b] *= factor;
+                }
+            }
+        }
+    }
+
+    free(estado);
+    free(votos);
+    free(votosElectos);
+    free(actual);
+    free(pesos);
+    resultado->segundos = obtenerTiempoAlta() - inicio;
+    return 0;
+}
+
+// Mismos candidatos decididos en el mismo orden
+int mismoResultadoPreferencial(const ResultadoPreferencial *a, const ResultadoPreferencial *b) {
+    if (a->numRondas != b->numRondas || a->numElectos != b->numElectos) {
+        return 0;
+    }
+    return memcmp(a->candidatoPorRonda, b->candidatoPorRonda, a->numRondas * sizeof(int)) == 0 &&
+           memcmp(a->electoEnRonda, b->electoEnRonda, a->numRondas * sizeof(int)) == 0;
+}
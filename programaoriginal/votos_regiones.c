@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "votos.h"
+
+// Las tablas de cada hilo se parten por hash de la clave; en la mezcla cada hilo
+// se queda con unas particiones y suma las de todos los hilos sin cerrojos
+#define PARTICIONES_REGION 64
+
+// Cualquier valor de 32 bits es una clave valida (CLAVE_REGION(255, 255, 65535) da
+// 0xFFFFFFFF), asi que los huecos ocupados se marcan aparte y no con una clave reservada
+typedef struct {
+    uint32_t *claves;
+    uint8_t *ocupados;
+    long long *filas;
+    int capacidad;
+    int usados;
+    int columnas;
+} TablaGrupos;
+
+static inline uint32_t hashClave(uint32_t clave) {
+    return (uint32_t)(mezclarBits(clave) >> 32);
+}
+
+static int crearTablaGrupos(TablaGrupos *tabla, int capacidad, int columnas) {
+    tabla->capacidad = capacidad;
+    tabla->usados = 0;
+    tabla->columnas = columnas;
+    tabla->claves = (uint32_t *)malloc(capacidad * sizeof(uint32_t));
+    tabla->ocupados = (uint8_t *)calloc(capacidad, sizeof(uint8_t));
+    tabla->filas = (long long *)calloc((size_t)capacidad * columnas, sizeof(long long));
+    if (tabla->claves == NULL || tabla->ocupados == NULL || tabla->filas == NULL) {
+        free(tabla->claves);
+        free(tabla->ocupados);
+        free(tabla->filas);
+        tabla->claves = NULL;
+        tabla->ocupados = NULL;
+        tabla->filas = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static void liberarTablaGrupos(TablaGrupos *tabla) {
+    free(tabla->claves);
+    free(tabla->ocupados);
+    free(tabla->filas);
+    tabla->claves = NULL;
+    tabla->ocupados = NULL;
+    tabla->filas = NULL;
+}
+
+static long long *buscarOInsertar(TablaGrupos *tabla, uint32_t clave);
+
+// Duplica la tabla cuando pasa de la mitad de ocupacion
+static int crecerTablaGrupos(TablaGrupos *tabla) {
+    TablaGrupos nueva;
+    if (crearTablaGrupos(&nueva, tabla->capacidad * 2, tabla->columnas) != 0) {
+        return -1;
+    }
+    for (int s = 0; s < tabla->capacidad; s++) {
+        if (!tabla->ocupados[s]) {
+            continue;
+        }
+        long long *destino = buscarOInsertar(&nueva, tabla->claves[s]);
+        memcpy(destino, tabla->filas + (size_t)s * tabla->columnas, tabla->columnas * sizeof(long long));
+    }
+    liberarTablaGrupos(tabla);
+    *tabla = nueva;
+    return 0;
+}
+
+// Direccionamiento abierto con sondeo lineal. Devuelve NULL si no hay memoria.
+static long long *buscarOInsertar(TablaGrupos *tabla, uint32_t clave) {
+    if (2 * (tabla->usados + 1) > tabla->capacidad && crecerTablaGrupos(tabla) != 0) {
+        return NULL;
+    }
+    uint32_t mascara = (uint32_t)tabla->capacidad - 1;
+    uint32_t s = hashClave(clave) & mascara;
+    while (!tabla->ocupados[s] || tabla->claves[s] != clave) {
+        if (!tabla->ocupados[s]) {
+            tabla->claves[s] = clave;
+            tabla->ocupados[s] = 1;
+            tabla->usados++;
+            break;
+        }
+        s = (s + 1) & mascara;
+    }
+    return tabla->filas + (size_t)s * tabla->columnas;
+}
+
+static inline int particionDe(uint32_t clave) {
+    return (int)(hashClave(clave) >> 26) & (PARTICIONES_REGION - 1);
+}
+
+// Ultimo tramo que empieza en la boleta i o antes
+static long long tramoDeBoleta(const AlmacenBoletas *almacen, long long i) {
+    long long bajo = 0, alto = almacen->numTramos - 1;
+    while (bajo < alto) {
+        long long medio = (bajo + alto + 1) / 2;
+        if (almacen->regiones[medio].inicio <= i) {
+            bajo = medio;
+        } else {
+            alto = medio - 1;
+        }
+    }
+    return bajo;
+}
+
+// Un tramo por urna de BOLETAS_POR_URNA boletas
+void generarRegionesAleatorias(AlmacenBoletas *almacen, const Geografia *geografia,
+                               uint64_t semilla, int numHilos) {
+    long long numTramos = almacen->numTramos;
+    int municipios = geografia->municipiosPorDepartamento;
+    int recintos = geografia->recintosPorMunicipio;
+    int totalRecintos = geografia->numDepartamentos * municipios * recintos;
+    uint64_t semillaRegion = mezclarBits(semilla ^ 0x5245474F4EULL);
+
+    #pragma omp parallel for schedule(static) num_threads(numHilos)
+    for (long long u = 0; u < numTramos; u++) {
+        uint64_t r = mezclarBits(semillaRegion ^ mezclarBits((uint64_t)u));
+        int recinto = reducirRango((uint32_t)r, totalRecintos);
+        int departamento = recinto / (municipios * recintos);
+        int municipio = recinto / recintos % municipios;
+        almacen->regiones[u].inicio = u * BOLETAS_POR_URNA;
+        almacen->regiones[u].clave = CLAVE_REGION(departamento, municipio, recinto % recintos);
+    }
+}
+
+int reservarRegiones(AlmacenBoletas *almacen, long long numTramos) {
+    free(almacen->regiones);
+    almacen->numTramos = 0;
+    almacen->regiones = (TramoRegion *)malloc((size_t)numTramos * sizeof(TramoRegion));
+    if (almacen->regiones == NULL) {
+        printf("Error: No se pudo reservar memoria para %lld tramos de region\n", numTramos);
+        return -1;
+    }
+    almacen->numTramos = numTramos;
+    return 0;
+}
+
+static int compararGrupos(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Ordena los grupos por clave (recinto) y acumula municipios y departamentos, que
+// quedan contiguos en ese orden
+static int construirNiveles(TablaGrupos *globales, int columnas, ResultadoRegiones niveles[3]) {
+    long long numRecintos = 0;
+    for (int p = 0; p < PARTICIONES_REGION; p++) {
+        numRecintos += globales[p].usados;
+    }
+
+    for (int n = 0; n < 3; n++) {
+        niveles[n].columnas = columnas;
+        niveles[n].numGrupos = 0;
+        niveles[n].claves = (uint32_t *)malloc((numRecintos + 1) * sizeof(uint32_t));
+        niveles[n].conteos = (long long *)calloc((size_t)(numRecintos + 1) * columnas, sizeof(long long));
+        if (niveles[n].claves == NULL || niveles[n].conteos == NULL) {
+            printf("Error: No se pudo reservar memoria para los resultados por region\n");
+            return -1;
+        }
+    }
+
+    // Pares (clave, indice) para ordenar sin mover las filas
+    uint64_t *orden = (uint64_t *)malloc((numRecintos + 1) * sizeof(uint64_t));
+    long long **origen = (long long **)malloc((numRecintos + 1) * sizeof(long long *));
+    if (orden == NULL || origen == NULL) {
+        free(orden);
+        free(origen);
+        printf("Error: No se pudo reservar memoria para ordenar las regiones\n");
+        return -1;
+    }
+    long long k = 0;
+    for (int p = 0; p < PARTICIONES_REGION; p++) {
+        for (int s = 0; s < globales[p].capacidad; s++) {
+            if (globales[p].ocupados[s]) {
+                origen[k] = globales[p].filas + (size_t)s * columnas;
+                orden[k] = ((uint64_t)globales[p].claves[s] << 32) | (uint64_t)k;
+                k++;
+            }
+        }
+    }
+    qsort(orden, numRecintos, sizeof(uint64_t), compararGrupos);
+
+    for (long long g = 0; g < numRecintos; g++) {
+        uint32_t clave = (uint32_t)(orden[g] >> 32);
+        const long long *fila = origen[orden[g] & 0xFFFFFFFFu];
+        uint32_t clavesNivel[3] = {
+            clave,
+            CLAVE_REGION(DEPARTAMENTO_DE(clave), MUNICIPIO_DE(clave), 0),
+            CLAVE_REGION(DEPARTAMENTO_DE(clave), 0, 0)
+        };
+        for (int n = 0; n < 3; n++) {
+            ResultadoRegiones *nivel = &niveles[n];
+            if (nivel->numGrupos == 0 || nivel->claves[nivel->numGrupos - 1] != clavesNivel[n]) {
+                nivel->claves[nivel->numGrupos++] = clavesNivel[n];
+            }
+            long long *destino = nivel->conteos + (size_t)(nivel->numGrupos - 1) * columnas;
+            for (int c = 0; c < columnas; c++) {
+                destino[c] += fila[c];
+            }
+        }
+    }
+
+    free(orden);
+    free(origen);
+    return 0;
+}
+
+// Conteo agrupado en una pasada: cada hilo recorre sus bloques por tramos de region
+// y cuenta cada tramo con el kernel de region del nivel SIMD (candidatos, blancos y
+// multiples en una lectura) sobre la fila del grupo en sus tablas propias partidas
+// por hash. Luego cada hilo mezcla unas particiones de todos los hilos y al final se
+// acumulan municipios y departamentos. niveles[0] = recintos, [1] = municipios,
+// [2] = departamentos.
+int contarPorRegion(const AlmacenBoletas *almacen, const char *isa, int numHilos, 
+                    ResultadoRegiones niveles[3]) {
+    if (almacen->regiones == NULL || almacen->numTramos <= 0 || almacen->regiones[0].inicio != 0) {
+        printf("Error: Las boletas no tienen tramos de region desde la boleta 0\n");
+        return -1;
+    }
+    for (long long t = 1; t < almacen->numTramos; t++) {
+        if (almacen->regiones[t].inicio < almacen->regiones[t - 1].inicio) {
+            printf("Error: Los tramos de region no estan ordenados (tramo %lld)\n", t);
+            return -1;
+        }
+    }
+    memset(niveles, 0, 3 * sizeof(ResultadoRegiones));
+    const NivelSimd *nivel = elegirNivelSimd(almacen, isa);
+    int columnas = almacen->numCandidatos + 2;
+    long long numBoletas = almacen->numBoletas;
+    long long numBloques = (numBoletas + BOLETAS_POR_BLOQUE - 1) / BOLETAS_POR_BLOQUE;
+
+    TablaGrupos *tablas = (TablaGrupos *)calloc((size_t)numHilos * PARTICIONES_REGION, sizeof(TablaGrupos));
+    if (tablas == NULL) {
+        printf("Error: No se pudo reservar memoria para las tablas de regiones\n");
+        return -1;
+    }
+    int errorReserva = 0;
+
+    #pragma omp parallel num_threads(numHilos)
+    {
+        int totalHilos = omp_get_num_threads();
+        TablaGrupos *propias = &tablas[(size_t)omp_get_thread_num() * PARTICIONES_REGION];
+        for (int p = 0; p < PARTICIONES_REGION; p++) {
+            if (crearTablaGrupos(&propias[p], 16, columnas) != 0) {
+                #pragma omp atomic write
+                errorReserva = 1;
+            }
+        }
+
+        #pragma omp for schedule(static)
+        for (long long b = 0; b < numBloques; b++) {
+            int fallo;
+            #pragma omp atomic read
+            fallo = errorReserva;
+            if (fallo) {
+                continue;
+            }
+            long long inicio = b * BOLETAS_POR_BLOQUE;
+            long long fin = inicio + BOLETAS_POR_BLOQUE < numBoletas ? inicio + BOLETAS_POR_BLOQUE : numBoletas;
+            long long i = inicio;
+            for (long long t = tramoDeBoleta(almacen, inicio); i < fin; t++) {
+                long long finTramo = t + 1 < almacen->numTramos ? almacen->regiones[t + 1].inicio : fin;
+                finTramo = finTramo < fin ? finTramo : fin;
+                if (finTramo <= i) {
+                    continue;
+                }
+                uint32_t clave = almacen->regiones[t].clave;
+                long long *fila = buscarOInsertar(&propias[particionDe(clave)], clave);
+                if (fila == NULL) {
+                    #pragma omp atomic write
+                    errorReserva = 1;
+                    break;
+                }
+                nivel->porRegion(almacen, i, finTramo, fila);
+                i = finTramo;
+            }
+        }
+
+        // Mezcla por particiones: la p de los demas hilos se suma a la p del hilo 0, asi
+        // con un hilo no se copia nada
+        #pragma omp for schedule(dynamic)
+        for (int p = 0; p < PARTICIONES_REGION; p++) {
+            int fallo;
+            #pragma omp atomic read
+            fallo = errorReserva;
+            if (fallo) {
+                continue;
+            }
+            for (int h = 1; h < totalHilos; h++) {
+                TablaGrupos *tabla = &tablas[(size_t)h * PARTICIONES_REGION + p];
+                for (int s = 0; s < tabla->capacidad; s++) {
+                    if (!tabla->ocupados[s]) {
+                        continue;
+                    }
+                    long long *destino = buscarOInsertar(&tablas[p], tabla->claves[s]);
+                    if (destino == NULL) {
+                        #pragma omp atomic write
+                        errorReserva = 1;
+                        break;
+                    }
+                    const long long *filaHilo = tabla->filas + (size_t)s * columnas;
+                    for (int c = 0; c < columnas; c++) {
+                        destino[c] += filaHilo[c];
+                    }
+                }
+            }
+        }
+    }
+
+    int error = errorReserva;
+    if (error) {
+        printf("Error: No hubo memoria para las tablas de regiones\n");
+    } else {
+        error = construirNiveles(tablas, columnas, niveles) != 0;
+    }
+
+    for (int t = 0; t < numHilos * PARTICIONES_REGION; t++) {
+        liberarTablaGrupos(&tablas[t]);
+    }
+    free(tablas);
+    if (error) {
+        liberarResultadosRegiones(niveles);
+        return -1;
+    }
+    return 0;
+}
+
+void liberarResultadosRegiones(ResultadoRegiones niveles[3]) {
+    for (int n = 0; n < 3; n++) {
+        free(niveles[n].claves);
+        free(niveles[n].conteos);
+        niveles[n].claves = NULL;
+        niveles[n].conteos = NULL;
+        niveles[n].numGrupos = 0;
+    }
+}
+
+// CSV con una fila por grupo de cada nivel: candidatos, blancos y marcas multiples
+int guardarResultadosRegiones(const char *ruta, const ResultadoRegiones niveles[3]) {
+    const char *nombres[3] = {"recinto", "municipio", "departamento"};
+    FILE *archivo = fopen(ruta, "w");
+    if (archivo == NULL) {
+        printf("Error: No se pudo crear el archivo '%s'\n", ruta);
+        return -1;
+    }
+
+    int numCandidatos = niveles[0].columnas - 2;
+    fprintf(archivo, "nivel,departamento,municipio,recinto");
+    for (int c = 0; c < numCandidatos; c++) {
+        fprintf(archivo, ",candidato_%d", c + 1);
+    }
+    fprintf(archivo, ",blancos,multiples\n");
+
+    for (int n = 2; n >= 0; n--) {
+        for (long long g = 0; g < niveles[n].numGrupos; g++) {
+            uint32_t clave = niveles[n].claves[g];
+            fprintf(archivo, "%s,%u,", nombres[n], DEPARTAMENTO_DE(clave) + 1);
+            if (n <= 1) fprintf(archivo, "%u", MUNICIPIO_DE(clave) + 1);
+            fprintf(archivo, ",");
+            if (n == 0) fprintf(archivo, "%u", RECINTO_DE(clave) + 1);
+            const long long *fila = niveles[n].conteos + (size_t)g * niveles[n].columnas;
+            for (int c = 0; c < niveles[n].columnas; c++) {
+                fprintf(archivo, ",%lld", fila[c]);
+            }
+            fprintf(archivo, "\n");
+        }
+    }
+
+    fclose(archivo);
+    printf("Resultados por region guardados en '%s'\n", ruta);
+    return 0;
+}
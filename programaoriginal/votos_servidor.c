@@ -0,0 +1,541 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <omp.h>
+
+#ifndef _WIN32
+    #include <errno.h>
+    #include <poll.h>
+    #include <signal.h>
+    #include <unistd.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+#endif
+
+#include "votos.h"
+
+#ifdef _WIN32
+
+int ejecutarServidor(const char *ruta, int numCandidatos, int numHilos) {
+    printf("Error: El servicio de conteo necesita sockets Unix\n");
+    return -1;
+}
+
+int ejecutarCargaServicio(const char *ruta, int numClientes, int lotesPorCliente, int boletasPorLote,
+                          uint64_t semilla, int cerrar) {
+    printf("Error: El servicio de conteo necesita sockets Unix\n");
+    return -1;
+}
+
+#else
+
+// Lotes distintos que prepara el generador de carga; los clientes los van rotando
+#define LOTES_DISTINTOS_CARGA 16
+
+static volatile sig_atomic_t servidorActivo = 1;
+
+static void detenerServidor(int senal) {
+    (void)senal;
+    servidorActivo = 0;
+}
+
+// Estado de lectura de cada cliente. El buffer de boletas crece hasta el mayor
+// mensaje del cliente y se reutiliza en los siguientes.
+typedef struct {
+    int descriptor;
+    CabeceraMensaje cabecera;
+    size_t recibidos;
+    char *boletas;
+    size_t capacidad;
+    int listo;
+} ClienteServicio;
+
+// Avanza el mensaje del cliente con lo que ya haya en el socket, sin bloquear.
+// Devuelve -1 si el cliente se desconecto o mando algo invalido.
+static int leerCliente(ClienteServicio *cliente, size_t pasoBoleta) {
+    while (!cliente->listo) {
+        char *destino;
+        size_t faltan;
+        if (cliente->recibidos < sizeof(CabeceraMensaje)) {
+            destino = (char *)&cliente->cabecera + cliente->recibidos;
+            faltan = sizeof(CabeceraMensaje) - cliente->recibidos;
+        } else {
+            size_t hechos = cliente->recibidos - sizeof(CabeceraMensaje);
+            size_t bytesBoletas = (size_t)cliente->cabecera.numBoletas * pasoBoleta;
+            if (hechos == bytesBoletas) {
+                cliente->listo = 1;
+                break;
+            }
+            destino = cliente->boletas + hechos;
+            faltan = bytesBoletas - hechos;
+        }
+
+        ssize_t n = recv(cliente->descriptor, destino, faltan, MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        cliente->recibidos += (size_t)n;
+
+        if (cliente->recibidos == sizeof(CabeceraMensaje)) {
+            if (cliente->cabecera.tipo != MENSAJE_LOTE) {
+                cliente->cabecera.numBoletas = 0;
+                continue;
+            }
+            if (cliente->cabecera.numBoletas > MAX_BOLETAS_MENSAJE) {
+                return -1;
+            }
+            size_t bytes = (size_t)cliente->cabecera.numBoletas * pasoBoleta;
+            if (bytes > cliente->capacidad) {
+                char *nuevo = (char *)realloc(cliente->boletas, bytes);
+                if (nuevo == NULL) {
+                    return -1;
+                }
+                cliente->boletas = nuevo;
+                cliente->capacidad = bytes;
+            }
+        }
+    }
+    return 0;
+}
+
+static void cerrarCliente(ClienteServicio *cliente) {
+    close(cliente->descriptor);
+    free(cliente->boletas);
+    cliente->descriptor = -1;
+    cliente->boletas = NULL;
+}
+
+static void reiniciarCliente(ClienteServicio *cliente) {
+    cliente->recibidos = 0;
+    cliente->listo = 0;
+}
+
+// Comprueba que ninguna boleta del mensaje marque bits por encima de numCandidatos,
+// leyendolas con el formato del almacen de agrupacion
+static int marcasValidas(const AlmacenBoletas *formato, const char *boletas, long long numBoletas) {
+    AlmacenBoletas vista = *formato;
+    vista.datos = (char *)boletas;
+    vista.numBoletas = numBoletas;
+    int numCandidatos = formato->numCandidatos;
+    if (vista.palabras == 1) {
+        uint64_t sobrantes = numCandidatos >= 64 ? 0 : ~0ULL << numCandidatos;
+        uint64_t marcas = 0;
+        for (long long i = 0; i < numBoletas; i++) {
+            marcas |= leerMascara(&vista, i);
+        }
+        return (marcas & sobrantes) == 0;
+    }
+    int ultima = vista.palabras - 1;
+    uint64_t sobrantes = numCandidatos % 64 == 0 ? 0 : ~0ULL << (numCandidatos % 64);
+    uint64_t marcas = 0;
+    for (long long i = 0; i < numBoletas; i++) {
+        marcas |= palabrasBoleta(&vista, i)[ultima];
+    }
+    return (marcas & sobrantes) == 0;
+}
+
+// Junta en el almacen de agrupacion los lotes completos de todos los clientes y los
+// cuenta como un solo lote del ConteoIncremental; cada cliente recibe el id del lote
+// agrupado. Si no caben todos, se cuentan en varias tandas. Un mensaje con marcas
+// fuera de los candidatos se rechaza entero con LOTE_MARCAS_INVALIDAS.
+static void atenderLotes(ClienteServicio *clientes, int numClientes, ConteoIncremental *conteo,
+                         AlmacenBoletas *agrupados, long long *lotesAgrupados, long long *mensajesLote) {
+    int *incluidos = (int *)malloc(numClientes * sizeof(int));
+    if (incluidos == NULL) {
+        return;
+    }
+    for (;;) {
+        long long boletas = 0;
+        int mensajes = 0;
+        for (int c = 0; c < numClientes; c++) {
+            ClienteServicio *cliente = &clientes[c];
+            if (cliente->descriptor < 0 || !cliente->listo || cliente->cabecera.tipo != MENSAJE_LOTE) {
+                continue;
+            }
+            long long n = cliente->cabecera.numBoletas;
+            if (!marcasValidas(agrupados, cliente->boletas, n)) {
+                RespuestaLote rechazo = {-1, 0, 0, LOTE_MARCAS_INVALIDAS};
+                reiniciarCliente(cliente);
+                if (enviarTodo(cliente->descriptor, &rechazo, sizeof(rechazo)) != 0) {
+                    cerrarCliente(cliente);
+                }
+                continue;
+            }
+            if (mensajes > 0 && boletas + n > MAX_BOLETAS_AGRUPADAS) {
+                continue;
+            }
+            memcpy(agrupados->datos + (size_t)boletas * agrupados->paso, cliente->boletas, (size_t)n * agrupados->paso);
+            boletas += n;
+            incluidos[mensajes++] = c;
+        }
+        if (mensajes == 0) {
+            break;
+        }
+
+        agrupados->numBoletas = boletas;
+        long long idLote = agregarLote(conteo, agrupados);
+        RespuestaLote respuesta = {idLote, boletas, mensajes, idLote < 0 ? LOTE_ERROR : LOTE_CONTADO};
+        for (int m = 0; m < mensajes; m++) {
+            ClienteServicio *cliente = &clientes[incluidos[m]];
+            reiniciarCliente(cliente);
+            if (enviarTodo(cliente->descriptor, &respuesta, sizeof(respuesta)) != 0) {
+                cerrarCliente(cliente);
+            }
+        }
+        (*lotesAgrupados)++;
+        *mensajesLote += mensajes;
+    }
+    free(incluidos);
+}
+
+static int responderInstantanea(int descriptor, ConteoIncremental *conteo, InstantaneaConteo *instantanea) {
+    tomarInstantanea(conteo, instantanea);
+    CabeceraInstantanea cabecera = {instantanea->version, instantanea->numBoletas, instantanea->votosNulos,
+                                    instantanea->lotes};
+    if (enviarTodo(descriptor, &cabecera, sizeof(cabecera)) != 0) {
+        return -1;
+    }
+    return enviarTodo(descriptor, instantanea->votosPorCandidato, conteo->numCandidatos * sizeof(long long));
+}
+
+static int abrirSocketServicio(const char *ruta) {
+    struct sockaddr_un direccion;
+    if (strlen(ruta) >= sizeof(direccion.sun_path)) {
+        printf("Error: Ruta de socket demasiado larga: %s\n", ruta);
+        return -1;
+    }
+    memset(&direccion, 0, sizeof(direccion));
+    direccion.sun_family = AF_UNIX;
+    strcpy(direccion.sun_path, ruta);
+
+    int descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (descriptor < 0) {
+        printf("Error: No se pudo crear el socket del servicio\n");
+        return -1;
+    }
+    unlink(ruta);
+    if (bind(descriptor, (struct sockaddr *)&direccion, sizeof(direccion)) != 0 ||
+        listen(descriptor, MAX_CLIENTES_SERVICIO) != 0) {
+        printf("Error: No se pudo escuchar en %s\n", ruta);
+        close(descriptor);
+        return -1;
+    }
+    return descriptor;
+}
+
+int ejecutarServidor(const char *ruta, int numCandidatos, int numHilos) {
+    ConteoIncremental conteo;
+    AlmacenBoletas agrupados;
+    InstantaneaConteo instantanea;
+    if (crearConteoIncremental(&conteo, numCandidatos, numHilos) != 0) {
+        return -1;
+    }
+    instantanea.votosPorCandidato = (long long *)malloc(numCandidatos * sizeof(long long));
+    if (instantanea.votosPorCandidato == NULL ||
+        crearAlmacenBoletas(&agrupados, MAX_BOLETAS_AGRUPADAS, numCandidatos, 0) != 0) {
+        printf("Error: No se pudo reservar memoria para el servicio\n");
+        free(instantanea.votosPorCandidato);
+        liberarConteoIncremental(&conteo);
+        return -1;
+    }
+    int escucha = abrirSocketServicio(ruta);
+    if (escucha < 0) {
+        free(instantanea.votosPorCandidato);
+        liberarAlmacenBoletas(&agrupados);
+        liberarConteoIncremental(&conteo);
+        return -1;
+    }
+
+    signal(SIGINT, detenerServidor);
+    signal(SIGTERM, detenerServidor);
+    SaludoServicio saludo = {MAGIA_SERVICIO, (uint32_t)numCandidatos, (uint32_t)agrupados.paso,
+                             MAX_BOLETAS_MENSAJE};
+    printf("Servicio de conteo en %s: %d candidatos, %d hilos, mascaras de %u bytes\n",
+           ruta, numCandidatos, conteo.numHilos, saludo.pasoBoleta);
+    fflush(stdout);
+
+    ClienteServicio clientes[MAX_CLIENTES_SERVICIO];
+    struct pollfd esperas[MAX_CLIENTES_SERVICIO + 1];
+    int numClientes = 0, cerrar = 0;
+    long long conexiones = 0, lotesAgrupados = 0, mensajesLote = 0, instantaneas = 0;
+    double inicio = obtenerTiempoAlta();
+
+    // Los contadores por hilo de cada conteo agrupado salen de esta arena, que se vacia
+    // tras cada vuelta: los conteos siguientes reutilizan la misma memoria
+    ArenaMemoria arena;
+    iniciarArena(&arena, 0);
+    activarArena(&arena);
+
+    while (servidorActivo && !cerrar) {
+        esperas[0].fd = escucha;
+        esperas[0].events = POLLIN;
+        for (int c = 0; c < numClientes; c++) {
+            esperas[c + 1].fd = clientes[c].descriptor;
+            esperas[c + 1].events = POLLIN;
+        }
+        if (poll(esperas, numClientes + 1, 1000) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("Error: poll fallo en el servicio\n");
+            break;
+        }
+
+        if (esperas[0].revents & POLLIN) {
+            int descriptor = accept(escucha, NULL, NULL);
+            if (descriptor >= 0 && numClientes < MAX_CLIENTES_SERVICIO &&
+                enviarTodo(descriptor, &saludo, sizeof(saludo)) == 0) {
+                memset(&clientes[numClientes], 0, sizeof(ClienteServicio));
+                clientes[numClientes++].descriptor = descriptor;
+                conexiones++;
+            } else if (descriptor >= 0) {
+                close(descriptor);
+            }
+        }
+
+        // Primero se lee todo lo que haya llegado, para agrupar los lotes de esta vuelta
+        for (int c = 0; c < numClientes; c++) {
+            short eventos = esperas[c + 1].fd == clientes[c].descriptor ? esperas[c + 1].revents : 0;
+            if ((eventos & (POLLIN | POLLHUP | POLLERR)) && leerCliente(&clientes[c], agrupados.paso) != 0) {
+                cerrarCliente(&clientes[c]);
+            }
+        }
+        atenderLotes(clientes, numClientes, &conteo, &agrupados, &lotesAgrupados, &mensajesLote);
+        vaciarArena(&arena);
+
+        // Las instantaneas ya ven los lotes de esta vuelta
+        for (int c = 0; c < numClientes; c++) {
+            ClienteServicio *cliente = &clientes[c];
+            if (cliente->descriptor < 0 || !cliente->listo) {
+                continue;
+            }
+            int error = 0;
+            if (cliente->cabecera.tipo == MENSAJE_INSTANTANEA) {
+                error = responderInstantanea(cliente->descriptor, &conteo, &instantanea);
+                instantaneas++;
+            } else if (cliente->cabecera.tipo == MENSAJE_CERRAR) {
+                RespuestaLote respuesta = {-1, 0, 0, 0};
+                error = enviarTodo(cliente->descriptor, &respuesta, sizeof(respuesta));
+                cerrar = 1;
+            } else {
+                error = 1;
+            }
+            reiniciarCliente(cliente);
+            if (error) {
+                cerrarCliente(cliente);
+            }
+        }
+
+        int vivos = 0;
+        for (int c = 0; c < numClientes; c++) {
+            if (clientes[c].descriptor >= 0) {
+                clientes[vivos++] = clientes[c];
+            }
+        }
+        numClientes = vivos;
+    }
+
+    activarArena(NULL);
+    destruirArena(&arena);
+    double segundos = obtenerTiempoAlta() - inicio;
+    tomarInstantanea(&conteo, &instantanea);
+    printf("Servicio detenido tras %.3f s: %lld conexiones, %lld lotes recibidos en %lld conteos agrupados "
+           "(%.1f por conteo), %lld instantaneas\n", segundos, conexiones, mensajesLote, lotesAgrupados,
+           lotesAgrupados > 0 ? (double)mensajesLote / lotesAgrupados : 0.0, instantaneas);
+    printf("Total: %lld boletas, %lld nulos\n", instantanea.numBoletas, instantanea.votosNulos);
+
+    for (int c = 0; c < numClientes; c++) {
+        cerrarCliente(&clientes[c]);
+    }
+    close(escucha);
+    unlink(ruta);
+    free(instantanea.votosPorCandidato);
+    liberarAlmacenBoletas(&agrupados);
+    liberarConteoIncremental(&conteo);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Generador de carga
+// ---------------------------------------------------------------------------
+
+// Reintenta unos segundos por si el servicio todavia esta arrancando
+static int conectarServicio(const char *ruta, SaludoServicio *saludo) {
+    struct sockaddr_un direccion;
+    memset(&direccion, 0, sizeof(direccion));
+    direccion.sun_family = AF_UNIX;
+    strncpy(direccion.sun_path, ruta, sizeof(direccion.sun_path) - 1);
+
+    for (int intento = 0; intento < 50; intento++) {
+        int descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (descriptor >= 0 && connect(descriptor, (struct sockaddr *)&direccion, sizeof(direccion)) == 0) {
+            if (recibirTodo(descriptor, saludo, sizeof(*saludo)) == 0 && saludo->magia == MAGIA_SERVICIO) {
+                return descriptor;
+            }
+            close(descriptor);
+            return -1;
+        }
+        if (descriptor >= 0) {
+            close(descriptor);
+        }
+        usleep(100000);
+    }
+    return -1;
+}
+
+static int pedirInstantanea(int descriptor, int numCandidatos, CabeceraInstantanea *cabecera, long long *votos) {
+    CabeceraMensaje mensaje = {MENSAJE_INSTANTANEA, 0};
+    if (enviarTodo(descriptor, &mensaje, sizeof(mensaje)) != 0 ||
+        recibirTodo(descriptor, cabecera, sizeof(*cabecera)) != 0) {
+        return -1;
+    }
+    return recibirTodo(descriptor, votos, numCandidatos * sizeof(long long));
+}
+
+static int compararLatencias(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int ejecutarCargaServicio(const char *ruta, int numClientes, int lotesPorCliente, int boletasPorLote,
+                          uint64_t semilla, int cerrar) {
+    SaludoServicio saludo;
+    int control = conectarServicio(ruta, &saludo);
+    if (control < 0) {
+        printf("Error: No se pudo conectar al servicio en %s\n", ruta);
+        return -1;
+    }
+    int numCandidatos = (int)saludo.numCandidatos;
+    if (boletasPorLote <= 0 || (uint32_t)boletasPorLote > saludo.maxBoletasMensaje) {
+        printf("Error: El lote debe tener entre 1 y %u boletas\n", saludo.maxBoletasMensaje);
+        close(control);
+        return -1;
+    }
+
+    // Lotes ya generados y contados aqui, para comprobar lo que cuenta el servicio
+    AlmacenBoletas lotes[LOTES_DISTINTOS_CARGA];
+    long long *esperado = (long long *)calloc((numCandidatos + 1) * (LOTES_DISTINTOS_CARGA + 1), sizeof(long long));
+    long long numLotes = (long long)numClientes * lotesPorCliente;
+    double *latencias = (double *)malloc(numLotes * sizeof(double));
+    long long *votosAntes = (long long *)malloc(numCandidatos * sizeof(long long));
+    long long *votosDespues = (long long *)malloc(numCandidatos * sizeof(long long));
+    int listos = 0;
+    for (; esperado != NULL && listos < LOTES_DISTINTOS_CARGA; listos++) {
+        if (crearAlmacenBoletas(&lotes[listos], boletasPorLote, numCandidatos, 0) != 0) {
+            break;
+        }
+        generarBoletasAleatorias(&lotes[listos], semilla + listos, 1);
+        long long *fila = esperado + (size_t)listos * (numCandidatos + 1);
+        contarVotosSecuencial(&lotes[listos], elegirNivelSimd(&lotes[listos], NULL), fila, &fila[numCandidatos]);
+    }
+    int error = listos < LOTES_DISTINTOS_CARGA || latencias == NULL || votosAntes == NULL || votosDespues == NULL;
+    if (!error && lotes[0].paso != saludo.pasoBoleta) {
+        printf("Error: El servicio usa mascaras de %u bytes y este cliente de %zu\n", saludo.pasoBoleta, lotes[0].paso);
+        error = 1;
+    }
+
+    CabeceraInstantanea antes, despues;
+    if (!error && pedirInstantanea(control, numCandidatos, &antes, votosAntes) != 0) {
+        printf("Error: El servicio no respondio la instantanea\n");
+        error = 1;
+    }
+
+    long long fallidos = 0, agrupacion = 0;
+    double inicio = obtenerTiempoAlta();
+    if (!error) {
+        printf("\n=== CARGA SOBRE EL SERVICIO DE CONTEO ===\n");
+        printf("%d clientes x %d lotes de %d boletas (%d candidatos)\n\n",
+               numClientes, lotesPorCliente, boletasPorLote, numCandidatos);
+        #pragma omp parallel num_threads(numClientes) reduction(+: fallidos, agrupacion)
+        {
+            int c = omp_get_thread_num();
+            SaludoServicio propio;
+            int descriptor = conectarServicio(ruta, &propio);
+            for (int l = 0; l < lotesPorCliente; l++) {
+                long long indice = (long long)c * lotesPorCliente + l;
+                const AlmacenBoletas *lote = &lotes[indice % LOTES_DISTINTOS_CARGA];
+                CabeceraMensaje mensaje = {MENSAJE_LOTE, (uint32_t)boletasPorLote};
+                RespuestaLote respuesta;
+                double enviado = obtenerTiempoAlta();
+                if (descriptor < 0 || enviarTodo(descriptor, &mensaje, sizeof(mensaje)) != 0 ||
+                    enviarTodo(descriptor, lote->datos, (size_t)boletasPorLote * lote->paso) != 0 ||
+                    recibirTodo(descriptor, &respuesta, sizeof(respuesta)) != 0 || respuesta.estado != 0) {
+                    fallidos += lotesPorCliente - l;
+                    for (; l < lotesPorCliente; l++) {
+                        latencias[(long long)c * lotesPorCliente + l] = 0;
+                    }
+                    break;
+                }
+                latencias[indice] = obtenerTiempoAlta() - enviado;
+                agrupacion += respuesta.mensajesAgrupados;
+            }
+            if (descriptor >= 0) {
+                close(descriptor);
+            }
+        }
+    }
+    double segundos = obtenerTiempoAlta() - inicio;
+
+    if (!error && pedirInstantanea(control, numCandidatos, &despues, votosDespues) != 0) {
+        printf("Error: El servicio no respondio la instantanea\n");
+        error = 1;
+    }
+    if (!error) {
+        // Lo que deberia haber sumado el servicio con los lotes que se mandaron
+        long long *total = esperado + (size_t)LOTES_DISTINTOS_CARGA * (numCandidatos + 1);
+        for (long long i = 0; i < numLotes; i++) {
+            const long long *fila = esperado + (size_t)(i % LOTES_DISTINTOS_CARGA) * (numCandidatos + 1);
+            for (int j = 0; j <= numCandidatos; j++) {
+                total[j] += fila[j];
+            }
+        }
+        int coincide = fallidos == 0 && despues.votosNulos - antes.votosNulos == total[numCandidatos];
+        for (int j = 0; j < numCandidatos; j++) {
+            coincide &= votosDespues[j] - votosAntes[j] == total[j];
+        }
+
+        long long enviados = numLotes - fallidos;
+        qsort(latencias, numLotes, sizeof(double), compararLatencias);
+        const double *validas = latencias + fallidos;
+        printf("  Lotes enviados:     %lld (%lld fallidos)\n", enviados, fallidos);
+        printf("  Ingesta sostenida:  %.1f M boletas/s (%.3f s)\n",
+               (double)enviados * boletasPorLote / segundos / 1e6, segundos);
+        if (enviados > 0) {
+            printf("  Latencia por lote:  p50 %.1f us, p99 %.1f us, max %.1f us\n",
+                   validas[enviados / 2] * 1e6, validas[(long long)(enviados * 0.99)] * 1e6,
+                   validas[enviados - 1] * 1e6);
+            printf("  Agrupacion:         %.2f lotes por conteo en el servicio\n", (double)agrupacion / enviados);
+        }
+        printf("  Instantanea:        %lld boletas nuevas, %s a los lotes enviados\n",
+               (long long)(despues.numBoletas - antes.numBoletas), coincide ? "iguales" : "DIFERENTES");
+        error = !coincide;
+    }
+
+    if (cerrar) {
+        CabeceraMensaje mensaje = {MENSAJE_CERRAR, 0};
+        RespuestaLote respuesta;
+        if (enviarTodo(control, &mensaje, sizeof(mensaje)) != 0 ||
+            recibirTodo(control, &respuesta, sizeof(respuesta)) != 0) {
+            printf("Error: El servicio no confirmo el cierre\n");
+            error = 1;
+        }
+    }
+    close(control);
+    for (int k = 0; k < listos; k++) {
+        liberarAlmacenBoletas(&lotes[k]);
+    }
+    free(esperado);
+    free(latencias);
+    free(votosAntes);
+    free(votosDespues);
+    return error ? -1 : 0;
+}
+
+#endif